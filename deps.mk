@@ -276,6 +276,8 @@ $(OBJDIR)/src/deark-char.o: src/deark-char.c src/deark-config.h \
  src/deark-private.h src/deark.h
 $(OBJDIR)/src/deark-cmd.o: src/deark-cmd.c src/deark-config.h \
  src/deark-user.h src/deark.h src/deark-version.h
+$(OBJDIR)/src/deark-crcbench.o: src/deark-crcbench.c src/deark-config.h \
+ src/deark-private.h src/deark.h src/deark-user.h
 $(OBJDIR)/src/deark-data.o: src/deark-data.c src/deark-config.h \
  src/deark-private.h src/deark.h
 $(OBJDIR)/src/deark-dbuf.o: src/deark-dbuf.c src/deark-config.h \
@@ -40,27 +40,18 @@ done:
 
 static void do_bitmap(deark *c, lctx *d, dbuf *unc_pixels)
 {
-	i64 i, j;
 	i64 rowspan;
-	u32 clr;
 	de_bitmap *img = NULL;
-	u8 b;
 
 	rowspan = (d->w * d->bpp +7)/8;
 
 	img = de_bitmap_create(c, d->w, d->h, 3);
 
-	for(j=0; j<d->h; j++) {
-		for(i=0; i<d->w; i++) {
-			if(d->bpp<=8) {
-				b = de_get_bits_symbol(unc_pixels, d->bpp, j*rowspan, i);
-				clr = d->pal[(unsigned int)b];
-			}
-			else {
-				clr = dbuf_getRGB(unc_pixels, j*rowspan + i*3, 0);
-			}
-			de_bitmap_setpixel_rgb(img, i, j, clr);
-		}
+	if(d->bpp<=8) {
+		de_convert_image_paletted(unc_pixels, 0, d->bpp, rowspan, d->pal, img, 0);
+	}
+	else {
+		de_convert_image_rgb(unc_pixels, 0, rowspan, 3, img, 0);
 	}
 
 	de_bitmap_write_to_file(img, NULL, 0);
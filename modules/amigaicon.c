@@ -831,4 +831,5 @@ void de_module_amigaicon(deark *c, struct deark_module_info *mi)
 	mi->desc = "Amiga Workbench icon (.info), NewIcons, GlowIcons";
 	mi->run_fn = de_run_amigaicon;
 	mi->identify_fn = de_identify_amigaicon;
+	de_module_add_signature(c, mi, 0, "\xe3\x10", 2);
 }
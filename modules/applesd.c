@@ -493,5 +493,7 @@ void de_module_applesd(deark *c, struct deark_module_info *mi)
 	mi->desc = "AppleSingle/AppleDouble";
 	mi->run_fn = de_run_applesd;
 	mi->identify_fn = de_identify_applesd;
+	de_module_add_signature(c, mi, 0, "\x00\x05\x16\x07", 4);
+	de_module_add_signature(c, mi, 0, "\x00\x05\x16\x00", 4);
 	mi->help_fn = de_help_applesd;
 }
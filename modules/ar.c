@@ -186,4 +186,5 @@ void de_module_ar(deark *c, struct deark_module_info *mi)
 	mi->desc = "ar archive";
 	mi->run_fn = de_run_ar;
 	mi->identify_fn = de_identify_ar;
+	de_module_add_signature(c, mi, 0, "!<arch>\x0a", 8);
 }
@@ -548,6 +548,7 @@ static void do_extract_member_file(deark *c, lctx *d, struct member_data *md,
 	dcmpro.f = outf;
 	dcmpro.len_known = 1;
 	dcmpro.expected_len = md->orig_size;
+	dcmpro.skip_if_unwanted = 1;
 
 	if(dcmpri.pos + dcmpri.len > dcmpri.f->len) {
 		de_err(c, "%s: Data goes beyond end of file", ucstring_getpsz_d(md->fn));
@@ -560,6 +561,7 @@ static void do_extract_member_file(deark *c, lctx *d, struct member_data *md,
 			de_dfilter_get_errmsg(c, &dres));
 		goto done;
 	}
+	if(dres.output_skipped) goto done;
 
 	md->crc_calc = de_crcobj_getval(d->crco);
 	de_dbg(c, "crc (calculated): 0x%04x", (unsigned int)md->crc_calc);
@@ -430,6 +430,7 @@ void de_module_arcfs(deark *c, struct deark_module_info *mi)
 	mi->desc = "ArcFS (RISC OS archive)";
 	mi->run_fn = de_run_arcfs;
 	mi->identify_fn = de_identify_arcfs;
+	de_module_add_signature(c, mi, 0, "Archive\x00", 8);
 	mi->help_fn = de_help_arcfs;
 }
 
@@ -543,4 +544,5 @@ void de_module_squash(deark *c, struct deark_module_info *mi)
 	mi->desc = "Squash (RISC OS compressed file)";
 	mi->run_fn = de_run_squash;
 	mi->identify_fn = de_identify_squash;
+	de_module_add_signature(c, mi, 0, "SQSH", 4);
 }
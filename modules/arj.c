@@ -176,20 +176,14 @@ struct method4_ctx {
 	struct de_bitreader bitrd;
 };
 
-static void method4_lz77buf_writebytecb(struct de_lz77buffer *rb, const u8 n)
+static void method4_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct method4_ctx *cctx = (struct method4_ctx*)rb->userdata;
 
-	if(cctx->stop_flag) return;
-	if(cctx->dcmpro->len_known) {
-		if(cctx->nbytes_written >= cctx->dcmpro->expected_len) {
-			cctx->stop_flag = 1;
-			return;
-		}
+	if(de_dfilter_write_to_output(cctx->dcmpro, &cctx->nbytes_written, buf, buf_len)) {
+		cctx->stop_flag = 1;
 	}
-
-	dbuf_writebyte(cctx->dcmpro->f, n);
-	cctx->nbytes_written++;
 }
 
 static UI method4_read_a_length_code(struct method4_ctx *cctx)
@@ -236,6 +230,8 @@ static void decompress_method_4(deark *c, lctx *d, struct member_data *md,
 	struct method4_ctx *cctx = NULL;
 	struct de_lz77buffer *ringbuf = NULL;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	cctx = de_malloc(c, sizeof(struct method4_ctx));
 	cctx->dcmpro = dcmpro;
 	cctx->bitrd.f = dcmpri->f;
@@ -244,7 +240,7 @@ static void decompress_method_4(deark *c, lctx *d, struct member_data *md,
 
 	// The maximum offset that can be encoded is 15871, so a 16K history is enough.
 	ringbuf = de_lz77buffer_create(c, 16384);
-	ringbuf->writebyte_cb = method4_lz77buf_writebytecb;
+	ringbuf->writebytes_cb = method4_lz77buf_writebytescb;
 	ringbuf->userdata = (void*)cctx;
 
 	while(1) {
@@ -273,7 +269,7 @@ static void decompress_method_4(deark *c, lctx *d, struct member_data *md,
 
 done:
 	dres->bytes_consumed_valid = 1;
-	dres->bytes_consumed = cctx->bitrd.curpos - dcmpri->pos;
+	dres->bytes_consumed = de_bitreader_get_curpos(&cctx->bitrd) - dcmpri->pos;
 	de_lz77buffer_destroy(c, ringbuf);
 	de_free(c, cctx);
 }
@@ -361,6 +357,7 @@ static void extract_member_file(deark *c, lctx *d, struct member_data *md)
 	dcmpro.f = outf;
 	dcmpro.len_known = 1;
 	dcmpro.expected_len = md->orig_len;
+	dcmpro.skip_if_unwanted = 1;
 
 	de_crcobj_reset(d->crco);
 	dbuf_set_writelistener(outf, our_writelistener_cb, (void*)d->crco);
@@ -383,6 +380,7 @@ static void extract_member_file(deark *c, lctx *d, struct member_data *md)
 			de_dfilter_get_errmsg(c, &dres));
 		goto done;
 	}
+	if(dres.output_skipped) goto done;
 
 	crc_calc = de_crcobj_getval(d->crco);
 	de_dbg(c, "crc (calculated): 0x%08x", (UI)crc_calc);
@@ -1070,4 +1070,5 @@ void de_module_asf(deark *c, struct deark_module_info *mi)
 	mi->desc = "ASF, WMV, WMA";
 	mi->run_fn = de_run_asf;
 	mi->identify_fn = de_identify_asf;
+	de_module_add_signature(c, mi, 0, "\x30\x26\xb2\x75", 4);
 }
@@ -528,16 +528,9 @@ static void do_image_paletted(deark *c, lctx *d, dbuf *bits, i64 bits_offset)
 static void do_image_24bit(deark *c, lctx *d, dbuf *bits, i64 bits_offset)
 {
 	de_bitmap *img = NULL;
-	i64 i, j;
-	u32 clr;
 
 	img = bmp_bitmap_create(c, d, 3);
-	for(j=0; j<d->height; j++) {
-		for(i=0; i<d->width; i++) {
-			clr = dbuf_getRGB(bits, bits_offset + j*d->rowspan + 3*i, DE_GETRGBFLAG_BGR);
-			de_bitmap_setpixel_rgb(img, i, j, clr);
-		}
-	}
+	de_convert_image_rgb(bits, bits_offset, d->rowspan, 3, img, DE_GETRGBFLAG_BGR);
 	de_bitmap_write_to_file_finfo(img, d->fi, 0);
 	de_bitmap_destroy(img);
 }
@@ -885,6 +878,7 @@ void de_module_bmp(deark *c, struct deark_module_info *mi)
 	mi->desc = "BMP (Windows or OS/2 bitmap)";
 	mi->run_fn = de_run_bmp;
 	mi->identify_fn = de_identify_bmp;
+	de_module_add_signature(c, mi, 0, "BM", 2);
 }
 
 static void de_run_dib(deark *c, de_module_params *mparams)
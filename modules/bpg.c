@@ -175,4 +175,5 @@ void de_module_bpg(deark *c, struct deark_module_info *mi)
 	mi->desc2 = "resources only";
 	mi->run_fn = de_run_bpg;
 	mi->identify_fn = de_identify_bpg;
+	de_module_add_signature(c, mi, 0, "\x42\x50\x47\xfb", 4);
 }
@@ -115,8 +115,7 @@ static int do_4color(deark *c, lctx *d)
 {
 	// TODO: This may not be the right palette.
 	static const u32 default_palette[4] = { 0x000000, 0x55ffff, 0xff55ff, 0xffffff };
-	u32 palette[4];
-	int palent;
+	de_color palette[4];
 	i64 i,j;
 	i64 pos;
 	i64 src_rowspan;
@@ -167,18 +166,16 @@ static int do_4color(deark *c, lctx *d)
 	src_rowspan = (img->width+3)/4;
 
 	for(j=0;j<img->height;j++) {
-		for(i=0;i<img->width;i++) {
-			if(d->interlaced) {
-				// Image is interlaced. Even-numbered scanlines are stored first.
-				palent = (int)de_get_bits_symbol(c->infile, 2,
-					pos + (j%2)*8192 + (j/2)*src_rowspan, i);
-			}
-			else {
-				palent = (int)de_get_bits_symbol(c->infile, 2,
-					pos + j*src_rowspan, i);
-			}
-			de_bitmap_setpixel_rgb(img, i, j, palette[palent]);
+		i64 rowpos;
+
+		if(d->interlaced) {
+			// Image is interlaced. Even-numbered scanlines are stored first.
+			rowpos = pos + (j%2)*8192 + (j/2)*src_rowspan;
+		}
+		else {
+			rowpos = pos + j*src_rowspan;
 		}
+		de_convert_row_paletted(c->infile, rowpos, 2, palette, img, j, 0);
 	}
 
 	de_bitmap_write_to_file(img, NULL, 0);
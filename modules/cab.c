@@ -415,4 +415,5 @@ void de_module_cab(deark *c, struct deark_module_info *mi)
 	mi->desc = "Microsoft Cabinet (CAB)";
 	mi->run_fn = de_run_cab;
 	mi->identify_fn = de_identify_cab;
+	de_module_add_signature(c, mi, 0, "MSCF", 4);
 }
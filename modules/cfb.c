@@ -177,99 +177,92 @@ static void describe_sec_id(deark *c, lctx *d, i64 sec_id,
 	}
 }
 
-// Copy a stream (with a known byte size) to a dbuf.
-static void copy_normal_stream_to_dbuf(deark *c, lctx *d, i64 first_sec_id,
-	i64 stream_startpos, i64 stream_size,
-	dbuf *outf)
+// Returns a read-only dbuf that presents the stream (with a known byte size)
+// as a contiguous file. The data is not copied. The caller must close it.
+static dbuf *open_normal_stream(deark *c, lctx *d, i64 first_sec_id,
+	i64 stream_size)
 {
+	dbuf *f;
 	i64 sec_id;
-	i64 bytes_left_to_copy;
-	i64 bytes_left_to_skip;
+	i64 bytes_left;
 
-	if(stream_size<=0) return;
-	if(stream_startpos+stream_size > c->infile->len) {
+	f = dbuf_open_input_extents(c->infile);
+	if(stream_size > c->infile->len) {
 		// This is a not-too-strict emergency brake. If the file has been
 		// truncated, we might still be able to process some of the data
 		// that is there.
-		stream_size = c->infile->len - stream_startpos;
+		stream_size = c->infile->len;
 	}
 
-	bytes_left_to_copy = stream_size;
-	bytes_left_to_skip = stream_startpos;
+	bytes_left = stream_size;
 	sec_id = first_sec_id;
-	while(bytes_left_to_copy > 0) {
-		i64 sec_offs;
-		i64 bytes_to_copy;
-		i64 bytes_to_skip;
+	while(bytes_left > 0) {
+		i64 n;
 
 		if(sec_id<0) break;
-		sec_offs = sec_id_to_offset(c, d, sec_id);
-
-		bytes_to_skip = bytes_left_to_skip;
-		if(bytes_to_skip > d->sec_size) bytes_to_skip = d->sec_size;
-
-		bytes_to_copy = d->sec_size - bytes_to_skip;
-		if(bytes_to_copy > bytes_left_to_copy) bytes_to_copy = bytes_left_to_copy;
-
-		dbuf_copy(c->infile, sec_offs + bytes_to_skip, bytes_to_copy, outf);
-
-		bytes_left_to_copy -= bytes_to_copy;
-		bytes_left_to_skip -= bytes_to_skip;
+		n = de_min_int(d->sec_size, bytes_left);
+		dbuf_add_extent(f, sec_id_to_offset(c, d, sec_id), n);
+		bytes_left -= n;
 		sec_id = get_next_sec_id(c, d, sec_id);
 	}
+	return f;
 }
 
-// Same as copy_normal_stream_to_dbuf(), but for mini streams.
-static void copy_mini_stream_to_dbuf(deark *c, lctx *d, i64 first_minisec_id,
-	i64 stream_startpos, i64 stream_size,
-	dbuf *outf)
+// Same as open_normal_stream(), but for mini streams.
+static dbuf *open_mini_stream(deark *c, lctx *d, i64 first_minisec_id,
+	i64 stream_size)
 {
+	dbuf *f;
 	i64 minisec_id;
-	i64 bytes_left_to_copy;
-	i64 bytes_left_to_skip;
+	i64 bytes_left;
 
-	if(!d->mini_sector_stream) return;
-	if(stream_size<=0 || stream_size>c->infile->len ||
-		stream_size>d->mini_sector_stream->len)
-	{
-		return;
+	if(!d->mini_sector_stream) {
+		// Return an empty dbuf
+		return dbuf_open_input_extents(c->infile);
+	}
+
+	f = dbuf_open_input_extents(d->mini_sector_stream);
+	if(stream_size>c->infile->len || stream_size>d->mini_sector_stream->len) {
+		return f;
 	}
 
-	bytes_left_to_copy = stream_size;
-	bytes_left_to_skip = stream_startpos;
+	bytes_left = stream_size;
 	minisec_id = first_minisec_id;
-	while(bytes_left_to_copy > 0) {
-		i64 minisec_offs;
-		i64 bytes_to_copy;
-		i64 bytes_to_skip;
+	while(bytes_left > 0) {
+		i64 n;
 
 		if(minisec_id<0) break;
-		minisec_offs = minisec_id * d->mini_sector_size;
-
-		bytes_to_skip = bytes_left_to_skip;
-		if(bytes_to_skip > d->mini_sector_size) bytes_to_skip = d->mini_sector_size;
-
-		bytes_to_copy = d->mini_sector_size - bytes_to_skip;
-		if(bytes_to_copy > bytes_left_to_copy) bytes_to_copy = bytes_left_to_copy;
-
-		dbuf_copy(d->mini_sector_stream, minisec_offs + bytes_to_skip, bytes_to_copy, outf);
-
-		bytes_left_to_copy -= bytes_to_copy;
-		bytes_left_to_skip -= bytes_to_skip;
+		n = de_min_int(d->mini_sector_size, bytes_left);
+		dbuf_add_extent(f, minisec_id * d->mini_sector_size, n);
+		bytes_left -= n;
 		minisec_id = get_next_minisec_id(c, d, minisec_id);
 	}
+	return f;
+}
+
+static dbuf *open_any_stream(deark *c, lctx *d, struct dir_entry_info *dei)
+{
+	if(dei->is_mini_stream) {
+		return open_mini_stream(c, d, dei->minisec_id, dei->stream_size);
+	}
+	return open_normal_stream(c, d, dei->normal_sec_id, dei->stream_size);
 }
 
+// Copy part of a stream to a dbuf.
 static void copy_any_stream_to_dbuf(deark *c, lctx *d, struct dir_entry_info *dei,
 	i64 stream_startpos, i64 stream_size,
 	dbuf *outf)
 {
-	if(dei->is_mini_stream) {
-		copy_mini_stream_to_dbuf(c, d, dei->minisec_id, stream_startpos, stream_size, outf);
+	dbuf *inf;
+
+	inf = open_any_stream(c, d, dei);
+	if(stream_startpos+stream_size > inf->len) {
+		stream_size = inf->len - stream_startpos;
 	}
-	else {
-		copy_normal_stream_to_dbuf(c, d, dei->normal_sec_id, stream_startpos, stream_size, outf);
+	if(stream_size>0) {
+		dbuf_copy(inf, stream_startpos, stream_size, outf);
 	}
+	dbuf_close(inf);
 }
 
 static int do_header(deark *c, lctx *d)
@@ -758,8 +751,7 @@ static void do_OfficeArtStream(deark *c, lctx *d, struct dir_entry_info *dei)
 
 	de_dbg(c, "OfficeArt stream, len=%"I64_FMT, dei->stream_size);
 	de_dbg_indent(c, 1);
-	tmpstream = dbuf_create_membuf(c, dei->stream_size, 0x1);
-	copy_any_stream_to_dbuf(c, d, dei, 0, dei->stream_size, tmpstream);
+	tmpstream = open_any_stream(c, d, dei);
 	if(tmpstream->len < dei->stream_size) {
 		de_warn(c, "OfficeArt stream might have been truncated");
 	}
@@ -993,15 +985,12 @@ static void do_StreamNamedThumbnail(deark *c, lctx *d, struct dir_entry_info *de
 	if(dei->stream_size<32 || dei->stream_size>DE_MAX_SANE_OBJECT_SIZE) {
 		goto done;
 	}
-	f = dbuf_create_membuf(c, 0, 0);
+	f = open_any_stream(c, d, dei);
 
-	// Start by reading just a little, to figure out the data type
-	copy_any_stream_to_dbuf(c, d, dei, 0, 16, f);
 	size1 = dbuf_getu32le(f, 0);
 	if(size1+4 != dei->stream_size) goto done;
 	if(dbuf_memcmp(f, 4, "UI\x00\x00", 4)) goto done;
 
-	copy_any_stream_to_dbuf(c, d, dei, 16, dei->stream_size-16, f);
 	do_Corel_UIformat(c, d, dei, f, 4, size1-4, 1);
 
 done:
@@ -1015,10 +1004,8 @@ static void do_StreamNamedImages(deark *c, lctx *d, struct dir_entry_info *dei)
 	if(dei->stream_size<32 || dei->stream_size>DE_MAX_SANE_OBJECT_SIZE) {
 		goto done;
 	}
-	f = dbuf_create_membuf(c, 0, 0);
+	f = open_any_stream(c, d, dei);
 
-	// Start by reading just a little, to figure out the data type
-	copy_any_stream_to_dbuf(c, d, dei, 0, 16, f);
 	if(dbuf_memcmp(f, 4, "\x01\x00\x00\x00\xff\xd8\xff", 7) &&
 		dbuf_memcmp(f, 4, "\x00\x00\x00\x00\x55\x49\x00\x00", 8))
 	{
@@ -1029,7 +1016,6 @@ static void do_StreamNamedImages(deark *c, lctx *d, struct dir_entry_info *dei)
 	}
 
 	// This is an object found in Corel Print House (.CPH) and similar files.
-	copy_any_stream_to_dbuf(c, d, dei, 16, dei->stream_size-16, f);
 	do_CorelImages_internal(c, d, dei, f);
 
 done:
@@ -1072,8 +1058,7 @@ static int read_thumbsdb_catalog(deark *c, lctx *d, struct dir_entry_info *dei)
 	de_dbg(c, "reading thumbsdb catalog");
 	de_dbg_indent(c, 1);
 
-	catf = dbuf_create_membuf(c, dei->stream_size, 0);
-	copy_any_stream_to_dbuf(c, d, dei, 0, dei->stream_size, catf);
+	catf = open_any_stream(c, d, dei);
 
 	item_len = dbuf_getu16le(catf, 0);
 	de_dbg(c, "header size: %d", (int)item_len); // (?)
@@ -1140,8 +1125,7 @@ static void do_cfb_olepropertyset(deark *c, lctx *d, struct dir_entry_info *dei,
 	int saved_indent_level;
 
 	if(dei->stream_size>1000000) goto done;
-	f = dbuf_create_membuf(c, dei->stream_size, 1);
-	copy_any_stream_to_dbuf(c, d, dei, 0, dei->stream_size, f);
+	f = open_any_stream(c, d, dei);
 
 	de_dbg_indent_save(c, &saved_indent_level);
 	if(is_summaryinfo) {
@@ -1164,8 +1148,7 @@ static void read_mini_sector_stream(deark *c, lctx *d, i64 first_sec_id, i64 str
 	if(d->mini_sector_stream) return; // Already done
 
 	de_dbg(c, "reading mini sector stream (%d bytes)", (int)stream_size);
-	d->mini_sector_stream = dbuf_create_membuf(c, 0, 0);
-	copy_normal_stream_to_dbuf(c, d, first_sec_id, 0, stream_size, d->mini_sector_stream);
+	d->mini_sector_stream = open_normal_stream(c, d, first_sec_id, stream_size);
 }
 
 // Reads the directory stream into d->dir, and sets d->num_dir_entries.
@@ -1904,5 +1887,6 @@ void de_module_cfb(deark *c, struct deark_module_info *mi)
 	mi->desc = "Microsoft Compound File Binary File";
 	mi->run_fn = de_run_cfb;
 	mi->identify_fn = de_identify_cfb;
+	de_module_add_signature(c, mi, 0, "\xd0\xcf\x11\xe0", 4);
 	mi->help_fn = de_help_cfb;
 }
@@ -57,6 +57,12 @@ struct dms_track_info {
 	u32 crc_header_reported;
 	u32 cksum_calc;
 	char shortname[80];
+
+	// Results of decompression. These are recorded instead of being reported
+	// right away, because decompression may happen on a worker thread.
+	u8 dcmpr_ok;
+	char errmsg[160];
+	char warnmsg[160];
 };
 
 struct dms_tracks_by_file_order_entry {
@@ -72,6 +78,12 @@ struct dms_tracks_by_track_num_entry {
 
 struct dmsheavy_cmpr_state;
 
+// The decompression state that may persist from one track to the next.
+struct dms_dcmpr_state {
+	struct dmsmedium_cmpr_state *saved_medium_state;
+	struct dmsheavy_cmpr_state *saved_heavy_state;
+};
+
 struct dmsctx {
 	UI info_bits;
 	UI cmpr_type;
@@ -84,8 +96,8 @@ struct dmsctx {
 	// Entries potentially in use: .first_track <= n <= .last_track
 	struct dms_tracks_by_track_num_entry tracks_by_track_num[DMS_MAX_TRACKS];
 
-	struct dmsmedium_cmpr_state *saved_medium_state;
-	struct dmsheavy_cmpr_state *saved_heavy_state;
+	// State used when tracks are decompressed sequentially
+	struct dms_dcmpr_state dst;
 };
 
 static const char *dms_get_cmprtype_name(UI n)
@@ -185,15 +197,12 @@ static int lzh_have_enough_output(struct lzh_ctx *cctx)
 	return 0;
 }
 
-static void lha5like_lz77buf_writebytecb(struct de_lz77buffer *rb, u8 n)
+static void lha5like_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct lzh_ctx *cctx = (struct lzh_ctx*)rb->userdata;
 
-	if(lzh_have_enough_output(cctx)) {
-		return;
-	}
-	dbuf_writebyte(cctx->dcmpro->f, n);
-	cctx->nbytes_written++;
+	de_dfilter_write_to_output(cctx->dcmpro, &cctx->nbytes_written, buf, buf_len);
 }
 
 static UI read_next_code_using_tree(struct lzh_ctx *cctx, struct lzh_tree_wrapper *tree)
@@ -310,7 +319,7 @@ static void decompress_dms_heavy(struct lzh_ctx *cctx, struct dmslzh_params *lzh
 	}
 
 	hvst->ringbuf->userdata = (void*)cctx;
-	hvst->ringbuf->writebyte_cb = lha5like_lz77buf_writebytecb;
+	hvst->ringbuf->writebytes_cb = lha5like_lz77buf_writebytescb;
 
 	if(!cctx->dcmpro->len_known) {
 		// I think we (may) have to know the output length, because zero-length Huffman
@@ -439,7 +448,7 @@ static void dmslzh_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
 	decompress_dms_heavy(cctx, lzhp, hvst);
 
 	hvst->ringbuf->userdata = NULL;
-	hvst->ringbuf->writebyte_cb = NULL;
+	hvst->ringbuf->writebytes_cb = NULL;
 	lzhp->heavy_state = hvst;
 	hvst = NULL;
 
@@ -449,8 +458,7 @@ static void dmslzh_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
 		goto done;
 	}
 
-	cctx->dres->bytes_consumed = cctx->bitrd.curpos - cctx->dcmpri->pos;
-	cctx->dres->bytes_consumed -= cctx->bitrd.bbll.nbits_in_bitbuf / 8;
+	cctx->dres->bytes_consumed = de_bitreader_get_curpos(&cctx->bitrd) - cctx->dcmpri->pos;
 	if(cctx->dres->bytes_consumed<0) {
 		cctx->dres->bytes_consumed = 0;
 	}
@@ -686,15 +694,12 @@ static void do_mediumlz77_internal(struct medium_ctx *mctx, struct dmsmedium_cmp
 	de_lz77buffer_set_curpos(mdst->ringbuf, mdst->ringbuf->curpos + 66);
 }
 
-static void medium_lz77buf_writebytecb(struct de_lz77buffer *rb, u8 n)
+static void medium_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct medium_ctx *mctx = (struct medium_ctx *)rb->userdata;
 
-	if(medium_have_enough_output(mctx)) {
-		return;
-	}
-	dbuf_writebyte(mctx->dcmpro->f, n);
-	mctx->nbytes_written++;
+	de_dfilter_write_to_output(mctx->dcmpro, &mctx->nbytes_written, buf, buf_len);
 }
 
 static void mediumlz77_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
@@ -723,12 +728,12 @@ static void mediumlz77_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
 		de_lz77buffer_set_curpos(mdst->ringbuf, 0x3fbe);
 	}
 	mdst->ringbuf->userdata = (void*)mctx;
-	mdst->ringbuf->writebyte_cb = medium_lz77buf_writebytecb;
+	mdst->ringbuf->writebytes_cb = medium_lz77buf_writebytescb;
 
 	do_mediumlz77_internal(mctx, mdst);
 
 	// Give the 'state' object back to the caller.
-	mdst->ringbuf->writebyte_cb = NULL;
+	mdst->ringbuf->writebytes_cb = NULL;
 	mdst->ringbuf->userdata = NULL;
 	mdparams->medium_state = mdst;
 	mdst = NULL;
@@ -741,7 +746,7 @@ static void mediumlz77_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
 	}
 }
 
-static void do_decompress_medium(deark *c, struct dmsctx *d, struct dms_track_info *tri,
+static void do_decompress_medium(deark *c, struct dms_dcmpr_state *dst, struct dms_track_info *tri,
 	struct de_dfilter_in_params *dcmpri, struct de_dfilter_out_params *dcmpro,
 	struct de_dfilter_results *dres)
 {
@@ -750,8 +755,8 @@ static void do_decompress_medium(deark *c, struct dmsctx *d, struct dms_track_in
 
 	de_zeromem(&mdparams, sizeof(struct dmsmedium_params));
 	if(tri->is_real) {
-		mdparams.medium_state = d->saved_medium_state;
-		d->saved_medium_state = NULL;
+		mdparams.medium_state = dst->saved_medium_state;
+		dst->saved_medium_state = NULL;
 	}
 
 	de_zeromem(&tlp, sizeof(struct de_dcmpr_two_layer_params));
@@ -766,7 +771,7 @@ static void do_decompress_medium(deark *c, struct dmsctx *d, struct dms_track_in
 	de_dfilter_decompress_two_layer(c, &tlp);
 
 	if(tri->is_real) {
-		d->saved_medium_state = mdparams.medium_state;
+		dst->saved_medium_state = mdparams.medium_state;
 	}
 	else {
 		destroy_medium_state(c, mdparams.medium_state);
@@ -775,7 +780,7 @@ static void do_decompress_medium(deark *c, struct dmsctx *d, struct dms_track_in
 
 ///////////////////////////////////
 
-static void do_decompress_heavy_lzh_rle(deark *c, struct dmsctx *d, struct dms_track_info *tri,
+static void do_decompress_heavy_lzh_rle(deark *c, struct dms_track_info *tri,
 	struct de_dfilter_in_params *dcmpri, struct de_dfilter_out_params *dcmpro,
 	struct de_dfilter_results *dres, struct dmslzh_params *lzhparams)
 {
@@ -793,7 +798,7 @@ static void do_decompress_heavy_lzh_rle(deark *c, struct dmsctx *d, struct dms_t
 	de_dfilter_decompress_two_layer(c, &tlp);
 }
 
-static void do_decompress_heavy(deark *c, struct dmsctx *d, struct dms_track_info *tri,
+static void do_decompress_heavy(deark *c, struct dms_dcmpr_state *dst, struct dms_track_info *tri,
 	struct de_dfilter_in_params *dcmpri, struct de_dfilter_out_params *dcmpro,
 	struct de_dfilter_results *dres)
 {
@@ -803,12 +808,12 @@ static void do_decompress_heavy(deark *c, struct dmsctx *d, struct dms_track_inf
 	lzhparams.cmpr_type = tri->cmpr_type;
 	lzhparams.dms_track_flags = tri->track_flags;
 	if(tri->is_real) {
-		lzhparams.heavy_state = d->saved_heavy_state;
-		d->saved_heavy_state = NULL;
+		lzhparams.heavy_state = dst->saved_heavy_state;
+		dst->saved_heavy_state = NULL;
 	}
 
 	if(tri->track_flags & 0x04) {
-		do_decompress_heavy_lzh_rle(c, d, tri, dcmpri, dcmpro, dres, &lzhparams);
+		do_decompress_heavy_lzh_rle(c, tri, dcmpri, dcmpro, dres, &lzhparams);
 	}
 	else {
 		// LZH, no RLE
@@ -816,44 +821,91 @@ static void do_decompress_heavy(deark *c, struct dmsctx *d, struct dms_track_inf
 	}
 
 	if(tri->is_real) {
-		d->saved_heavy_state = lzhparams.heavy_state;
+		dst->saved_heavy_state = lzhparams.heavy_state;
 	}
 	else {
 		destroy_heavy_state(c, lzhparams.heavy_state);
 	}
 }
 
-static void destroy_saved_dcrmpr_state(deark *c, struct dmsctx *d)
+static void destroy_saved_dcrmpr_state(deark *c, struct dms_dcmpr_state *dst)
 {
-	if(d->saved_medium_state) {
-		destroy_medium_state(c, d->saved_medium_state);
-		d->saved_medium_state = NULL;
+	if(dst->saved_medium_state) {
+		destroy_medium_state(c, dst->saved_medium_state);
+		dst->saved_medium_state = NULL;
 	}
-	if(d->saved_heavy_state) {
-		destroy_heavy_state(c, d->saved_heavy_state);
-		d->saved_heavy_state = NULL;
+	if(dst->saved_heavy_state) {
+		destroy_heavy_state(c, dst->saved_heavy_state);
+		dst->saved_heavy_state = NULL;
 	}
 }
 
-static int dms_decompress_track(deark *c, struct dmsctx *d, struct dms_track_info *tri,
-	dbuf *outf)
+static int dms_checksum_cbfn(struct de_bufferedreadctx *brctx, const u8 *buf,
+	i64 buf_len)
+{
+	u32 *cksum = (u32*)brctx->userdata;
+	i64 i;
+
+	for(i=0; i<buf_len; i++) {
+		*cksum += (u32)buf[i];
+	}
+	return 1;
+}
+
+// outf is presumed to be membuf containing one track, and nothing else.
+static u32 dms_calc_checksum(deark *c, dbuf *outf)
+{
+	u32 cksum = 0;
+
+	dbuf_buffered_read(outf, 0, outf->len, dms_checksum_cbfn, (void*)&cksum);
+	cksum &= 0xffff;
+	return cksum;
+}
+
+static void get_trackflags_descr(deark *c, de_ucstring *s, UI tflags1, UI cmpr)
+{
+	UI tflags = tflags1;
+
+	if(cmpr==5 || cmpr==6) {
+		if(tflags & 0x4) {
+			ucstring_append_flags_item(s, "w/RLE");
+			tflags -= 0x4;
+		}
+		if(tflags & 0x2) {
+			ucstring_append_flags_item(s, "track has Huffman tree defs");
+			tflags -= 0x2;
+		}
+	}
+	if(tflags & 0x1) {
+		ucstring_append_flags_item(s, "persist decompr. state");
+		tflags -= 0x1;
+	}
+	if(tflags>0) ucstring_append_flags_itemf(s, "0x%02x", tflags);
+}
+
+// Decompress a track (whose compressed data is in inf, at inf_pos) to outf
+// (which caller supplies as an empty membuf), and verify its checksum.
+// This does not print any messages, so that it can be run on a worker thread.
+// Instead, the results are recorded in tri, for dms_report_track_result().
+static void dms_decompress_track(deark *c, struct dms_dcmpr_state *dst,
+	struct dms_track_info *tri, dbuf *inf, i64 inf_pos, dbuf *outf)
 {
-	int retval = 0;
 	i64 unc_nbytes;
 	struct de_dfilter_in_params dcmpri;
 	struct de_dfilter_out_params dcmpro;
 	struct de_dfilter_results dres;
 
+	tri->dcmpr_ok = 0;
 	if(outf->len!=0) goto done;
 
-	if(tri->dpos + tri->cmpr_len > c->infile->len) {
-		de_err(c, "Track goes beyond end of file");
+	if(inf_pos + tri->cmpr_len > inf->len) {
+		de_strlcpy(tri->errmsg, "Track goes beyond end of file", sizeof(tri->errmsg));
 		goto done;
 	}
 
 	de_dfilter_init_objects(c, &dcmpri, &dcmpro, &dres);
-	dcmpri.f = c->infile;
-	dcmpri.pos = tri->dpos;
+	dcmpri.f = inf;
+	dcmpri.pos = inf_pos;
 	dcmpri.len = tri->cmpr_len;
 	dcmpro.f = outf;
 	dcmpro.len_known = 1;
@@ -869,20 +921,22 @@ static int dms_decompress_track(deark *c, struct dmsctx *d, struct dms_track_inf
 			&dcmpri, &dcmpro, &dres);
 	}
 	else if(tri->cmpr_type==DMSCMPR_MEDIUM) {
-		do_decompress_medium(c, d, tri, &dcmpri, &dcmpro, &dres);
+		do_decompress_medium(c, dst, tri, &dcmpri, &dcmpro, &dres);
 	}
 	else if(tri->cmpr_type==DMSCMPR_HEAVY1 || tri->cmpr_type==DMSCMPR_HEAVY2) {
-		do_decompress_heavy(c, d, tri, &dcmpri, &dcmpro, &dres);
+		do_decompress_heavy(c, dst, tri, &dcmpri, &dcmpro, &dres);
 	}
 	else {
-		de_err(c, "[%s] Unsupported compression method: %u (%s)",
+		de_snprintf(tri->errmsg, sizeof(tri->errmsg),
+			"[%s] Unsupported compression method: %u (%s)",
 			tri->shortname, tri->cmpr_type,
 			dms_get_cmprtype_name(tri->cmpr_type));
 		goto done;
 	}
 
 	if(dres.errcode) {
-		de_err(c, "[%s] Decompression failed: %s", tri->shortname,
+		de_snprintf(tri->errmsg, sizeof(tri->errmsg),
+			"[%s] Decompression failed: %s", tri->shortname,
 			de_dfilter_get_errmsg(c, &dres));
 		goto done;
 	}
@@ -892,82 +946,34 @@ static int dms_decompress_track(deark *c, struct dmsctx *d, struct dms_track_inf
 	dbuf_truncate(outf, tri->uncmpr_len);
 
 	if(unc_nbytes < tri->uncmpr_len) {
-		de_err(c, "[%s] Expected %"I64_FMT" decompressed bytes, got %"I64_FMT,
+		de_snprintf(tri->errmsg, sizeof(tri->errmsg),
+			"[%s] Expected %"I64_FMT" decompressed bytes, got %"I64_FMT,
 			tri->shortname, tri->uncmpr_len, unc_nbytes);
 		goto done;
 	}
 	if(unc_nbytes > tri->uncmpr_len) {
-		de_warn(c, "[%s] Expected %"I64_FMT" decompressed bytes, got %"I64_FMT,
+		de_snprintf(tri->warnmsg, sizeof(tri->warnmsg),
+			"[%s] Expected %"I64_FMT" decompressed bytes, got %"I64_FMT,
 			tri->shortname, tri->uncmpr_len, unc_nbytes);
 	}
 
-	retval = 1;
+	tri->cksum_calc = dms_calc_checksum(c, outf);
+	tri->dcmpr_ok = 1;
 
 done:
 	if(tri->is_real && !(tri->track_flags & 0x1)) {
-		destroy_saved_dcrmpr_state(c, d);
+		destroy_saved_dcrmpr_state(c, dst);
 	}
-	return retval;
-}
-
-static int dms_checksum_cbfn(struct de_bufferedreadctx *brctx, const u8 *buf,
-	i64 buf_len)
-{
-	u32 *cksum = (u32*)brctx->userdata;
-	i64 i;
-
-	for(i=0; i<buf_len; i++) {
-		*cksum += (u32)buf[i];
-	}
-	return 1;
-}
-
-// outf is presumed to be membuf containing one track, and nothing else.
-static u32 dms_calc_checksum(deark *c, dbuf *outf)
-{
-	u32 cksum = 0;
-
-	dbuf_buffered_read(outf, 0, outf->len, dms_checksum_cbfn, (void*)&cksum);
-	cksum &= 0xffff;
-	return cksum;
 }
 
-static void get_trackflags_descr(deark *c, de_ucstring *s, UI tflags1, UI cmpr)
-{
-	UI tflags = tflags1;
-
-	if(cmpr==5 || cmpr==6) {
-		if(tflags & 0x4) {
-			ucstring_append_flags_item(s, "w/RLE");
-			tflags -= 0x4;
-		}
-		if(tflags & 0x2) {
-			ucstring_append_flags_item(s, "track has Huffman tree defs");
-			tflags -= 0x2;
-		}
-	}
-	if(tflags & 0x1) {
-		ucstring_append_flags_item(s, "persist decompr. state");
-		tflags -= 0x1;
-	}
-	if(tflags>0) ucstring_append_flags_itemf(s, "0x%02x", tflags);
-}
-
-// Read track and decompress to outf (which caller supplies as an empty membuf).
+// Read the header of a track, and initialize tri.
 // track_idx: the index into d->tracks_by_file_order
-// Returns nonzero if successfully decompressed.
-static int dms_read_and_decompress_track(deark *c, struct dmsctx *d,
-	i64 track_idx, dbuf *outf)
+static void dms_read_track_header(deark *c, struct dmsctx *d,
+	i64 track_idx, struct dms_track_info *tri)
 {
 	i64 pos1, pos;
-	struct dms_track_info *tri = NULL;
 	de_ucstring *descr = NULL;
-	int retval = 0;
-	int saved_indent_level;
-
-	de_dbg_indent_save(c, &saved_indent_level);
 
-	tri = de_malloc(c, sizeof(struct dms_track_info));
 	pos1 = d->tracks_by_file_order[track_idx].file_pos;
 	tri->track_num = (i64)d->tracks_by_file_order[track_idx].track_num;
 	tri->is_real = d->tracks_by_file_order[track_idx].is_real;
@@ -1004,10 +1010,30 @@ static int dms_read_and_decompress_track(deark *c, struct dmsctx *d,
 
 	tri->dpos = pos1 + DMS_TRACK_HDR_LEN;
 	de_dbg(c, "cmpr data pos: %"I64_FMT, tri->dpos);
+	de_dbg_indent(c, -1);
+	ucstring_destroy(descr);
+}
+
+// Print the messages recorded by dms_decompress_track().
+// Returns nonzero if the track was successfully decompressed.
+static int dms_report_track_result(deark *c, struct dms_track_info *tri)
+{
+	int retval = 0;
+	int saved_indent_level;
 
-	if(!dms_decompress_track(c, d, tri, outf)) goto done;
+	de_dbg_indent_save(c, &saved_indent_level);
+	de_dbg_indent(c, 1);
+
+	if(!tri->dcmpr_ok) {
+		if(tri->errmsg[0]) {
+			de_err(c, "%s", tri->errmsg);
+		}
+		goto done;
+	}
+	if(tri->warnmsg[0]) {
+		de_warn(c, "%s", tri->warnmsg);
+	}
 
-	tri->cksum_calc = dms_calc_checksum(c, outf);
 	de_dbg(c, "checksum (calculated): 0x%04x", (UI)tri->cksum_calc);
 	if(tri->cksum_calc != tri->cksum_reported) {
 		de_err(c, "[%s] Checksum check failed", tri->shortname);
@@ -1016,8 +1042,6 @@ static int dms_read_and_decompress_track(deark *c, struct dmsctx *d,
 	retval = 1;
 
 done:
-	ucstring_destroy(descr);
-	de_free(c, tri);
 	de_dbg_indent_restore(c, saved_indent_level);
 	return retval;
 }
@@ -1034,36 +1058,38 @@ static void write_extra_track(deark *c, struct dmsctx *d, i64 track_idx, dbuf *t
 	dbuf_close(outf_extra);
 }
 
-// Write out all the tracks, whether real or extra.
-static void do_dms_main(deark *c, struct dmsctx *d)
+// Write out all the tracks, whether real or extra, decompressing them in order.
+static void do_dms_main_sequential(deark *c, struct dmsctx *d)
 {
 	i64 i;
 	int real_track_failure_flag = 0;
 	dbuf *outf = NULL;
 	dbuf *trackbuf = NULL;
+	struct dms_track_info *tri = NULL;
 
+	tri = de_malloc(c, sizeof(struct dms_track_info));
 	trackbuf = dbuf_create_membuf(c, 11264, 0);
 	outf = dbuf_create_output_file(c, "adf", NULL, 0);
 
 	for(i=0; i<d->num_tracks_in_file; i++) {
-		int ret_dcmpr;
-
 		if(real_track_failure_flag && d->tracks_by_file_order[i].is_real) {
 			continue;
 		}
 
 		dbuf_truncate(trackbuf, 0);
+		de_zeromem(tri, sizeof(struct dms_track_info));
 
-		ret_dcmpr = dms_read_and_decompress_track(c, d, i, trackbuf);
+		dms_read_track_header(c, d, i, tri);
+		dms_decompress_track(c, &d->dst, tri, c->infile, tri->dpos, trackbuf);
 
-		if(!ret_dcmpr) {
-			if(d->tracks_by_file_order[i].is_real) {
+		if(!dms_report_track_result(c, tri)) {
+			if(tri->is_real) {
 				real_track_failure_flag = 1;
 			}
 			continue;
 		}
 
-		if(d->tracks_by_file_order[i].is_real) {
+		if(tri->is_real) {
 			dbuf_copy(trackbuf, 0, trackbuf->len, outf);
 		}
 		else {
@@ -1073,6 +1099,195 @@ static void do_dms_main(deark *c, struct dmsctx *d)
 
 	dbuf_close(outf);
 	dbuf_close(trackbuf);
+	de_free(c, tri);
+}
+
+// For parallel decompression, the tracks are divided into groups that do not
+// share any decompression state. A group is either a single extra track, or
+// a sequence of real tracks in which all but the last have the "persist
+// decompr. state" flag set.
+struct dms_track_work {
+	struct dms_track_info tri;
+	dbuf *cmpr_data;
+	dbuf *outf;
+	i64 group_idx;
+	i64 next_in_group; // index into the dms_track_work array, or -1
+};
+
+struct dms_track_group {
+	deark *c;
+	struct dms_track_work *tw; // The whole array
+	i64 first_track_idx;
+	struct de_workerpool_job *job;
+};
+
+// Decompress all the tracks in a group, with a fresh decompression state.
+static void dms_group_job(void *userdata)
+{
+	struct dms_track_group *grp = (struct dms_track_group*)userdata;
+	deark *c = grp->c;
+	struct dms_dcmpr_state dst;
+	i64 i;
+
+	de_zeromem(&dst, sizeof(struct dms_dcmpr_state));
+	for(i=grp->first_track_idx; i>=0; i=grp->tw[i].next_in_group) {
+		struct dms_track_work *w = &grp->tw[i];
+
+		dms_decompress_track(c, &dst, &w->tri, w->cmpr_data, 0, w->outf);
+		// After a failure, the remaining (real) tracks won't be used.
+		if(!w->tri.dcmpr_ok) break;
+	}
+	destroy_saved_dcrmpr_state(c, &dst);
+}
+
+// Copy a group's compressed data to memory, and start decompressing it.
+// Worker threads never read from the input file.
+static void dms_submit_group(deark *c, struct de_workerpool *wp, struct dms_track_group *grp)
+{
+	i64 i;
+
+	for(i=grp->first_track_idx; i>=0; i=grp->tw[i].next_in_group) {
+		struct dms_track_work *w = &grp->tw[i];
+
+		w->cmpr_data = dbuf_create_membuf(c, w->tri.cmpr_len, 0);
+		// (If the track goes beyond the end of the file, leave cmpr_data
+		// empty, and let dms_decompress_track() report it.)
+		if(w->tri.dpos + w->tri.cmpr_len <= c->infile->len) {
+			dbuf_copy(c->infile, w->tri.dpos, w->tri.cmpr_len, w->cmpr_data);
+		}
+		w->outf = dbuf_create_membuf(c, 11264, 0);
+	}
+	grp->job = de_workerpool_submit(wp, dms_group_job, (void*)grp);
+}
+
+// Write out all the tracks, the same as do_dms_main_sequential(), but with
+// independent groups of tracks decompressed by worker threads.
+// The output does not depend on the number of threads.
+static void do_dms_main_parallel(deark *c, struct dmsctx *d, struct de_workerpool *wp)
+{
+	i64 i;
+	i64 num_groups = 0;
+	i64 open_group = -1; // The group that the next real track belongs to
+	i64 last_in_open_group = -1;
+	i64 num_submitted = 0;
+	i64 num_in_progress = 0;
+	i64 max_queue_len;
+	int real_track_failure_flag = 0;
+	dbuf *outf = NULL;
+	struct dms_track_work *tw = NULL;
+	struct dms_track_group *groups = NULL;
+
+	tw = de_mallocarray(c, d->num_tracks_in_file, sizeof(struct dms_track_work));
+	groups = de_mallocarray(c, d->num_tracks_in_file, sizeof(struct dms_track_group));
+
+	for(i=0; i<d->num_tracks_in_file; i++) {
+		struct dms_track_work *w = &tw[i];
+
+		dms_read_track_header(c, d, i, &w->tri);
+		w->next_in_group = -1;
+
+		if(w->tri.is_real && open_group>=0) {
+			w->group_idx = open_group;
+			tw[last_in_open_group].next_in_group = i;
+		}
+		else {
+			w->group_idx = num_groups++;
+			groups[w->group_idx].c = c;
+			groups[w->group_idx].tw = tw;
+			groups[w->group_idx].first_track_idx = i;
+		}
+
+		if(w->tri.is_real) {
+			if(w->tri.track_flags & 0x1) {
+				open_group = w->group_idx;
+				last_in_open_group = i;
+			}
+			else {
+				open_group = -1;
+			}
+		}
+	}
+
+	// Groups are needed in the order they were created, so we can limit the
+	// number of groups in progress.
+	max_queue_len = 2*de_max_int(1, de_workerpool_get_nthreads(wp));
+
+	outf = dbuf_create_output_file(c, "adf", NULL, 0);
+
+	for(i=0; i<d->num_tracks_in_file; i++) {
+		struct dms_track_work *w = &tw[i];
+		struct dms_track_group *grp = &groups[w->group_idx];
+
+		if(real_track_failure_flag && w->tri.is_real) {
+			continue;
+		}
+
+		while(num_submitted<num_groups &&
+			(num_submitted<=w->group_idx || num_in_progress<max_queue_len))
+		{
+			struct dms_track_group *grp2 = &groups[num_submitted++];
+
+			if(real_track_failure_flag && tw[grp2->first_track_idx].tri.is_real) {
+				continue; // Won't be used
+			}
+			dms_submit_group(c, wp, grp2);
+			num_in_progress++;
+		}
+
+		if(grp->job) {
+			de_workerpool_finish_job(wp, grp->job);
+			grp->job = NULL;
+			num_in_progress--;
+		}
+
+		if(!dms_report_track_result(c, &w->tri)) {
+			if(w->tri.is_real) {
+				real_track_failure_flag = 1;
+			}
+			continue;
+		}
+
+		if(w->tri.is_real) {
+			dbuf_copy(w->outf, 0, w->outf->len, outf);
+		}
+		else {
+			write_extra_track(c, d, i, w->outf);
+		}
+		dbuf_close(w->outf);
+		w->outf = NULL;
+	}
+
+	dbuf_close(outf);
+
+	for(i=0; i<num_groups; i++) {
+		if(groups[i].job) {
+			de_workerpool_finish_job(wp, groups[i].job);
+		}
+	}
+	for(i=0; i<d->num_tracks_in_file; i++) {
+		dbuf_close(tw[i].cmpr_data);
+		dbuf_close(tw[i].outf);
+	}
+	de_free(c, groups);
+	de_free(c, tw);
+}
+
+static void do_dms_main(deark *c, struct dmsctx *d)
+{
+	struct de_workerpool *wp = NULL;
+
+	// Debugging output is only correct if tracks are processed in order.
+	if(c->num_threads>0 && c->debug_level<1 && d->num_tracks_in_file>1) {
+		wp = de_workerpool_create(c, c->num_threads);
+	}
+
+	if(wp) {
+		do_dms_main_parallel(c, d, wp);
+	}
+	else {
+		do_dms_main_sequential(c, d);
+	}
+	de_workerpool_destroy(wp);
 }
 
 static int do_dms_header(deark *c, struct dmsctx *d, i64 pos1)
@@ -1229,7 +1444,7 @@ static void de_run_amiga_dms(deark *c, de_module_params *mparams)
 
 done:
 	if(d) {
-		destroy_saved_dcrmpr_state(c, d);
+		destroy_saved_dcrmpr_state(c, &d->dst);
 		de_free(c, d);
 	}
 }
@@ -1250,4 +1465,5 @@ void de_module_amiga_dms(deark *c, struct deark_module_info *mi)
 	mi->desc = "Amiga DMS disk image";
 	mi->run_fn = de_run_amiga_dms;
 	mi->identify_fn = de_identify_amiga_dms;
+	de_module_add_signature(c, mi, 0, "DMS!", 4);
 }
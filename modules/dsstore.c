@@ -432,5 +432,6 @@ void de_module_dsstore(deark *c, struct deark_module_info *mi)
 	mi->desc = "Mac Finder .DS_Store format";
 	mi->run_fn = de_run_dsstore;
 	mi->identify_fn = de_identify_dsstore;
+	de_module_add_signature(c, mi, 4, "Bud1", 4);
 	mi->help_fn = de_help_dsstore;
 }
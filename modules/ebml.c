@@ -709,5 +709,6 @@ void de_module_ebml(deark *c, struct deark_module_info *mi)
 	mi->desc = "EBML";
 	mi->run_fn = de_run_ebml;
 	mi->identify_fn = de_identify_ebml;
+	de_module_add_signature(c, mi, 0, "\x1a\x45\xdf\xa3", 4);
 	mi->help_fn = de_help_ebml;
 }
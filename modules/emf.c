@@ -1183,4 +1183,5 @@ void de_module_emf(deark *c, struct deark_module_info *mi)
 	mi->desc2 = "extract bitmaps only";
 	mi->run_fn = de_run_emf;
 	mi->identify_fn = de_identify_emf;
+	de_module_add_signature(c, mi, 40, " EMF", 4);
 }
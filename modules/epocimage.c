@@ -69,7 +69,6 @@ static de_bitmap *do_create_image(deark *c, lctx *d, struct page_ctx *pg,
 	de_bitmap *img = NULL;
 	i64 i, j;
 	i64 src_rowspan;
-	u8 b;
 	u8 cr;
 	u32 n;
 	u32 clr;
@@ -95,35 +94,34 @@ static de_bitmap *do_create_image(deark *c, lctx *d, struct page_ctx *pg,
 		src_rowspan = ((pg->bits_per_pixel*pg->width +31)/32)*4;
 	}
 
+	if(pg->bits_per_pixel==1 || pg->bits_per_pixel==2 ||
+		pg->bits_per_pixel==4 || pg->bits_per_pixel==8)
+	{
+		de_color pal[256];
+
+		if(pg->color_type && pg->bits_per_pixel==4) {
+			for(i=0; i<16; i++) {
+				pal[i] = pal16[i];
+			}
+		}
+		else if(pg->color_type && pg->bits_per_pixel==8) {
+			for(i=0; i<256; i++) {
+				pal[i] = getpal256((int)i);
+			}
+		}
+		else {
+			// (For 8 bits/pixel, I have no grayscale samples, so I don't know
+			// if this is correct, or valid.)
+			de_make_grayscale_palette(pal, (i64)1<<pg->bits_per_pixel, 0);
+		}
+		de_convert_image_paletted(unc_pixels, 0, pg->bits_per_pixel, src_rowspan,
+			pal, img, DE_CVTF_LSBFIRST);
+		return img;
+	}
+
 	for(j=0; j<pg->height; j++) {
 		for(i=0; i<pg->width; i++) {
 			switch(pg->bits_per_pixel) {
-			case 1:
-				b = de_get_bits_symbol_lsb(unc_pixels, pg->bits_per_pixel, j*src_rowspan, i);
-				de_bitmap_setpixel_gray(img, i, j, b*255);
-				break;
-			case 2:
-				b = de_get_bits_symbol_lsb(unc_pixels, pg->bits_per_pixel, j*src_rowspan, i);
-				de_bitmap_setpixel_gray(img, i, j, b*85);
-				break;
-			case 4:
-				b = de_get_bits_symbol_lsb(unc_pixels, pg->bits_per_pixel, j*src_rowspan, i);
-				if(pg->color_type)
-					de_bitmap_setpixel_rgb(img, i, j, pal16[(unsigned int)b]);
-				else
-					de_bitmap_setpixel_gray(img, i, j, b*17);
-				break;
-			case 8:
-				b = dbuf_getbyte(unc_pixels, j*src_rowspan + i);
-				if(pg->color_type) {
-					de_bitmap_setpixel_rgb(img, i, j, getpal256((unsigned int)b));
-				}
-				else {
-					// I have no 8-bit grayscale samples, so I don't know if this is
-					// correct, or valid.
-					de_bitmap_setpixel_gray(img, i, j, b);
-				}
-				break;
 			case 16:
 				n = (u32)dbuf_getu16le(unc_pixels, j*src_rowspan + i*2);
 				if(is_mask) {
@@ -68,29 +68,15 @@ static void process_hex_digit(deark *c, lctx *d, u8 hexdigit, dbuf *outf)
 	return;
 }
 
-static void convert_row_gray(dbuf *f, i64 fpos, de_bitmap *img,
-	i64 rownum, int depth)
-{
-	i64 i;
-	u8 b;
-
-	for(i=0; i<img->width; i++) {
-		b = de_get_bits_symbol(f, depth, fpos, i);
-		if(depth==1) b*=255;
-		else if(depth==2) b*=85;
-		else if(depth==4) b*=17;
-		de_bitmap_setpixel_gray(img, i, rownum, 255-b);
-	}
-}
-
 static void do_decode_epsi_image(deark *c, lctx *d, i64 pos1)
 {
 	de_bitmap *img = NULL;
 	dbuf *tmpf = NULL;
 	i64 content_len, total_len;
 	i64 pos;
-	i64 i, j, k;
+	i64 i, k;
 	i64 src_rowspan;
+	de_color pal[256];
 
 
 	pos = pos1;
@@ -114,9 +100,9 @@ static void do_decode_epsi_image(deark *c, lctx *d, i64 pos1)
 
 	src_rowspan = (d->w * d->depth +7)/8;
 
-	for(j=0; j<d->h; j++) {
-		convert_row_gray(tmpf, j*src_rowspan, img, j, (int)d->depth);
-	}
+	// 0 = white
+	de_make_grayscale_palette(pal, (i64)1<<d->depth, 0x1);
+	de_convert_image_paletted(tmpf, 0, d->depth, src_rowspan, pal, img, 0);
 
 	de_bitmap_write_to_file(img, "preview", DE_CREATEFLAG_IS_AUX);
 	de_bitmap_destroy(img);
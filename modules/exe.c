@@ -1358,4 +1358,5 @@ void de_module_exe(deark *c, struct deark_module_info *mi)
 	mi->desc = "Microsoft EXE executable (PE, NE, LX)";
 	mi->run_fn = de_run_exe;
 	mi->identify_fn = de_identify_exe;
+	de_module_add_signature(c, mi, 0, "MZ", 2);
 }
@@ -122,6 +122,7 @@ static i64 get_unpadded_len(const u8 *s, i64 len1)
 static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 {
 	dbuf *outf = NULL;
+	dbuf *inf = NULL;
 	de_finfo *fi = NULL;
 	de_ucstring *fullfn = NULL;
 	i64 cur_cluster;
@@ -156,6 +157,8 @@ static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 		nbytes_remaining = md->filesize;
 	}
 
+	// Map out the file's clusters, then copy them all at once.
+	inf = dbuf_open_input_extents(c->infile);
 	while(1) {
 		i64 dpos;
 		i64 nbytes_to_copy;
@@ -167,10 +170,11 @@ static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 		if(c->debug_level>=3) de_dbg3(c, "cluster: %d", (int)cur_cluster);
 		dpos = clusternum_to_offset(c, d, cur_cluster);
 		nbytes_to_copy = de_min_int(d->bytes_per_cluster, nbytes_remaining);
-		dbuf_copy(c->infile, dpos, nbytes_to_copy, outf);
+		dbuf_add_extent(inf, dpos, nbytes_to_copy);
 		nbytes_remaining -= nbytes_to_copy;
 		cur_cluster = (i64)d->fat_nextcluster[cur_cluster];
 	}
+	dbuf_copy(inf, 0, inf->len, outf);
 
 	if(nbytes_remaining>0) {
 		de_err(c, "%s: File extraction failed", ucstring_getpsz_d(md->short_fn));
@@ -179,6 +183,7 @@ static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 
 done:
 	dbuf_close(outf);
+	dbuf_close(inf);
 	ucstring_destroy(fullfn);
 	de_finfo_destroy(c, fi);
 }
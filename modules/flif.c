@@ -211,5 +211,6 @@ void de_module_flif(deark *c, struct deark_module_info *mi)
 	mi->desc = "FLIF image format";
 	mi->run_fn = de_run_flif;
 	mi->identify_fn = de_identify_flif;
+	de_module_add_signature(c, mi, 0, "FLIF", 4);
 	mi->flags |= DE_MODFLAG_NONWORKING;
 }
@@ -228,4 +228,5 @@ void de_module_gemmeta(deark *c, struct deark_module_info *mi)
 	mi->desc = "GEM VDI Metafile";
 	mi->run_fn = de_run_gemmeta;
 	mi->identify_fn = de_identify_gemmeta;
+	de_module_add_signature(c, mi, 0, "\xff\xff\x18\x00", 4);
 }
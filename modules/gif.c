@@ -1273,5 +1273,6 @@ void de_module_gif(deark *c, struct deark_module_info *mi)
 	mi->desc = "GIF image";
 	mi->run_fn = de_run_gif;
 	mi->identify_fn = de_identify_gif;
+	de_module_add_signature(c, mi, 0, "GIF8", 4);
 	mi->help_fn = de_help_gif;
 }
@@ -260,4 +260,5 @@ void de_module_gzip(deark *c, struct deark_module_info *mi)
 	mi->desc = "gzip compressed file";
 	mi->run_fn = de_run_gzip;
 	mi->identify_fn = de_identify_gzip;
+	de_module_add_signature(c, mi, 0, "\x1f\x8b", 2);
 }
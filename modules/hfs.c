@@ -422,8 +422,10 @@ static void do_extract_fork_run(deark *c, lctx *d, struct recorddata *rd,
 {
 	i64 nbytes_still_to_write;
 	size_t k;
+	dbuf *inf = NULL;
 
 	nbytes_still_to_write = fki->logical_eof;
+	inf = dbuf_open_input_extents(c->infile);
 
 	for(k=0; k<3; k++) {
 		i64 fragment_dpos;
@@ -442,13 +444,15 @@ static void do_extract_fork_run(deark *c, lctx *d, struct recorddata *rd,
 			goto done;
 		}
 
-		dbuf_copy(c->infile, fragment_dpos, nbytes_to_write_this_time, outf);
+		dbuf_add_extent(inf, fragment_dpos, nbytes_to_write_this_time);
 
 		nbytes_still_to_write -= nbytes_to_write_this_time;
 	}
 
 done:
-	;
+	// Copy whatever fragments we found, as a single stream.
+	dbuf_copy(inf, 0, inf->len, outf);
+	dbuf_close(inf);
 }
 
 static void read_finder_info(deark *c, lctx *d, struct de_advfile *advf, i64 pos1)
@@ -1838,5 +1838,6 @@ void de_module_hlp(deark *c, struct deark_module_info *mi)
 	mi->desc = "HLP";
 	mi->run_fn = de_run_hlp;
 	mi->identify_fn = de_identify_hlp;
+	de_module_add_signature(c, mi, 0, "\x3f\x5f\x03\x00", 4);
 	mi->help_fn = de_help_hlp;
 }
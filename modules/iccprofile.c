@@ -593,4 +593,5 @@ void de_module_iccprofile(deark *c, struct deark_module_info *mi)
 	mi->desc = "ICC profile";
 	mi->run_fn = de_run_iccprofile;
 	mi->identify_fn = de_identify_iccprofile;
+	de_module_add_signature(c, mi, 36, "acsp", 4);
 }
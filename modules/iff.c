@@ -316,4 +316,5 @@ void de_module_midi(deark *c, struct deark_module_info *mi)
 	mi->desc = "MIDI audio";
 	mi->run_fn = de_run_midi;
 	mi->identify_fn = de_identify_midi;
+	de_module_add_signature(c, mi, 0, "MThd", 4);
 }
@@ -1461,6 +1461,8 @@ struct cdraw_params {
 	i64 sector_dlen;
 	i64 sector_data_offset;
 	const char *ext;
+	const char *modname; // Module to run on the converted image
+	dbuf *rawf; // used by cdraw_read_cb
 };
 
 // If the volume has an ISO 9660 "volume identifier", try to read it to use as
@@ -1488,9 +1490,52 @@ done:
 	ucstring_destroy(vol_id);
 }
 
-static void do_cdraw_convert(deark *c, struct cdraw_params *cdrp)
+// Read function for the virtual dbuf that contains just the data part of each
+// sector. Logical sector N is at N*sector_total_len + sector_data_offset in
+// the raw image.
+static void cdraw_read_cb(dbuf *f, void *userdata, u8 *buf, i64 pos, i64 len)
+{
+	struct cdraw_params *cdrp = (struct cdraw_params*)userdata;
+
+	while(len>0) {
+		i64 secnum;
+		i64 offset_in_sector;
+		i64 n;
+
+		secnum = pos / cdrp->sector_dlen;
+		offset_in_sector = pos % cdrp->sector_dlen;
+		n = de_min_int(cdrp->sector_dlen - offset_in_sector, len);
+		dbuf_read(cdrp->rawf, buf, secnum*cdrp->sector_total_len +
+			cdrp->sector_data_offset + offset_in_sector, n);
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+}
+
+// Returns a read-only dbuf that maps the raw image in cdrp->rawf to a plain
+// (e.g. 2048 bytes/sector) image, without copying it.
+// If the last sector is truncated, the image ends where its data ends.
+static dbuf *cdraw_open_virtual_image(deark *c, struct cdraw_params *cdrp)
+{
+	dbuf *f;
+	i64 nfullsectors;
+	i64 lastsector_dlen;
+
+	nfullsectors = cdrp->rawf->len / cdrp->sector_total_len;
+	lastsector_dlen = cdrp->rawf->len - nfullsectors*cdrp->sector_total_len -
+		cdrp->sector_data_offset;
+	if(lastsector_dlen<0) lastsector_dlen = 0;
+	if(lastsector_dlen>cdrp->sector_dlen) lastsector_dlen = cdrp->sector_dlen;
+
+	f = dbuf_create_custom_dbuf(c, nfullsectors*cdrp->sector_dlen + lastsector_dlen, 0);
+	f->userdata_for_customread = (void*)cdrp;
+	f->customread_fn = cdraw_read_cb;
+	return f;
+}
+
+static void do_cdraw_convert(deark *c, struct cdraw_params *cdrp, dbuf *imgf)
 {
-	i64 pos;
 	de_finfo *fi = NULL;
 	dbuf *outf = NULL;
 
@@ -1498,13 +1543,7 @@ static void do_cdraw_convert(deark *c, struct cdraw_params *cdrp)
 	cdraw_set_name_from_vol_id(c, cdrp, fi);
 
 	outf = dbuf_create_output_file(c, cdrp->ext, fi, 0x0);
-
-	pos = cdrp->sector_data_offset;
-	while(1) {
-		if(pos >= c->infile->len) break;
-		dbuf_copy(c->infile, pos, cdrp->sector_dlen, outf);
-		pos += cdrp->sector_total_len;
-	}
+	dbuf_copy(imgf, 0, imgf->len, outf);
 
 	dbuf_close(outf);
 	de_finfo_destroy(c, fi);
@@ -1517,6 +1556,8 @@ static void cdraw_setdefaults(struct cdraw_params *cdrp)
 	cdrp->sector_dlen = 2048;
 	cdrp->sector_data_offset = 0;
 	cdrp->ext = "bin";
+	cdrp->modname = NULL;
+	cdrp->rawf = NULL;
 }
 
 static int syncbytes_at(dbuf *f, i64 pos)
@@ -1532,6 +1573,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 		cdrp->sector_total_len = 2336;
 		cdrp->sector_data_offset = 8;
 		cdrp->ext = "iso";
+		cdrp->modname = "iso9660";
 		return;
 	}
 	if(cdsig_at2(f, 2352*16+16, 2352*17+16)) {
@@ -1539,6 +1581,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 		cdrp->sector_total_len = 2352;
 		cdrp->sector_data_offset = 16;
 		cdrp->ext = "iso";
+		cdrp->modname = "iso9660";
 		return;
 	}
 	if(cdsig_at2(f, 2352*16+24, 2352*17+24)) {
@@ -1546,6 +1589,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 		cdrp->sector_total_len = 2352;
 		cdrp->sector_data_offset = 24;
 		cdrp->ext = "iso";
+		cdrp->modname = "iso9660";
 		return;
 	}
 	if(cdsig_at2(f, 2448*16+16, 2448*17+16)) {
@@ -1553,6 +1597,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 		cdrp->sector_total_len = 2448;
 		cdrp->sector_data_offset = 16;
 		cdrp->ext = "iso";
+		cdrp->modname = "iso9660";
 		return;
 	}
 	if(cdsig_at2(f, 2448*16+24, 2448*17+24)) {
@@ -1560,6 +1605,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 		cdrp->sector_total_len = 2448;
 		cdrp->sector_data_offset = 24;
 		cdrp->ext = "iso";
+		cdrp->modname = "iso9660";
 		return;
 	}
 	if(syncbytes_at(f, 0)) {
@@ -1569,6 +1615,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 				cdrp->sector_total_len = 2352;
 				cdrp->sector_data_offset = 16;
 				cdrp->ext = "apm";
+				cdrp->modname = "apm";
 				return;
 			}
 		}
@@ -1579,6 +1626,7 @@ static void cdraw_detect_params(dbuf *f, struct cdraw_params *cdrp)
 static void de_run_cd_raw(deark *c, de_module_params *mparams)
 {
 	struct cdraw_params cdrp;
+	dbuf *imgf = NULL;
 
 	cdraw_setdefaults(&cdrp);
 	cdraw_detect_params(c->infile, &cdrp);
@@ -1591,10 +1639,21 @@ static void de_run_cd_raw(deark *c, de_module_params *mparams)
 	de_dbg(c, "data bytes/sector: %"I64_FMT, cdrp.sector_dlen);
 	de_dbg(c, "data offset: %"I64_FMT, cdrp.sector_data_offset);
 
-	do_cdraw_convert(c, &cdrp);
+	cdrp.rawf = c->infile;
+	imgf = cdraw_open_virtual_image(c, &cdrp);
+
+	if(cdrp.modname && de_get_ext_option_bool(c, "cd_raw:decode", 0)) {
+		de_dbg(c, "decoding as %s", cdrp.modname);
+		de_dbg_indent(c, 1);
+		de_run_module_by_id_on_slice(c, cdrp.modname, NULL, imgf, 0, imgf->len);
+		de_dbg_indent(c, -1);
+	}
+	else {
+		do_cdraw_convert(c, &cdrp, imgf);
+	}
 
 done:
-	;
+	dbuf_close(imgf);
 }
 
 static int de_identify_cd_raw(deark *c)
@@ -1607,12 +1666,19 @@ static int de_identify_cd_raw(deark *c)
 	return 0;
 }
 
+static void de_help_cd_raw(deark *c)
+{
+	de_msg(c, "-opt cd_raw:decode : Decode the filesystem directly, instead of "
+		"converting to a plain image file");
+}
+
 void de_module_cd_raw(deark *c, struct deark_module_info *mi)
 {
 	mi->id = "cd_raw";
 	mi->desc = "Raw CD image";
 	mi->run_fn = de_run_cd_raw;
 	mi->identify_fn = de_identify_cd_raw;
+	mi->help_fn = de_help_cd_raw;
 }
 
 struct nrg_ctx {
@@ -578,4 +578,5 @@ void de_module_j2c(deark *c, struct deark_module_info *mi)
 	mi->desc = "JPEG 2000 codestream";
 	mi->run_fn = de_run_j2c;
 	mi->identify_fn = de_identify_j2c;
+	de_module_add_signature(c, mi, 0, "\xff\x4f\xff\x51", 4);
 }
@@ -427,4 +427,5 @@ void de_module_jbf(deark *c, struct deark_module_info *mi)
 	mi->desc = "PaintShop Pro Browser Cache (pspbrwse.jbf)";
 	mi->run_fn = de_run_jbf;
 	mi->identify_fn = de_identify_jbf;
+	de_module_add_signature(c, mi, 0, "JASC", 4);
 }
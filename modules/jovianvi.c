@@ -64,25 +64,26 @@ static void do_read_palette(deark *c, lctx *d)
 
 static void do_convert_grayscale(deark *c, lctx *d, de_bitmap *img)
 {
-	int i, j;
+	i64 k;
 	u8 v;
+	de_color pal[256];
 
 	if(d->bitdepth==1) {
 		de_convert_image_bilevel(c->infile, d->bitspos, d->rowspan, img, 0);
 		goto done;
 	}
 
-	for(j=0; j<d->h; j++) {
-		for(i=0; i<d->w; i++) {
-			v = de_get_bits_symbol(c->infile, d->bits_alloc, d->bitspos + j*d->rowspan, i);
-			if(d->bitdepth==4) v *= 17;
-			else if(d->bitdepth==6) {
-				if(v<=63) v = de_scale_63_to_255(v);
-				else v=0;
-			}
-			de_bitmap_setpixel_gray(img, i, j, v);
+	for(k=0; k<((i64)1<<d->bits_alloc); k++) {
+		v = (u8)k;
+		if(d->bitdepth==4) v *= 17;
+		else if(d->bitdepth==6) {
+			if(v<=63) v = de_scale_63_to_255(v);
+			else v=0;
 		}
+		pal[k] = DE_MAKE_GRAY(v);
 	}
+	de_convert_image_paletted(c->infile, d->bitspos, d->bits_alloc, d->rowspan,
+		pal, img, 0);
 
 done:
 	;
@@ -2163,6 +2163,7 @@ void de_module_jpeg(deark *c, struct deark_module_info *mi)
 	mi->desc2 = "resources only";
 	mi->run_fn = de_run_jpeg;
 	mi->identify_fn = de_identify_jpeg;
+	de_module_add_signature(c, mi, 0, "\xff\xd8\xff", 3);
 }
 
 void de_module_jpegscan(deark *c, struct deark_module_info *mi)
@@ -276,6 +276,7 @@ void de_module_lbr(deark *c, struct deark_module_info *mi)
 	mi->desc = "LBR archive";
 	mi->run_fn = de_run_lbr;
 	mi->identify_fn = de_identify_lbr;
+	de_module_add_signature(c, mi, 0, "\x00\x20\x20\x20", 4);
 }
 
 ///////////////////////////////////////////////
@@ -533,4 +534,6 @@ void de_module_squeeze(deark *c, struct deark_module_info *mi)
 	mi->desc = "Squeeze (CP/M)";
 	mi->run_fn = de_run_squeeze;
 	mi->identify_fn = de_identify_squeeze;
+	de_module_add_signature(c, mi, 0, "\x76\xff", 2);
+	de_module_add_signature(c, mi, 0, "\xfa\xff", 2);
 }
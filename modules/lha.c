@@ -889,13 +889,15 @@ static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 	dcmpro.f = outf;
 	dcmpro.expected_len = md->orig_size;
 	dcmpro.len_known = 1;
+	dcmpro.skip_if_unwanted = 1;
 
 	if(md->is_dir) goto done; // For directories, we're done.
 
-	dcmpr_attempted = 1;
 	if(md->cmi->decompressor) {
 		md->cmi->decompressor(c, d, md, &dcmpri, &dcmpro, &dres);
 	}
+	if(dres.output_skipped) goto done;
+	dcmpr_attempted = 1;
 
 	if(dres.errcode) {
 		de_err(c, "%s: Decompression failed: %s", ucstring_getpsz_d(md->fullfilename),
@@ -1673,4 +1675,5 @@ void de_module_arx(deark *c, struct deark_module_info *mi)
 	mi->desc = "ARX LHA-like archive";
 	mi->run_fn = de_run_arx;
 	mi->identify_fn = de_identify_arx;
+	de_module_add_signature(c, mi, 2, "-lh1-", 5);
 }
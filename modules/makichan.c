@@ -509,4 +509,5 @@ void de_module_makichan(deark *c, struct deark_module_info *mi)
 	mi->desc = "MAKIchan graphics";
 	mi->run_fn = de_run_makichan;
 	mi->identify_fn = de_identify_makichan;
+	de_module_add_signature(c, mi, 0, "MAKI0", 5);
 }
@@ -760,6 +760,7 @@ void de_module_mrw(deark *c, struct deark_module_info *mi)
 	mi->desc2 = "resources only";
 	mi->run_fn = de_run_mrw;
 	mi->identify_fn = de_identify_mrw;
+	de_module_add_signature(c, mi, 0, "\x00\x4d\x52\x4d", 4);
 }
 
 // **************************************************************************
@@ -1207,6 +1208,7 @@ void de_module_lss16(deark *c, struct deark_module_info *mi)
 	mi->desc = "SYSLINUX LSS16 image";
 	mi->run_fn = de_run_lss16;
 	mi->identify_fn = de_identify_lss16;
+	de_module_add_signature(c, mi, 0, "\x3d\xf3\x13\x14", 4);
 }
 
 // **************************************************************************
@@ -1247,6 +1249,7 @@ void de_module_vbm(deark *c, struct deark_module_info *mi)
 	mi->desc = "C64/128 VBM (VDC BitMap)";
 	mi->run_fn = de_run_vbm;
 	mi->identify_fn = de_identify_vbm;
+	de_module_add_signature(c, mi, 0, "BM\xcb", 3);
 }
 
 // **************************************************************************
@@ -1393,6 +1396,7 @@ void de_module_olpc565(deark *c, struct deark_module_info *mi)
 	mi->desc = "OLPC .565 firmware icon";
 	mi->run_fn = de_run_olpc565;
 	mi->identify_fn = de_identify_olpc565;
+	de_module_add_signature(c, mi, 0, "C565", 4);
 }
 
 // **************************************************************************
@@ -1448,6 +1452,7 @@ void de_module_iim(deark *c, struct deark_module_info *mi)
 	mi->desc = "InShape IIM";
 	mi->run_fn = de_run_iim;
 	mi->identify_fn = de_identify_iim;
+	de_module_add_signature(c, mi, 0, "IS_IMAGE", 8);
 }
 
 // **************************************************************************
@@ -1624,6 +1629,7 @@ void de_module_crg(deark *c, struct deark_module_info *mi)
 	mi->desc = "Calamus Raster Graphic";
 	mi->run_fn = de_run_crg;
 	mi->identify_fn = de_identify_crg;
+	de_module_add_signature(c, mi, 0, "CALAMUSCRG", 10);
 }
 
 // **************************************************************************
@@ -1672,6 +1678,7 @@ void de_module_farbfeld(deark *c, struct deark_module_info *mi)
 	mi->desc = "farbfeld image";
 	mi->run_fn = de_run_farbfeld;
 	mi->identify_fn = de_identify_farbfeld;
+	de_module_add_signature(c, mi, 0, "farbfeld", 8);
 }
 
 // **************************************************************************
@@ -1994,6 +2001,7 @@ void de_module_vitec(deark *c, struct deark_module_info *mi)
 	mi->desc = "VITec image format";
 	mi->run_fn = de_run_vitec;
 	mi->identify_fn = de_identify_vitec;
+	de_module_add_signature(c, mi, 0, "\x00\x5b\x07\x20", 4);
 }
 
 // **************************************************************************
@@ -2159,6 +2167,7 @@ void de_module_zbr(deark *c, struct deark_module_info *mi)
 	mi->desc2 = "extract preview image";
 	mi->run_fn = de_run_zbr;
 	mi->identify_fn = de_identify_zbr;
+	de_module_add_signature(c, mi, 0, "\x9a\x02", 2);
 }
 
 // **************************************************************************
@@ -2271,6 +2280,7 @@ void de_module_compress(deark *c, struct deark_module_info *mi)
 	mi->desc = "Compress (.Z)";
 	mi->run_fn = de_run_compress;
 	mi->identify_fn = de_identify_compress;
+	de_module_add_signature(c, mi, 0, "\x1f\x9d", 2);
 }
 
 // **************************************************************************
@@ -397,13 +397,12 @@ static int mslzh_have_enough_output(struct mslzh_context *lzhctx)
 	return 0;
 }
 
-static void mslzh_lz77buf_writebytecb(struct de_lz77buffer *rb, u8 n)
+static void mslzh_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct mslzh_context *lzhctx = (struct mslzh_context*)rb->userdata;
 
-	if(mslzh_have_enough_output(lzhctx)) return;
-	dbuf_writebyte(lzhctx->dcmpro->f, n);
-	lzhctx->nbytes_written++;
+	de_dfilter_write_to_output(lzhctx->dcmpro, &lzhctx->nbytes_written, buf, buf_len);
 }
 
 static void mslzh_decompress_main(struct mslzh_context *lzhctx)
@@ -519,7 +518,7 @@ static void do_decompress_LZHUFF(deark *c, struct de_dfilter_in_params *dcmpri,
 	}
 
 	lzhctx->ringbuf = de_lz77buffer_create(c, 4096);
-	lzhctx->ringbuf->writebyte_cb = mslzh_lz77buf_writebytecb;
+	lzhctx->ringbuf->writebytes_cb = mslzh_lz77buf_writebytescb;
 	lzhctx->ringbuf->userdata = (void*)lzhctx;
 	de_lz77buffer_clear(lzhctx->ringbuf, 0x20);
 
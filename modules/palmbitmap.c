@@ -138,7 +138,7 @@ static void make_stdpal256(deark *c, lctx *d, u32 *stdpal)
 	static const u32 supplpal[15] = {0x111111,
 		0x222222,0x444444,0x555555,0x777777,0x888888,0xaaaaaa,0xbbbbbb,0xdddddd,
 		0xeeeeee,0xc0c0c0,0x800000,0x800080,0x008000,0x008080};
-	static u8 vals[6] = {0xff, 0xcc, 0x99, 0x66, 0x33, 0x00};
+	static const u8 vals[6] = {0xff, 0xcc, 0x99, 0x66, 0x33, 0x00};
 
 	for(k=0; k<215; k++) {
 		u8 r, g, b;
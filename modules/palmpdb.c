@@ -295,10 +295,8 @@ static int do_decompress_imgview_image(deark *c, lctx *d, dbuf *inf,
 static void do_generate_unc_image(deark *c, lctx *d, dbuf *unc_pixels,
 	struct img_gen_info *igi)
 {
-	i64 i, j;
-	u8 b;
-	u8 b_adj;
 	de_bitmap *img = NULL;
+	de_color pal[16];
 
 	if(igi->bitsperpixel==1) {
 		de_convert_and_write_image_bilevel(unc_pixels, 0, igi->w, igi->h, igi->rowbytes,
@@ -308,13 +306,10 @@ static void do_generate_unc_image(deark *c, lctx *d, dbuf *unc_pixels,
 
 	img = de_bitmap_create(c, igi->w, igi->h, 1);
 
-	for(j=0; j<igi->h; j++) {
-		for(i=0; i<igi->w; i++) {
-			b = de_get_bits_symbol(unc_pixels, igi->bitsperpixel, igi->rowbytes*j, i);
-			b_adj = 255 - de_sample_nbit_to_8bit(igi->bitsperpixel, (unsigned int)b);
-			de_bitmap_setpixel_gray(img, i, j, b_adj);
-		}
-	}
+	// 0 = white
+	de_make_grayscale_palette(pal, (i64)1<<igi->bitsperpixel, 0x1);
+	de_convert_image_paletted(unc_pixels, 0, igi->bitsperpixel, igi->rowbytes,
+		pal, img, 0);
 
 	de_bitmap_write_to_file_finfo(img, igi->fi, igi->createflags);
 
@@ -759,4 +759,5 @@ void de_module_pcf(deark *c, struct deark_module_info *mi)
 	mi->desc = "PCF font";
 	mi->run_fn = de_run_pcf;
 	mi->identify_fn = de_identify_pcf;
+	de_module_add_signature(c, mi, 0, "\x01" "fcp", 4);
 }
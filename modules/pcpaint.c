@@ -241,21 +241,22 @@ static int decode_egavga16(deark *c, lctx *d)
 	d->img->bytes_per_pixel = 3;
 	d->img->flipped = 1;
 
+	if(d->plane_info!=0x31) {
+		de_convert_image_paletted(d->unc_pixels, 0, 4, src_rowspan, pal, d->img, 0);
+		goto done;
+	}
+
 	for(j=0; j<d->img->height; j++) {
 		for(i=0; i<d->img->width; i++) {
-			if(d->plane_info==0x31) {
-				for(plane=0; plane<4; plane++) {
-					z[plane] = de_get_bits_symbol(d->unc_pixels, 1, plane*src_planespan + j*src_rowspan, i);
-				}
-				palent = z[0] + 2*z[1] + 4*z[2] + 8*z[3];
-			}
-			else {
-				palent = de_get_bits_symbol(d->unc_pixels, 4, j*src_rowspan, i);
+			for(plane=0; plane<4; plane++) {
+				z[plane] = de_get_bits_symbol(d->unc_pixels, 1, plane*src_planespan + j*src_rowspan, i);
 			}
+			palent = z[0] + 2*z[1] + 4*z[2] + 8*z[3];
 			de_bitmap_setpixel_rgb(d->img, i, j, pal[palent]);
 		}
 	}
 
+done:
 	de_bitmap_write_to_file_finfo(d->img, d->fi, 0);
 	return 1;
 }
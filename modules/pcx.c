@@ -486,6 +486,12 @@ static void do_bitmap_paletted(deark *c, lctx *d)
 
 	img = de_bitmap_create(c, d->width, d->height, 3);
 
+	if(d->planes==1) {
+		// Not planar, so this is easy.
+		de_convert_image_paletted(d->unc_pixels, 0, d->bits, d->rowspan, d->pal, img, 0);
+		goto done;
+	}
+
 	for(j=0; j<d->height; j++) {
 		for(i=0; i<d->width; i++) {
 			palent = 0;
@@ -499,6 +505,7 @@ static void do_bitmap_paletted(deark *c, lctx *d)
 		}
 	}
 
+done:
 	de_bitmap_write_to_file_finfo(img, d->fi, 0);
 	de_bitmap_destroy(img);
 }
@@ -733,4 +740,5 @@ void de_module_dcx(deark *c, struct deark_module_info *mi)
 	mi->desc = "DCX (multi-image PCX)";
 	mi->run_fn = de_run_dcx;
 	mi->identify_fn = de_identify_dcx;
+	de_module_add_signature(c, mi, 0, "\xb1\x68\xde\x3a", 4);
 }
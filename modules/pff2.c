@@ -239,4 +239,5 @@ void de_module_pff2(deark *c, struct deark_module_info *mi)
 	mi->desc = "PFF2 font";
 	mi->run_fn = de_run_pff2;
 	mi->identify_fn = de_identify_pff2;
+	de_module_add_signature(c, mi, 0, "FILE", 4);
 }
@@ -562,4 +562,5 @@ void de_module_pkfont(deark *c, struct deark_module_info *mi)
 	mi->desc = "PK Font";
 	mi->run_fn = de_run_pkfont;
 	mi->identify_fn = de_identify_pkfont;
+	de_module_add_signature(c, mi, 0, "\xf7\x59", 2);
 }
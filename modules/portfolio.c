@@ -152,6 +152,7 @@ void de_module_pgx(deark *c, struct deark_module_info *mi)
 	mi->desc = "Atari Portfolio animation";
 	mi->run_fn = de_run_pgx;
 	mi->identify_fn = de_identify_pgx;
+	de_module_add_signature(c, mi, 0, "PGX", 3);
 }
 
 // **************************************************************************
@@ -231,4 +232,5 @@ void de_module_pgc(deark *c, struct deark_module_info *mi)
 	mi->desc = "Atari Portfolio Graphics - compressed";
 	mi->run_fn = de_run_pgc;
 	mi->identify_fn = de_identify_pgc;
+	de_module_add_signature(c, mi, 0, "PG\x01", 3);
 }
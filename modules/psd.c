@@ -4210,6 +4210,8 @@ void de_module_psd(deark *c, struct deark_module_info *mi)
 	mi->desc = "Photoshop PSD";
 	mi->run_fn = de_run_psd;
 	mi->identify_fn = de_identify_psd;
+	de_module_add_signature(c, mi, 0, "8BPS", 4);
+	de_module_add_signature(c, mi, 0, "8BIM", 4);
 }
 
 static int de_identify_ps_action(deark *c)
@@ -631,4 +631,7 @@ void de_module_riff(deark *c, struct deark_module_info *mi)
 	mi->desc = "RIFF-based formats";
 	mi->run_fn = de_run_riff;
 	mi->identify_fn = de_identify_riff;
+	de_module_add_signature(c, mi, 0, "RIFF", 4);
+	de_module_add_signature(c, mi, 0, "XFIR", 4);
+	de_module_add_signature(c, mi, 0, "RIFX", 4);
 }
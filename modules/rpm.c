@@ -267,4 +267,5 @@ void de_module_rpm(deark *c, struct deark_module_info *mi)
 	mi->desc = "RPM Package Manager";
 	mi->run_fn = de_run_rpm;
 	mi->identify_fn = de_identify_rpm;
+	de_module_add_signature(c, mi, 0, "\xed\xab\xee\xdb", 4);
 }
@@ -578,4 +578,6 @@ void de_module_shg(deark *c, struct deark_module_info *mi)
 	mi->desc = "SHG (Segmented Hypergraphics), MRB (Multiple Resolution Bitmap)";
 	mi->run_fn = de_run_shg;
 	mi->identify_fn = de_identify_shg;
+	de_module_add_signature(c, mi, 0, "\x6c\x50", 2);
+	de_module_add_signature(c, mi, 0, "\x6c\x70", 2);
 }
@@ -26,6 +26,7 @@ struct fork_data {
 	u8 is_a_file;
 	u8 cmpr_meth;
 	u8 is_encrypted;
+	u8 dcmpr_skipped; // Not decompressed, because the output is not wanted
 	u32 crc_reported;
 	i64 unc_len;
 	i64 cmpr_pos;
@@ -159,6 +160,8 @@ static void do_decompr_huffman(deark *c, lctx *d, struct member_data *md,
 	i64 nbytes_written = 0;
 	char pos_descr[32];
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	hctx = de_malloc(c, sizeof(struct sit_huffctx));
 	hctx->c = c;
 	hctx->modname = "huffman";
@@ -480,7 +483,12 @@ static void do_main_decompress_fork(deark *c, lctx *d, struct member_data *md,
 	dcmpro.f = outf;
 	dcmpro.len_known = 1;
 	dcmpro.expected_len = frk->unc_len;
+	dcmpro.skip_if_unwanted = 1;
 	frk->cmi->decompressor(c, d, md, frk, &dcmpri, &dcmpro, &dres);
+	if(dres.output_skipped) {
+		frk->dcmpr_skipped = 1;
+		goto done;
+	}
 	if(dres.errcode) {
 		de_err(c, "Decompression failed for file %s[%s fork]: %s", ucstring_getpsz_d(md->full_fname),
 			frk->forkname, de_dfilter_get_errmsg(c, &dres));
@@ -496,6 +504,7 @@ static void do_post_decompress_fork(deark *c, lctx *d, struct member_data *md,
 {
 	u32 crc_calc;
 
+	if(frk->dcmpr_skipped) return;
 	if(frk->is_rsrc_fork) {
 		crc_calc = de_crcobj_getval(d->crco_rfork);
 	}
@@ -72,7 +72,6 @@ static void do_image(deark *c, lctx *d, dbuf *unc_pixels)
 {
 	de_bitmap *img = NULL;
 	u32 clr;
-	u8 b;
 	i64 i, j;
 	i64 src_bypp, dst_bypp;
 	unsigned int getrgbflags;
@@ -140,19 +139,18 @@ static void do_image(deark *c, lctx *d, dbuf *unc_pixels)
 
 	img = de_bitmap_create(c, d->width, d->height, (int)dst_bypp);
 
-	for(j=0; j<d->height; j++) {
-		for(i=0; i<d->width; i++) {
-			if(d->is_paletted || d->is_grayscale) {
-				b = de_get_bits_symbol(unc_pixels, d->depth, d->rowspan*j, i);
-				clr = d->pal[(unsigned int)b];
-				de_bitmap_setpixel_rgb(img, i, j, clr);
-			}
-			else if(d->depth==24) {
-				clr = dbuf_getRGB(unc_pixels, d->rowspan*j+i*src_bypp, getrgbflags);
-				de_bitmap_setpixel_rgb(img, i, j, clr);
-			}
-			else if(d->depth==32) {
+	if((d->is_paletted || d->is_grayscale) && d->depth<=8) {
+		de_convert_image_paletted(unc_pixels, 0, d->depth, d->rowspan, d->pal, img, 0);
+	}
+	else if(d->depth==24 && !d->is_paletted && !d->is_grayscale) {
+		de_convert_image_rgb(unc_pixels, 0, d->rowspan, src_bypp, img, getrgbflags);
+	}
+	else {
+		// 32-bit (paletted and grayscale images are never deeper than 8 bits)
+		for(j=0; j<d->height; j++) {
+			for(i=0; i<d->width; i++) {
 				u8 pixbuf[4];
+
 				dbuf_read(unc_pixels, pixbuf, d->rowspan*j+i*src_bypp, 4);
 				clr =
 					((unsigned int)pixbuf[0] << d->color32desc.channel_shift[0]) |
@@ -390,5 +388,6 @@ void de_module_sunras(deark *c, struct deark_module_info *mi)
 	mi->desc = "Sun Raster";
 	mi->run_fn = de_run_sunras;
 	mi->identify_fn = de_identify_sunras;
+	de_module_add_signature(c, mi, 0, "\x59\xa6\x6a\x95", 4);
 	mi->help_fn = de_help_sunras;
 }
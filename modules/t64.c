@@ -141,4 +141,5 @@ void de_module_t64(deark *c, struct deark_module_info *mi)
 	mi->desc = "T64 (C64 tape format)";
 	mi->run_fn = de_run_t64;
 	mi->identify_fn = de_identify_t64;
+	de_module_add_signature(c, mi, 0, "C64", 3);
 }
@@ -1278,7 +1278,7 @@ static void handler_makernote(deark *c, lctx *d, const struct taginfo *tg, const
 
 static void handler_usercomment(deark *c, lctx *d, const struct taginfo *tg, const struct tagnuminfo *tni)
 {
-	static u8 charcode[8];
+	u8 charcode[8];
 	de_ucstring *s = NULL;
 	de_encoding enc = DE_ENCODING_UNKNOWN;
 	i64 bytes_per_char = 1;
@@ -114,4 +114,5 @@ void de_module_wad(deark *c, struct deark_module_info *mi)
 	mi->desc = "Doom WAD";
 	mi->run_fn = de_run_wad;
 	mi->identify_fn = de_identify_wad;
+	de_module_add_signature(c, mi, 1, "WAD", 3);
 }
@@ -75,6 +75,27 @@ struct member_data {
 
 	i64 cmpr_size, uncmpr_size;
 	u32 crc_reported;
+	i64 central_index; // -1 if not known
+};
+
+// A member that is being decompressed on a worker thread, before the main
+// thread gets to it. See zip_prefetch_fill().
+struct zip_prefetch_job {
+	lctx *d;
+	i64 central_index;
+	// What we expect the normal header parsing to find
+	i64 file_data_pos;
+	i64 cmpr_size, uncmpr_size;
+	int cmpr_meth;
+	const struct cmpr_meth_info *cmi;
+	unsigned int bit_flags;
+
+	dbuf *cmpr_data; // A copy of the compressed data
+	dbuf *outf; // membuf
+	struct de_crcobj *crco;
+	struct de_dfilter_results dres;
+	u32 crc_calculated;
+	struct de_workerpool_job *job;
 };
 
 struct extra_item_type_info_struct;
@@ -107,6 +128,16 @@ struct localctx_struct {
 	int is_zip64;
 	int using_scanmode;
 	struct de_crcobj *crco;
+
+	// Used to decompress members ahead of time, on worker threads
+	struct de_workerpool *wp;
+	struct zip_prefetch_job **pf_queue; // Circular, in central dir order
+	i64 pf_queue_size;
+	i64 pf_queue_start;
+	i64 pf_queue_count;
+	i64 pf_next_index; // Index of the next central dir entry to look at
+	i64 pf_next_pos;
+	u8 pf_stopped;
 };
 
 typedef void (*extrafield_decoder_fn)(deark *c, lctx *d,
@@ -195,24 +226,21 @@ static const struct cmpr_meth_info *get_cmpr_meth_info(int cmpr_meth)
 	return NULL;
 }
 
-// Decompress some data from inf, using the given ZIP compression method,
-// and append it to outf.
-// On failure, prints an error and returns 0.
-// Returns 1 on apparent success.
-// TODO: How should this low-level function report errors and warnings?
-static int do_decompress_data(deark *c, lctx *d,
+// Decompress some data from inf, using the given (supported) ZIP compression
+// method, and append it to outf. The results go in *dres. Nothing is reported,
+// so this may be called from a worker thread.
+static void do_decompress_data_lowlevel(deark *c, lctx *d,
 	dbuf *inf, i64 inf_pos, i64 inf_size,
 	dbuf *outf, i64 maxuncmprsize,
-	int cmpr_meth, const struct cmpr_meth_info *cmi, unsigned int bit_flags)
+	int cmpr_meth, const struct cmpr_meth_info *cmi, unsigned int bit_flags,
+	struct de_dfilter_results *dres)
 {
-	int retval = 0;
 	struct de_dfilter_in_params dcmpri;
 	struct de_dfilter_out_params dcmpro;
-	struct de_dfilter_results dres;
 	struct compression_params cparams;
 
 	de_zeromem(&cparams, sizeof(struct compression_params));
-	de_dfilter_init_objects(c, &dcmpri, &dcmpro, &dres);
+	de_dfilter_init_objects(c, &dcmpri, &dcmpro, dres);
 	cparams.cmpr_meth = cmpr_meth;
 	cparams.bit_flags = bit_flags;
 	dcmpri.f = inf;
@@ -221,28 +249,49 @@ static int do_decompress_data(deark *c, lctx *d,
 	dcmpro.f = outf;
 	dcmpro.expected_len = maxuncmprsize;
 	dcmpro.len_known = 1;
+	dcmpro.skip_if_unwanted = 1;
 
-	if(cmi && cmi->decompressor) {
-		cmi->decompressor(c, d, &cparams, &dcmpri, &dcmpro, &dres);
-		if(dres.errcode) {
-			de_err(c, "%s", de_dfilter_get_errmsg(c, &dres));
-		}
-		else {
-			if(dres.bytes_consumed_valid && (dres.bytes_consumed < inf_size)) {
-				de_warn(c, "Decompression may have failed (used only "
-					"%"I64_FMT" of %"I64_FMT" compressed bytes)",
-					dres.bytes_consumed, inf_size);
-			}
-			retval = 1;
-		}
-		goto done;
+	cmi->decompressor(c, d, &cparams, &dcmpri, &dcmpro, dres);
+}
+
+// Report the results of do_decompress_data_lowlevel().
+// On failure, prints an error and returns 0.
+// Returns 1 on apparent success.
+static int report_decompression_results(deark *c, struct de_dfilter_results *dres,
+	i64 inf_size)
+{
+	if(dres->errcode) {
+		de_err(c, "%s", de_dfilter_get_errmsg(c, dres));
+		return 0;
+	}
+	if(dres->bytes_consumed_valid && (dres->bytes_consumed < inf_size)) {
+		de_warn(c, "Decompression may have failed (used only "
+			"%"I64_FMT" of %"I64_FMT" compressed bytes)",
+			dres->bytes_consumed, inf_size);
 	}
+	return 1;
+}
 
-	de_err(c, "Unsupported compression method: %d (%s)", cmpr_meth,
-		(cmi ? cmi->name : "?"));
+// Decompress some data from inf, using the given ZIP compression method,
+// and append it to outf. The caller can check dres->output_skipped.
+// On failure, prints an error and returns 0.
+// Returns 1 on apparent success.
+static int do_decompress_data(deark *c, lctx *d,
+	dbuf *inf, i64 inf_pos, i64 inf_size,
+	dbuf *outf, i64 maxuncmprsize,
+	int cmpr_meth, const struct cmpr_meth_info *cmi, unsigned int bit_flags,
+	struct de_dfilter_results *dres)
+{
+	de_dfilter_results_clear(c, dres);
+	if(!is_compression_method_supported(d, cmi)) {
+		de_err(c, "Unsupported compression method: %d (%s)", cmpr_meth,
+			(cmi ? cmi->name : "?"));
+		return 0;
+	}
 
-done:
-	return retval;
+	do_decompress_data_lowlevel(c, d, inf, inf_pos, inf_size, outf, maxuncmprsize,
+		cmpr_meth, cmi, bit_flags, dres);
+	return report_decompression_results(c, dres, inf_size);
 }
 
 // As we read a member file's attributes, we may encounter multiple timestamps,
@@ -626,6 +675,7 @@ static void ef_infozipmac(deark *c, lctx *d, struct extra_item_info_struct *eii)
 	struct de_fourcc creator;
 	de_ucstring *flags_str = NULL;
 	dbuf *attr_data = NULL;
+	struct de_dfilter_results dres;
 	int ret;
 	i64 create_time_raw;
 	i64 create_time_offset;
@@ -690,7 +740,7 @@ static void ef_infozipmac(deark *c, lctx *d, struct extra_item_info_struct *eii)
 	// Decompress and decode the Finder attribute data
 	attr_data = dbuf_create_membuf(c, ulen, 0x1);
 	ret = do_decompress_data(c, d, c->infile, pos, cmpr_attr_size,
-		attr_data, 65536, cmpr_meth, cmi, 0);
+		attr_data, 65536, cmpr_meth, cmi, 0, &dres);
 	if(!ret) {
 		de_warn(c, "Failed to decompress finder attribute data");
 		goto done;
@@ -900,15 +950,237 @@ static void our_writelistener_cb(dbuf *f, void *userdata, const u8 *buf, i64 buf
 	de_crcobj_addbuf(md->crco, buf, buf_len);
 }
 
+/////// Prefetching (parallel decompression) ///////
+
+// When worker threads are allowed, the main thread looks ahead in the central
+// directory, and starts decompressing upcoming members into memory. Then,
+// when the normal (sequential) processing gets to a member, it uses the
+// prefetched data instead of decompressing it. Files are still written in
+// the usual order, and messages are still printed in the usual order.
+
+// Larger members are decompressed by the main thread, directly to the output
+// file.
+#define ZIP_PREFETCH_MAX_MEMBER_SIZE (16*1048576)
+// How many central dir entries we'll look ahead, at most
+#define ZIP_PREFETCH_MAX_LOOKAHEAD 256
+
+static void zip_prefetch_job_fn(void *userdata)
+{
+	struct zip_prefetch_job *pj = (struct zip_prefetch_job*)userdata;
+	deark *c = pj->outf->c;
+
+	do_decompress_data_lowlevel(c, pj->d, pj->cmpr_data, 0, pj->cmpr_size,
+		pj->outf, pj->uncmpr_size, pj->cmpr_meth, pj->cmi, pj->bit_flags, &pj->dres);
+	de_crcobj_addslice(pj->crco, pj->outf, 0, pj->outf->len);
+	pj->crc_calculated = de_crcobj_getval(pj->crco);
+}
+
+static void zip_prefetch_destroy_job(deark *c, lctx *d, struct zip_prefetch_job *pj)
+{
+	if(!pj) return;
+	if(pj->job) {
+		de_workerpool_finish_job(d->wp, pj->job);
+	}
+	dbuf_close(pj->cmpr_data);
+	dbuf_close(pj->outf);
+	de_crcobj_destroy(pj->crco);
+	de_free(c, pj);
+}
+
+// Read just enough of the headers for a member to decompress it, without
+// printing anything. The normal header parsing happens later, and if it
+// disagrees with us, the prefetched data won't be used.
+// Returns 0 if the central dir entry could not be read.
+// On success, sets *pentry_size, and returns the job in *ppj (or NULL if the
+// member shouldn't be prefetched).
+static int zip_prefetch_peek_member(deark *c, lctx *d, i64 pos, i64 *pentry_size,
+	struct zip_prefetch_job **ppj)
+{
+	struct zip_prefetch_job *pj = NULL;
+	UI lbit_flags;
+	int lcmpr_meth;
+	i64 lhpos;
+	i64 cmpr_size, uncmpr_size;
+	i64 file_data_pos;
+	const struct cmpr_meth_info *cmi;
+
+	*ppj = NULL;
+	if(pos+46 > d->central_dir_offset+d->central_dir_byte_size) return 0;
+	if((u32)de_getu32le(pos) != CODE_PK12) return 0;
+	*pentry_size = 46 + de_getu16le(pos+28) + de_getu16le(pos+30) + de_getu16le(pos+32);
+
+	if(de_getu16le(pos+34) != d->this_disk_num) goto done;
+	lhpos = de_getu32le(pos+42);
+	if(d->used_offset_discrepancy) {
+		lhpos += d->offset_discrepancy;
+	}
+	if(lhpos+30 > c->infile->len) goto done;
+	if((u32)de_getu32le(lhpos) != CODE_PK34) goto done;
+
+	lbit_flags = (UI)de_getu16le(lhpos+6);
+	if(lbit_flags & 0x1) goto done; // encrypted
+	lcmpr_meth = (int)de_getu16le(lhpos+8);
+	cmi = get_cmpr_meth_info(lcmpr_meth);
+	if(!is_compression_method_supported(d, cmi)) goto done;
+
+	if(lbit_flags & 0x0008) {
+		cmpr_size = de_getu32le(pos+20);
+		uncmpr_size = de_getu32le(pos+24);
+	}
+	else {
+		cmpr_size = de_getu32le(lhpos+18);
+		uncmpr_size = de_getu32le(lhpos+22);
+	}
+	// (This also excludes sizes that would be in a Zip64 extra field.)
+	if(uncmpr_size<1 || uncmpr_size>ZIP_PREFETCH_MAX_MEMBER_SIZE ||
+		cmpr_size>ZIP_PREFETCH_MAX_MEMBER_SIZE)
+	{
+		goto done;
+	}
+
+	file_data_pos = lhpos + 30 + de_getu16le(lhpos+26) + de_getu16le(lhpos+28);
+	if(file_data_pos+cmpr_size > c->infile->len) goto done;
+
+	pj = de_malloc(c, sizeof(struct zip_prefetch_job));
+	pj->d = d;
+	pj->file_data_pos = file_data_pos;
+	pj->cmpr_size = cmpr_size;
+	pj->uncmpr_size = uncmpr_size;
+	pj->cmpr_meth = lcmpr_meth;
+	pj->cmi = cmi;
+	pj->bit_flags = lbit_flags;
+	*ppj = pj;
+
+done:
+	return 1;
+}
+
+static void zip_prefetch_init(deark *c, lctx *d)
+{
+	if(c->num_threads<1) return;
+	if(d->central_dir_num_entries<2) return;
+	// The decompressors' debug messages would be out of order.
+	if(c->debug_level>0) return;
+	// Don't do a lot of work that might be thrown away.
+	if(c->first_output_file>0 || c->max_output_files>=0) return;
+	if(c->list_mode && !c->verify_mode) return;
+
+	d->wp = de_workerpool_create(c, c->num_threads);
+	if(!d->wp) return;
+	d->pf_queue_size = 2*(i64)de_max_int(1, de_workerpool_get_nthreads(d->wp));
+	d->pf_queue = de_mallocarray(c, d->pf_queue_size, sizeof(struct zip_prefetch_job*));
+	d->pf_next_index = 0;
+	d->pf_next_pos = d->central_dir_offset;
+}
+
+static struct zip_prefetch_job *zip_prefetch_pop(lctx *d)
+{
+	struct zip_prefetch_job *pj;
+
+	pj = d->pf_queue[d->pf_queue_start];
+	d->pf_queue[d->pf_queue_start] = NULL;
+	d->pf_queue_start = (d->pf_queue_start+1) % d->pf_queue_size;
+	d->pf_queue_count--;
+	return pj;
+}
+
+// Called before processing central dir entry #cur_index.
+static void zip_prefetch_fill(deark *c, lctx *d, i64 cur_index)
+{
+	if(!d->wp) return;
+
+	// Discard any jobs that were not used, e.g. because the member failed
+	// to be processed.
+	while(d->pf_queue_count>0 &&
+		d->pf_queue[d->pf_queue_start]->central_index < cur_index)
+	{
+		zip_prefetch_destroy_job(c, d, zip_prefetch_pop(d));
+	}
+
+	while(d->pf_queue_count < d->pf_queue_size && !d->pf_stopped &&
+		d->pf_next_index < d->central_dir_num_entries &&
+		d->pf_next_index < cur_index + ZIP_PREFETCH_MAX_LOOKAHEAD)
+	{
+		struct zip_prefetch_job *pj = NULL;
+		i64 entry_size = 0;
+
+		if(!zip_prefetch_peek_member(c, d, d->pf_next_pos, &entry_size, &pj)) {
+			d->pf_stopped = 1;
+			break;
+		}
+
+		if(pj) {
+			pj->central_index = d->pf_next_index;
+			// Worker threads can't read from the input file, so copy the
+			// compressed data to memory.
+			pj->cmpr_data = dbuf_create_membuf(c, pj->cmpr_size, 0);
+			dbuf_copy(c->infile, pj->file_data_pos, pj->cmpr_size, pj->cmpr_data);
+			pj->outf = dbuf_create_membuf(c, pj->uncmpr_size, 0);
+			pj->crco = de_crcobj_create(c, DE_CRCOBJ_CRC32_IEEE);
+			pj->job = de_workerpool_submit(d->wp, zip_prefetch_job_fn, (void*)pj);
+
+			d->pf_queue[(d->pf_queue_start + d->pf_queue_count) % d->pf_queue_size] = pj;
+			d->pf_queue_count++;
+		}
+
+		d->pf_next_index++;
+		d->pf_next_pos += entry_size;
+	}
+}
+
+// If the member was prefetched, wait for it to be decompressed, and return
+// the job, which the caller must destroy.
+static struct zip_prefetch_job *zip_prefetch_get(deark *c, lctx *d,
+	struct member_data *md)
+{
+	struct zip_prefetch_job *pj;
+
+	if(!d->wp || d->pf_queue_count<1) return NULL;
+	pj = d->pf_queue[d->pf_queue_start];
+	if(pj->central_index != md->central_index) return NULL;
+	zip_prefetch_pop(d);
+
+	if(pj->file_data_pos != md->file_data_pos ||
+		pj->cmpr_size != md->cmpr_size ||
+		pj->uncmpr_size != md->uncmpr_size ||
+		pj->cmpr_meth != md->local_dir_entry_data.cmpr_meth ||
+		pj->bit_flags != md->local_dir_entry_data.bit_flags)
+	{
+		zip_prefetch_destroy_job(c, d, pj);
+		return NULL;
+	}
+
+	de_workerpool_finish_job(d->wp, pj->job);
+	pj->job = NULL;
+	return pj;
+}
+
+static void zip_prefetch_destroy(deark *c, lctx *d)
+{
+	if(!d->wp) return;
+	while(d->pf_queue_count>0) {
+		zip_prefetch_destroy_job(c, d, zip_prefetch_pop(d));
+	}
+	de_free(c, d->pf_queue);
+	d->pf_queue = NULL;
+	de_workerpool_destroy(d->wp);
+	d->wp = NULL;
+}
+
+///////////////////////////////////
+
 static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 {
 	dbuf *outf = NULL;
 	de_finfo *fi = NULL;
 	struct dir_entry_data *ldd = &md->local_dir_entry_data;
+	struct zip_prefetch_job *pj = NULL;
+	struct de_dfilter_results dres;
 	u32 crc_calculated;
 	int tsidx;
 	int ret;
 
+	de_dfilter_results_clear(c, &dres);
 	de_dbg(c, "file data at %"I64_FMT", len=%"I64_FMT, md->file_data_pos,
 		md->cmpr_size);
 
@@ -965,17 +1237,27 @@ static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 		goto done;
 	}
 
-	dbuf_set_writelistener(outf, our_writelistener_cb, (void*)md);
-	md->crco = d->crco;
-	de_crcobj_reset(md->crco);
-
 	de_dbg_indent(c, 1);
-	ret = do_decompress_data(c, d, c->infile, md->file_data_pos, md->cmpr_size,
-		outf, md->uncmpr_size, ldd->cmpr_meth, ldd->cmi, ldd->bit_flags);
+	pj = zip_prefetch_get(c, d, md);
+	if(pj) {
+		// Already decompressed, and CRC calculated, by a worker thread
+		dbuf_copy(pj->outf, 0, pj->outf->len, outf);
+		ret = report_decompression_results(c, &pj->dres, md->cmpr_size);
+		crc_calculated = pj->crc_calculated;
+	}
+	else {
+		dbuf_set_writelistener(outf, our_writelistener_cb, (void*)md);
+		md->crco = d->crco;
+		de_crcobj_reset(md->crco);
+
+		ret = do_decompress_data(c, d, c->infile, md->file_data_pos, md->cmpr_size,
+			outf, md->uncmpr_size, ldd->cmpr_meth, ldd->cmi, ldd->bit_flags, &dres);
+		crc_calculated = de_crcobj_getval(md->crco);
+	}
 	de_dbg_indent(c, -1);
 	if(!ret) goto done;
+	if(dres.output_skipped) goto done;
 
-	crc_calculated = de_crcobj_getval(md->crco);
 	de_dbg(c, "crc (calculated): 0x%08x", (unsigned int)crc_calculated);
 
 	if(crc_calculated != md->crc_reported) {
@@ -985,6 +1267,7 @@ static void do_extract_file(deark *c, lctx *d, struct member_data *md)
 	}
 
 done:
+	zip_prefetch_destroy_job(c, d, pj);
 	dbuf_close(outf);
 	de_finfo_destroy(c, fi);
 }
@@ -1330,6 +1613,7 @@ static struct member_data *create_member_data(deark *c, lctx *d)
 	struct member_data *md;
 
 	md = de_malloc(c, sizeof(struct member_data));
+	md->central_index = -1;
 	md->local_dir_entry_data.fname = ucstring_create(c);
 	md->central_dir_entry_data.fname = ucstring_create(c);
 	return md;
@@ -1416,6 +1700,7 @@ static int do_member_from_central_dir_entry(deark *c, lctx *d,
 	de_dbg_indent_save(c, &saved_indent_level);
 
 	*entry_size = 0;
+	md->central_index = central_index;
 
 	if(pos >= d->central_dir_offset+d->central_dir_byte_size) {
 		goto done;
@@ -1518,7 +1803,10 @@ static int do_central_dir(deark *c, lctx *d)
 	de_dbg(c, "central dir at %"I64_FMT, pos);
 	de_dbg_indent(c, 1);
 
+	zip_prefetch_init(c, d);
+
 	for(i=0; i<d->central_dir_num_entries; i++) {
+		zip_prefetch_fill(c, d, i);
 		if(!do_central_dir_entry(c, d, i, pos, &entry_size)) {
 			// TODO: Decide exactly what to do if something fails.
 			goto done;
@@ -1528,6 +1816,7 @@ static int do_central_dir(deark *c, lctx *d)
 	retval = 1;
 
 done:
+	zip_prefetch_destroy(c, d);
 	de_dbg_indent(c, -1);
 	return retval;
 }
@@ -522,6 +522,7 @@ static void do_member(deark *c, lctx *d, i64 pos1, i64 *next_member_hdr_pos)
 	dcmpro.f = outf;
 	dcmpro.len_known = 1;
 	dcmpro.expected_len = md->uncmpr_len;
+	dcmpro.skip_if_unwanted = 1;
 
 	de_dbg_indent(c, 1);
 	switch(md->method) {
@@ -538,6 +539,7 @@ static void do_member(deark *c, lctx *d, i64 pos1, i64 *next_member_hdr_pos)
 		goto done; // Should be impossible
 	}
 	de_dbg_indent(c, -1);
+	if(dres.output_skipped) goto done;
 
 	md->crc_calculated = de_crcobj_getval(d->crco);
 	de_dbg(c, "file data crc (calculated): 0x%04x", (unsigned int)md->crc_calculated);
@@ -632,4 +634,5 @@ void de_module_zoo(deark *c, struct deark_module_info *mi)
 	mi->desc = "ZOO compressed archive format";
 	mi->run_fn = de_run_zoo;
 	mi->identify_fn = de_identify_zoo;
+	de_module_add_signature(c, mi, 20, "\xdc\xa7\xc4\xfd", 4);
 }
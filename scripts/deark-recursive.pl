@@ -6,6 +6,8 @@
 # It is normal for error messages to be printed, when unsupported formats are
 # extracted.
 # This script is quick and dirty. Use at your own risk.
+# Note: Deark's -recurse option does something similar, without re-reading
+# each extracted file from disk.
 # Terms of use: Public domain
 # By Jason Summers, 2018
 use strict;
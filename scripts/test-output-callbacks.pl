@@ -0,0 +1,61 @@
+#!/usr/bin/perl -w
+# A test of the DE_OUTPUTSTYLE_CALLBACK output style, using the
+# "-opt cmd:cbtest" developer option of deark-cmd.
+# It makes a ZIP file, and checks that the callbacks receive the expected
+# file names, sizes, and contents (by CRC-32). It also checks that
+# "-opt cmd:cbtest=noopen" (no open function) fails cleanly.
+# Usage: test-output-callbacks.pl [path-to-deark]
+# Runs in a temporary directory. Exits with a nonzero status on failure.
+# Terms of use: Public domain
+use strict;
+use File::Temp qw(tempdir);
+use Cwd qw(abs_path);
+use IO::Compress::Zip qw(zip $ZipError);
+use Compress::Zlib qw(crc32);
+
+my $deark_exe = abs_path($ARGV[0] || "./deark");
+my $dir = tempdir(CLEANUP => 1);
+chdir($dir) or die;
+
+my @members = (
+  [ "a.txt", "first member\n" x 300 ],
+  [ "b.bin", join("", map { chr($_ % 251) } 0..99999) ],
+  [ "empty.txt", "" ],
+);
+
+my $zipdata;
+my $zip = IO::Compress::Zip->new(\$zipdata, Name => $members[0][0])
+  or die $ZipError;
+$zip->print($members[0][1]);
+for my $i (1..$#members) {
+  $zip->newStream(Name => $members[$i][0]) or die $ZipError;
+  $zip->print($members[$i][1]);
+}
+$zip->close();
+
+open(my $fh, '>:raw', "t.zip") or die;
+print $fh $zipdata;
+close($fh);
+
+my @lines = grep { /^cbtest: / } `"$deark_exe" -q -opt cmd:cbtest t.zip`;
+$? == 0 or die "FAIL: deark failed\n";
+scalar(@lines) == scalar(@members) or die "FAIL: wrong number of files\n";
+
+for my $i (0..$#members) {
+  my ($name, $data) = @{$members[$i]};
+  my $expected = sprintf("cbtest: %d %s %d crc32=%08x\n", $i, $name,
+    length($data), crc32($data));
+  if($lines[$i] ne $expected) {
+    die "FAIL: got \"$lines[$i]\", expected \"$expected\"\n";
+  }
+}
+
+if(-e "output.000.a.txt") {
+  die "FAIL: a file was written to disk\n";
+}
+
+system("\"$deark_exe\" -q -opt cmd:cbtest=noopen t.zip >/dev/null 2>&1");
+if($? == 0) {
+  die "FAIL: noopen mode did not report an error\n";
+}
+print "ok\n";
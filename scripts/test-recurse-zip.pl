@@ -0,0 +1,41 @@
+#!/usr/bin/perl -w
+# A regression test for -recurse.
+# It makes a ZIP file that has a 2002-byte prefix and an archive comment,
+# containing another ZIP file, and checks that Deark extracts the member of
+# the inner ZIP file. (Detection data about the outer file, such as the
+# location of its end-of-central-directory record, must not be used for the
+# inner file.)
+# Usage: test-recurse-zip.pl [path-to-deark]
+# Runs in a temporary directory. Exits with a nonzero status on failure.
+# Terms of use: Public domain
+use strict;
+use File::Temp qw(tempdir);
+use Cwd qw(abs_path);
+use IO::Compress::Zip qw(zip $ZipError);
+
+my $deark_exe = abs_path($ARGV[0] || "./deark");
+my $dir = tempdir(CLEANUP => 1);
+chdir($dir) or die;
+
+my $member_data = "hello from the inner zip\n" x 50;
+my $inner_zip;
+zip(\$member_data => \$inner_zip, Name => "member.txt") or die $ZipError;
+
+my $outer_zip;
+zip(\$inner_zip => \$outer_zip, Name => "inner.zip", Method => 0,
+  ZipComment => "outer archive comment") or die $ZipError;
+
+open(my $fh, '>:raw', "outer.zip") or die;
+print $fh ("\0" x 2002) . $outer_zip;
+close($fh);
+
+system($deark_exe, "-q", "-recurse", "outer.zip") == 0 or die "deark failed\n";
+
+my $outfn = "output.000.inner.zip.000.member.txt";
+open($fh, '<:raw', $outfn) or die "FAIL: $outfn not extracted\n";
+my $got = do { local $/; <$fh> };
+close($fh);
+if($got ne $member_data) {
+  die "FAIL: $outfn has the wrong contents\n";
+}
+print "ok\n";
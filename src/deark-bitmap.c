@@ -83,56 +83,190 @@ static void de_bitmap_alloc_pixels(de_bitmap *img)
 	img->bitmap = de_malloc(img->c, img->bitmap_size);
 }
 
+#define PALHASH_SIZE 1024 // Must be a power of 2, and more than 2*256
+
+// The distinct colors in an image, collected by scan_image().
+struct palhash {
+	int max_entries;
+	int num_entries;
+	int num_trns_entries;
+	de_color pal[256];
+	de_color hash_clr[PALHASH_SIZE];
+	u16 hash_idx[PALHASH_SIZE]; // 0 = empty, otherwise 1 + palette index
+};
+
 struct image_scan_results {
 	int has_color;
 	int has_trns;
 	int has_visible_pixels;
+	// Non-NULL if colors were counted, and there are few enough for a palette.
+	// The caller must free it.
+	struct palhash *ph;
+};
+
+// Accumulators for scan_image().
+// Using bitwise operations (instead of conditional "flag=1" statements)
+// lets the compiler vectorize the loops in scan_row().
+struct scan_accum {
+	u8 any_a; // Nonzero if any pixel has nonzero alpha
+	u8 all_a; // 0xff if every pixel has alpha 0xff
+	u8 colordiff; // Nonzero if any visible pixel is not a gray shade
 };
 
+static void scan_row(const u8 *p, i64 npixels, int bytes_per_pixel,
+	struct scan_accum *acc)
+{
+	i64 i;
+	u8 any_a = acc->any_a;
+	u8 all_a = acc->all_a;
+	u8 colordiff = acc->colordiff;
+
+	switch(bytes_per_pixel) {
+	case 4:
+		for(i=0; i<npixels; i++) {
+			u8 r = p[i*4];
+			u8 g = p[i*4+1];
+			u8 b = p[i*4+2];
+			u8 a = p[i*4+3];
+
+			any_a |= a;
+			all_a &= a;
+			colordiff |= ((r^g) | (r^b)) & (a ? 0xff : 0x00);
+		}
+		break;
+	case 3:
+		for(i=0; i<npixels; i++) {
+			colordiff |= (p[i*3]^p[i*3+1]) | (p[i*3]^p[i*3+2]);
+		}
+		break;
+	case 2:
+		for(i=0; i<npixels; i++) {
+			any_a |= p[i*2+1];
+			all_a &= p[i*2+1];
+		}
+		break;
+	}
+
+	acc->any_a = any_a;
+	acc->all_a = all_a;
+	acc->colordiff = colordiff;
+}
+
+static de_color get_raw_pixel(const u8 *p, int bytes_per_pixel)
+{
+	switch(bytes_per_pixel) {
+	case 4: return DE_MAKE_RGBA(p[0], p[1], p[2], p[3]);
+	case 3: return DE_MAKE_RGBA(p[0], p[1], p[2], 0xff);
+	case 2: return DE_MAKE_RGBA(p[0], p[0], p[0], p[1]);
+	}
+	return DE_MAKE_RGBA(p[0], p[0], p[0], 0xff);
+}
+
+// Returns the palette index of clr, adding it to the palette if necessary.
+// Returns -1 if that would make too many colors.
+static int palhash_lookup(struct palhash *ph, de_color clr)
+{
+	UI h;
+
+	h = ((UI)(clr * 0x9e3779b1U) >> 22) & (PALHASH_SIZE-1);
+	while(ph->hash_idx[h] && ph->hash_clr[h]!=clr) {
+		h = (h+1) & (PALHASH_SIZE-1);
+	}
+	if(!ph->hash_idx[h]) {
+		if(ph->num_entries >= ph->max_entries) return -1;
+		ph->hash_clr[h] = clr;
+		ph->hash_idx[h] = (u16)(1+ph->num_entries);
+		ph->pal[ph->num_entries] = clr;
+		if(DE_COLOR_A(clr)<255) ph->num_trns_entries++;
+		ph->num_entries++;
+	}
+	return (int)ph->hash_idx[h] - 1;
+}
+
+// Add a row's colors to ph. Returns 0 if there are too many colors.
+static int count_row_colors(struct palhash *ph, const u8 *p, i64 npixels,
+	int bytes_per_pixel)
+{
+	i64 i;
+	de_color prev_clr = 0;
+	int have_prev = 0;
+
+	for(i=0; i<npixels; i++) {
+		de_color clr;
+
+		clr = get_raw_pixel(p, bytes_per_pixel);
+		p += bytes_per_pixel;
+		if(have_prev && clr==prev_clr) continue;
+		if(palhash_lookup(ph, clr)<0) return 0;
+		prev_clr = clr;
+		have_prev = 1;
+	}
+	return 1;
+}
+
 // Scan the image's pixels, and report whether any are transparent, etc.
-static void scan_image(de_bitmap *img, struct image_scan_results *isres)
+// If count_colors is set, also collect its colors into isres->ph, giving up
+// as soon as there are too many for a palette to be useful.
+static void scan_image(de_bitmap *img, struct image_scan_results *isres,
+	int count_colors)
 {
-	i64 i, j;
-	de_color clr;
-	de_colorsample a, r, g, b;
+	deark *c = img->c;
+	i64 j;
+	i64 rowspan;
+	struct scan_accum acc;
+	struct palhash *ph = NULL;
 
 	de_zeromem(isres, sizeof(struct image_scan_results));
-	if(img->bytes_per_pixel==1) {
+	if(img->bytes_per_pixel==1 && !count_colors) {
 		// No reason to scan opaque grayscale images.
 		isres->has_visible_pixels = 1;
 		return;
 	}
+	if(!img->bitmap) de_bitmap_alloc_pixels(img);
+
+	if(count_colors) {
+		ph = de_malloc(c, sizeof(struct palhash));
+		// For opaque grayscale images, a palette only helps if we can use a
+		// bit depth of 1 or 2. (See get_paletted_image().)
+		ph->max_entries = (img->bytes_per_pixel==1) ? 4 : 256;
+	}
+
+	de_zeromem(&acc, sizeof(struct scan_accum));
+	acc.all_a = 0xff;
+	if(img->bytes_per_pixel==1 || img->bytes_per_pixel==3) {
+		acc.any_a = 0xff;
+	}
+	rowspan = img->width * img->bytes_per_pixel;
+
 	for(j=0; j<img->height; j++) {
-		for(i=0; i<img->width; i++) {
-			clr = de_bitmap_getpixel(img, i, j);
-			// TODO: Optimize these tests. We check for too many things we
-			// already know the answer to.
-			a = DE_COLOR_A(clr);
-			r = DE_COLOR_R(clr);
-			g = DE_COLOR_G(clr);
-			b = DE_COLOR_B(clr);
-			if(!isres->has_visible_pixels && a!=0) {
-				isres->has_visible_pixels = 1;
-			}
-			if(!isres->has_trns && a<255) {
-				isres->has_trns = 1;
-			}
-			if(!isres->has_color && img->bytes_per_pixel>=3 &&
-				((g!=r || b!=r) && a!=0) )
+		scan_row(&img->bitmap[j*rowspan], img->width, img->bytes_per_pixel, &acc);
+
+		if(ph) {
+			if(!count_row_colors(ph, &img->bitmap[j*rowspan], img->width,
+				img->bytes_per_pixel))
 			{
-				isres->has_color = 1;
+				de_free(c, ph);
+				ph = NULL;
+			}
+			else {
+				continue;
 			}
 		}
 
 		// After each row, test whether we've learned everything we can learn
 		// about this image.
-		if((isres->has_trns || img->bytes_per_pixel==1 || img->bytes_per_pixel==3) &&
-			(isres->has_visible_pixels) &&
-			(isres->has_color || img->bytes_per_pixel<=2))
+		if((acc.all_a!=0xff || img->bytes_per_pixel==1 || img->bytes_per_pixel==3) &&
+			(acc.any_a!=0) &&
+			(acc.colordiff!=0 || img->bytes_per_pixel<=2))
 		{
-			return;
+			break;
 		}
 	}
+
+	isres->has_visible_pixels = (acc.any_a!=0);
+	isres->has_trns = (acc.all_a!=0xff);
+	isres->has_color = (acc.colordiff!=0);
+	isres->ph = ph;
 }
 
 // Clone an existing bitmap's metadata, but don't allocate the new pixels.
@@ -145,19 +279,185 @@ static de_bitmap *de_bitmap_clone_noalloc(de_bitmap *img1)
 	de_memcpy(img2, img1, sizeof(de_bitmap));
 	img2->bitmap = 0;
 	img2->bitmap_size = 0;
+	img2->pal = NULL;
+	img2->num_pal_entries = 0;
 	return img2;
 }
 
+// Returns a paletted version of img1, using the colors that scan_image()
+// found (ph).
+// Returns NULL if it wouldn't help.
+// Palette entries with transparency are put first, so that the PNG tRNS
+// chunk can be as short as possible.
+static de_bitmap *get_paletted_image(de_bitmap *img1, struct palhash *ph)
+{
+	deark *c = img1->c;
+	de_bitmap *palimg = NULL;
+	u8 *indices = NULL;
+	de_color *pal = NULL;
+	int num_entries = ph->num_entries;
+	int num_trns_entries = ph->num_trns_entries;
+	i64 npixels;
+	i64 k;
+
+	npixels = img1->width * img1->height;
+	pal = de_mallocarray(c, 256, sizeof(de_color));
+	de_memcpy(pal, ph->pal, (size_t)num_entries*sizeof(de_color));
+
+	// Don't bother if the paletted image, including its PLTE and tRNS chunks,
+	// would be no smaller than the image we'd otherwise write (after
+	// get_optimized_image()). (We assume the palette indices will use the
+	// smallest possible bit depth.)
+	{
+		int bits_per_index;
+		int is_gray = 1;
+		int i;
+		i64 pal_est_size;
+		i64 nonpal_bytes_per_pixel;
+
+		for(i=0; i<num_entries; i++) {
+			if(DE_COLOR_R(pal[i])!=DE_COLOR_G(pal[i]) ||
+				DE_COLOR_B(pal[i])!=DE_COLOR_G(pal[i]))
+			{
+				is_gray = 0;
+				break;
+			}
+		}
+
+		if(num_entries<=2) bits_per_index = 1;
+		else if(num_entries<=4) bits_per_index = 2;
+		else if(num_entries<=16) bits_per_index = 4;
+		else bits_per_index = 8;
+
+		// A palette that is just some opaque gray shades is not worth it,
+		// unless the indices are very small. 8-bit grayscale needs no
+		// palette, and compresses at least as well as 4- or 8-bit indices.
+		if(is_gray && num_trns_entries==0 && bits_per_index>2) goto done;
+
+		pal_est_size = ((img1->width*bits_per_index+7)/8)*img1->height;
+		pal_est_size += 12 + 3*(i64)num_entries; // PLTE
+		if(num_trns_entries>0) pal_est_size += 12 + num_trns_entries; // tRNS
+
+		nonpal_bytes_per_pixel = (is_gray ? 1 : 3) + (num_trns_entries>0 ? 1 : 0);
+		if(pal_est_size >= nonpal_bytes_per_pixel*npixels) {
+			goto done;
+		}
+	}
+
+	indices = de_malloc(c, npixels);
+	{
+		const u8 *p = img1->bitmap;
+		de_color prev_clr = 0;
+		u8 prev_idx = 0;
+		int have_prev = 0;
+
+		for(k=0; k<npixels; k++) {
+			de_color clr;
+
+			clr = get_raw_pixel(p, img1->bytes_per_pixel);
+			p += img1->bytes_per_pixel;
+			if(!have_prev || clr!=prev_clr) {
+				// Every color is already in ph, so this can't fail.
+				prev_idx = (u8)palhash_lookup(ph, clr);
+				prev_clr = clr;
+				have_prev = 1;
+			}
+			indices[k] = prev_idx;
+		}
+	}
+
+	if(num_trns_entries>0 && num_trns_entries<num_entries) {
+		u8 newidx[256];
+		de_color newpal[256];
+		int n = 0;
+		int pass;
+		int i;
+
+		for(pass=0; pass<2; pass++) {
+			for(i=0; i<num_entries; i++) {
+				if((DE_COLOR_A(pal[i])<255) == (pass==0)) {
+					newidx[i] = (u8)n;
+					newpal[n++] = pal[i];
+				}
+			}
+		}
+		de_memcpy(pal, newpal, (size_t)num_entries*sizeof(de_color));
+		for(k=0; k<npixels; k++) {
+			indices[k] = newidx[indices[k]];
+		}
+	}
+
+	palimg = de_bitmap_clone_noalloc(img1);
+	palimg->bytes_per_pixel = 1;
+	palimg->bitmap = indices;
+	palimg->bitmap_size = npixels;
+	palimg->pal = pal;
+	palimg->num_pal_entries = num_entries;
+	indices = NULL;
+	pal = NULL;
+
+done:
+	de_free(c, indices);
+	de_free(c, pal);
+	return palimg;
+}
+
+// Copy the pixels of img1 to img2, which must have the same dimensions, and
+// fewer bytes per pixel. The caller is responsible for making sure no
+// meaningful information is lost.
+// As with de_bitmap_setpixel_rgba(), grayscale values are taken from the
+// green sample.
+static void reduce_image_depth(const de_bitmap *img1, de_bitmap *img2)
+{
+	const u8 *s = img1->bitmap;
+	u8 *d = img2->bitmap;
+	i64 npixels;
+	i64 k;
+
+	if(!s || !d) return;
+	npixels = img1->width * img1->height;
+
+	switch(img1->bytes_per_pixel*10 + img2->bytes_per_pixel) {
+	case 43:
+		for(k=0; k<npixels; k++) {
+			d[k*3] = s[k*4];
+			d[k*3+1] = s[k*4+1];
+			d[k*3+2] = s[k*4+2];
+		}
+		break;
+	case 42:
+		for(k=0; k<npixels; k++) {
+			d[k*2] = s[k*4+1];
+			d[k*2+1] = s[k*4+3];
+		}
+		break;
+	case 41:
+		for(k=0; k<npixels; k++) {
+			d[k] = s[k*4+1];
+		}
+		break;
+	case 31:
+		for(k=0; k<npixels; k++) {
+			d[k] = s[k*3+1];
+		}
+		break;
+	case 21:
+		for(k=0; k<npixels; k++) {
+			d[k] = s[k*2];
+		}
+		break;
+	}
+}
+
 // Returns NULL if there's no need to optimize the image
-static de_bitmap *get_optimized_image(de_bitmap *img1)
+static de_bitmap *get_optimized_image(de_bitmap *img1,
+	const struct image_scan_results *isres)
 {
-	struct image_scan_results isres;
 	int opt_bytes_per_pixel;
 	de_bitmap *optimg;
 
-	scan_image(img1, &isres);
-	opt_bytes_per_pixel = isres.has_color ? 3 : 1;
-	if(isres.has_trns) opt_bytes_per_pixel++;
+	opt_bytes_per_pixel = isres->has_color ? 3 : 1;
+	if(isres->has_trns) opt_bytes_per_pixel++;
 
 	if(opt_bytes_per_pixel>=img1->bytes_per_pixel) {
 		return NULL;
@@ -165,7 +465,8 @@ static de_bitmap *get_optimized_image(de_bitmap *img1)
 
 	optimg = de_bitmap_clone_noalloc(img1);
 	optimg->bytes_per_pixel = opt_bytes_per_pixel;
-	de_bitmap_copy_rect(img1, optimg, 0, 0, img1->width, img1->height, 0, 0, 0);
+	de_bitmap_alloc_pixels(optimg);
+	reduce_image_depth(img1, optimg);
 	return optimg;
 }
 
@@ -177,6 +478,7 @@ void de_bitmap_write_to_file_finfo(de_bitmap *img, de_finfo *fi,
 	deark *c;
 	dbuf *f;
 	de_bitmap *optimg = NULL;
+	struct image_scan_results isres;
 
 	if(!img) return;
 	c = img->c;
@@ -184,17 +486,33 @@ void de_bitmap_write_to_file_finfo(de_bitmap *img, de_finfo *fi,
 
 	if(!img->bitmap) de_bitmap_alloc_pixels(img);
 
-	if(createflags & DE_CREATEFLAG_OPT_IMAGE) {
-		// This should probably be the default, but our optimization routine
-		// isn't very efficient, and wouldn't change anything in most cases.
-		optimg = get_optimized_image(img);
-		if(optimg) {
-			de_dbg3(c, "reducing image depth (%d->%d)", img->bytes_per_pixel,
-				optimg->bytes_per_pixel);
+	if(!c->pngpalette_valid) {
+		c->pngpalette = (u8)de_get_ext_option_bool(c, "pngpalette", 1);
+		c->pngpalette_valid = 1;
+	}
+
+	if(!img->pal) {
+		scan_image(img, &isres, (int)c->pngpalette);
+
+		if(isres.ph) {
+			optimg = get_paletted_image(img, isres.ph);
+			if(optimg) {
+				de_dbg3(c, "converting image to %d-color paletted", optimg->num_pal_entries);
+			}
+			de_free(c, isres.ph);
+		}
+
+		if(!optimg) {
+			// Remove any color or alpha channels that aren't needed.
+			optimg = get_optimized_image(img, &isres);
+			if(optimg) {
+				de_dbg3(c, "reducing image depth (%d->%d)", img->bytes_per_pixel,
+					optimg->bytes_per_pixel);
+			}
 		}
 	}
 
-	f = dbuf_create_output_file(c, "png", fi, createflags);
+	f = dbuf_create_output_file(c, "png", fi, createflags|DE_CREATEFLAG_NORECURSE);
 	if(optimg) {
 		de_write_png(c, optimg, f);
 	}
@@ -339,6 +657,11 @@ de_color de_bitmap_getpixel(de_bitmap *img, i64 x, i64 y)
 	if(x<0 || y<0 || x>=img->width || y>=img->height) return 0;
 	pos = (img->width*img->bytes_per_pixel)*y + img->bytes_per_pixel*x;
 
+	if(img->pal) {
+		if(img->bitmap[pos] >= img->num_pal_entries) return 0;
+		return img->pal[img->bitmap[pos]];
+	}
+
 	switch(img->bytes_per_pixel) {
 	case 4:
 		return DE_MAKE_RGBA(img->bitmap[pos], img->bitmap[pos+1],
@@ -383,6 +706,7 @@ void de_bitmap_destroy(de_bitmap *b)
 	if(b) {
 		deark *c = b->c;
 		if(b->bitmap) de_free(c, b->bitmap);
+		de_free(c, b->pal);
 		de_free(c, b);
 	}
 }
@@ -477,13 +801,137 @@ u8 de_get_bits_symbol2(dbuf *f, int nbits, i64 bytepos, i64 bitpos)
 	return (b0<<bits_in_second_byte) | (b1>>(8-bits_in_second_byte));
 }
 
+// Row-at-a-time helpers for the de_convert_* functions. They are much faster
+// than setting one pixel at a time, because they read each row of the source
+// file only once, and don't do bounds checking on each pixel. The loops are
+// kept simple, so that compilers can vectorize them.
+// Paletted and bilevel rows are converted in chunks of this many pixels,
+// using buffers on the stack.
+#define CVT_CHUNK_NPIXELS 1024
+
+// Returns a pointer to the start of the given row of img's pixels, or NULL
+// if the row doesn't exist.
+static u8 *bitmap_get_row_ptr(de_bitmap *img, i64 rownum)
+{
+	if(!img->bitmap) de_bitmap_alloc_pixels(img);
+	if(!img->bitmap) return NULL;
+	if(rownum<0 || rownum>=img->height) return NULL;
+	return &img->bitmap[rownum * img->width * img->bytes_per_pixel];
+}
+
+// Store npixels colors in row rownum of img, starting at column xpos, in the
+// same way that de_bitmap_setpixel_rgba() would.
+static void bitmap_store_row(de_bitmap *img, i64 rownum, i64 xpos,
+	const de_color *clrs, i64 npixels)
+{
+	u8 *dst;
+	i64 i;
+
+	dst = bitmap_get_row_ptr(img, rownum);
+	if(!dst) return;
+	if(xpos<0 || xpos>=img->width) return;
+	if(npixels>img->width-xpos) npixels = img->width-xpos;
+	dst += xpos*img->bytes_per_pixel;
+
+	switch(img->bytes_per_pixel) {
+	case 4:
+		for(i=0; i<npixels; i++) {
+			dst[i*4]   = DE_COLOR_R(clrs[i]);
+			dst[i*4+1] = DE_COLOR_G(clrs[i]);
+			dst[i*4+2] = DE_COLOR_B(clrs[i]);
+			dst[i*4+3] = DE_COLOR_A(clrs[i]);
+		}
+		break;
+	case 3:
+		for(i=0; i<npixels; i++) {
+			dst[i*3]   = DE_COLOR_R(clrs[i]);
+			dst[i*3+1] = DE_COLOR_G(clrs[i]);
+			dst[i*3+2] = DE_COLOR_B(clrs[i]);
+		}
+		break;
+	case 2:
+		for(i=0; i<npixels; i++) {
+			dst[i*2]   = DE_COLOR_G(clrs[i]);
+			dst[i*2+1] = DE_COLOR_A(clrs[i]);
+		}
+		break;
+	case 1:
+		for(i=0; i<npixels; i++) {
+			dst[i] = DE_COLOR_G(clrs[i]);
+		}
+		break;
+	}
+}
+
+// Unpack npixels palette indices of bpp (1, 2, 4, or 8) bits each, and look
+// them up in pal.
+// flags: DE_CVTF_LSBFIRST
+static void unpack_row_paletted(const u8 *src, i64 bpp, const de_color *pal,
+	de_color *clrs, i64 npixels, unsigned int flags)
+{
+	i64 i;
+
+	if(flags & DE_CVTF_LSBFIRST) {
+		switch(bpp) {
+		case 8:
+			for(i=0; i<npixels; i++) {
+				clrs[i] = pal[src[i]];
+			}
+			break;
+		case 4:
+			for(i=0; i<npixels; i++) {
+				clrs[i] = pal[(src[i/2] >> (4 * (i%2))) & 0x0f];
+			}
+			break;
+		case 2:
+			for(i=0; i<npixels; i++) {
+				clrs[i] = pal[(src[i/4] >> (2 * (i%4))) & 0x03];
+			}
+			break;
+		case 1:
+			for(i=0; i<npixels; i++) {
+				clrs[i] = pal[(src[i/8] >> (i%8)) & 0x01];
+			}
+			break;
+		}
+		return;
+	}
+
+	switch(bpp) {
+	case 8:
+		for(i=0; i<npixels; i++) {
+			clrs[i] = pal[src[i]];
+		}
+		break;
+	case 4:
+		for(i=0; i<npixels; i++) {
+			clrs[i] = pal[(src[i/2] >> (4 * (1 - i%2))) & 0x0f];
+		}
+		break;
+	case 2:
+		for(i=0; i<npixels; i++) {
+			clrs[i] = pal[(src[i/4] >> (2 * (3 - i%4))) & 0x03];
+		}
+		break;
+	case 1:
+		for(i=0; i<npixels; i++) {
+			clrs[i] = pal[(src[i/8] >> (7 - i%8)) & 0x01];
+		}
+		break;
+	}
+}
+
 void de_convert_row_bilevel(dbuf *f, i64 fpos, de_bitmap *img,
 	i64 rownum, unsigned int flags)
 {
 	i64 i;
-	u8 x;
-	u8 b;
+	i64 xpos;
+	i64 npixels;
+	u8 *dst;
 	u8 black, white;
+	de_color pal[2];
+	u8 srcbuf[CVT_CHUNK_NPIXELS/8];
+	de_color clrs[CVT_CHUNK_NPIXELS];
 
 	if(flags & DE_CVTF_WHITEISZERO) {
 		white = 0; black = 255;
@@ -491,14 +939,34 @@ void de_convert_row_bilevel(dbuf *f, i64 fpos, de_bitmap *img,
 	else {
 		black = 0; white = 255;
 	}
+	pal[0] = DE_MAKE_GRAY(black);
+	pal[1] = DE_MAKE_GRAY(white);
+
+	dst = bitmap_get_row_ptr(img, rownum);
+	if(!dst) return;
+
+	for(xpos=0; xpos<img->width; xpos+=CVT_CHUNK_NPIXELS) {
+		npixels = de_min_int(img->width-xpos, CVT_CHUNK_NPIXELS);
+		dbuf_read(f, srcbuf, fpos+xpos/8, (npixels+7)/8);
 
-	for(i=0; i<img->width; i++) {
-		b = dbuf_getbyte(f, fpos + i/8);
-		if(flags & DE_CVTF_LSBFIRST)
-			x = (b >> (i%8)) & 0x01;
-		else
-			x = (b >> (7 - i%8)) & 0x01;
-		de_bitmap_setpixel_gray(img, i, rownum, x ? white : black);
+		if(img->bytes_per_pixel==1) {
+			u8 *d = &dst[xpos];
+
+			if(flags & DE_CVTF_LSBFIRST) {
+				for(i=0; i<npixels; i++) {
+					d[i] = ((srcbuf[i/8] >> (i%8)) & 0x01) ? white : black;
+				}
+			}
+			else {
+				for(i=0; i<npixels; i++) {
+					d[i] = ((srcbuf[i/8] >> (7 - i%8)) & 0x01) ? white : black;
+				}
+			}
+		}
+		else {
+			unpack_row_paletted(srcbuf, 1, pal, clrs, npixels, flags);
+			bitmap_store_row(img, rownum, xpos, clrs, npixels);
+		}
 	}
 }
 
@@ -543,36 +1011,95 @@ void de_read_palette_rgb(dbuf *f,
 	}
 }
 
+// flags: DE_CVTF_LSBFIRST
+void de_convert_row_paletted(dbuf *f, i64 fpos, i64 bpp,
+	const de_color *pal, de_bitmap *img, i64 rownum, unsigned int flags)
+{
+	i64 xpos;
+	i64 npixels;
+	u8 srcbuf[CVT_CHUNK_NPIXELS];
+	de_color clrs[CVT_CHUNK_NPIXELS];
+
+	if(bpp!=1 && bpp!=2 && bpp!=4 && bpp!=8) return;
+	if(!bitmap_get_row_ptr(img, rownum)) return;
+
+	for(xpos=0; xpos<img->width; xpos+=CVT_CHUNK_NPIXELS) {
+		npixels = de_min_int(img->width-xpos, CVT_CHUNK_NPIXELS);
+		dbuf_read(f, srcbuf, fpos+(xpos*bpp)/8, (npixels*bpp+7)/8);
+		unpack_row_paletted(srcbuf, bpp, pal, clrs, npixels, flags);
+		bitmap_store_row(img, rownum, xpos, clrs, npixels);
+	}
+}
+
 void de_convert_image_paletted(dbuf *f, i64 fpos,
 	i64 bpp, i64 rowspan, const de_color *pal,
 	de_bitmap *img, unsigned int flags)
 {
-	i64 i, j;
-	unsigned int palent;
+	i64 j;
 
 	if(bpp!=1 && bpp!=2 && bpp!=4 && bpp!=8) return;
 	if(!de_good_image_dimensions_noerr(f->c, img->width, img->height)) return;
 
 	for(j=0; j<img->height; j++) {
-		for(i=0; i<img->width; i++) {
-			palent = (unsigned int)de_get_bits_symbol(f, bpp, fpos+j*rowspan, i);
-			de_bitmap_setpixel_rgba(img, i, j, pal[palent]);
-		}
+		de_convert_row_paletted(f, fpos+j*rowspan, bpp, pal, img, j, flags);
 	}
 }
 
+// flags: DE_GETRGBFLAG_*
 void de_convert_image_rgb(dbuf *f, i64 fpos,
 	i64 rowspan, i64 pixelspan, de_bitmap *img, unsigned int flags)
 {
 	i64 i, j;
-	de_color clr;
+	i64 srcrowlen;
+	int ridx, bidx;
+	u8 *rowbuf = NULL;
+	de_color *clrs = NULL;
+
+	if(img->width<1 || pixelspan<1) return;
+	if(!de_good_image_dimensions_noerr(f->c, img->width, img->height)) return;
+
+	if(flags & DE_GETRGBFLAG_BGR) {
+		ridx = 2; bidx = 0;
+	}
+	else {
+		ridx = 0; bidx = 2;
+	}
+
+	srcrowlen = (img->width-1)*pixelspan + 3;
+	rowbuf = de_malloc(f->c, srcrowlen);
+	if(img->bytes_per_pixel!=3) {
+		clrs = de_mallocarray(f->c, img->width, sizeof(de_color));
+	}
 
 	for(j=0; j<img->height; j++) {
-		for(i=0; i<img->width; i++) {
-			clr = dbuf_getRGB(f, fpos + j*rowspan + i*pixelspan, flags);
-			de_bitmap_setpixel_rgb(img, i, j, clr);
+		dbuf_read(f, rowbuf, fpos+j*rowspan, srcrowlen);
+
+		if(img->bytes_per_pixel==3) {
+			u8 *dst;
+
+			// The most common case. Write directly to the bitmap.
+			dst = bitmap_get_row_ptr(img, j);
+			if(!dst) break;
+			for(i=0; i<img->width; i++) {
+				const u8 *src = &rowbuf[i*pixelspan];
+
+				dst[i*3]   = src[ridx];
+				dst[i*3+1] = src[1];
+				dst[i*3+2] = src[bidx];
+			}
+		}
+		else {
+			for(i=0; i<img->width; i++) {
+				const u8 *src = &rowbuf[i*pixelspan];
+
+				clrs[i] = DE_MAKE_RGB(src[ridx], src[1], src[bidx]);
+			}
+			bitmap_store_row(img, j, 0, clrs, img->width);
 		}
 	}
+
+	de_free(f->c, rowbuf);
+	de_free(f->c, clrs);
 }
 
 // Paint a solid, solid-color rectangle onto an image.
@@ -644,8 +1171,8 @@ void de_bitmap_apply_mask(de_bitmap *fg, de_bitmap *mask,
 	}
 }
 
-// Note: This function's features overlap with the DE_CREATEFLAG_OPT_IMAGE
-//  flag supported by de_bitmap_write_to_file().
+// Note: This function's features overlap with the image optimization
+//  always done by de_bitmap_write_to_file().
 // If the image is 100% opaque, remove the alpha channel.
 // Otherwise do nothing.
 // flags:
@@ -659,7 +1186,7 @@ void de_optimize_image_alpha(de_bitmap *img, unsigned int flags)
 
 	if(img->bytes_per_pixel!=2 && img->bytes_per_pixel!=4) return;
 
-	scan_image(img, &isres);
+	scan_image(img, &isres, 0);
 
 	if(isres.has_trns && !isres.has_visible_pixels && (flags&0x1)) {
 		if(flags&0x2) {
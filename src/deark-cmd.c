@@ -30,7 +30,11 @@ enum special_command_code_enum {
 struct cmdctx {
 	deark *c;
 	struct de_platform_data *plctx;
+	int argc;
+	char **argv;
 	const char *input_filename;
+	int num_input_filenames;
+	const char **input_filenames; // Pointer to an array of [argc] items
 	int error_flag;
 	int show_usage_message;
 	int special_command_flag;
@@ -63,11 +67,46 @@ struct cmdctx {
 	enum color_method_enum color_method_req;
 	enum color_method_enum color_method;
 	char msgbuf[1000];
+
+	int batch_mode;
+	const char *batch_list_filename;
+
+	// 1 = "-opt cmd:cbtest", 2 = "-opt cmd:cbtest=noopen"
+	int cbtest_mode;
+
+	// In batch mode, each input file gets its own cmdctx, whose parent is the
+	// main cmdctx. Its messages are collected in outbuf, and printed when the
+	// file is finished.
+	struct cmdctx *parent;
+	char *outbuf;
+	size_t outbuf_len;
+	size_t outbuf_alloc;
 };
 
+static void append_to_outbuf(struct cmdctx *cc, const char *sz)
+{
+	size_t len;
+	size_t new_alloc;
+
+	len = strlen(sz);
+	if(cc->outbuf_len + len + 1 > cc->outbuf_alloc) {
+		new_alloc = cc->outbuf_alloc*2;
+		if(new_alloc < cc->outbuf_len + len + 1) new_alloc = cc->outbuf_len + len + 1;
+		if(new_alloc < 1024) new_alloc = 1024;
+		cc->outbuf = de_realloc(NULL, cc->outbuf, (i64)cc->outbuf_alloc, (i64)new_alloc);
+		cc->outbuf_alloc = new_alloc;
+	}
+	memcpy(&cc->outbuf[cc->outbuf_len], sz, len+1);
+	cc->outbuf_len += len;
+}
+
 // Low-level print function
 static void emit_sz(struct cmdctx *cc, const char *sz)
 {
+	if(cc->parent) {
+		append_to_outbuf(cc, sz);
+		return;
+	}
 #ifdef DE_WINDOWS
 	if(cc->use_fwputs) {
 		de_utf8_to_utf16_to_FILE(cc->c, sz, cc->msgs_FILE);
@@ -344,10 +383,84 @@ static void our_msgfn(deark *c, unsigned int flags, const char *s1)
 	emit_sz(cc, s);
 }
 
+// If this returns during de_run(), de_run() fails, and we carry on from there.
+// In batch mode, that means the other files still get processed.
 static void our_fatalerrorfn(deark *c)
 {
-	de_puts(c, DE_MSGTYPE_MESSAGE, "Exiting\n");
-	de_exitprocess(1);
+	struct cmdctx *cc;
+
+	cc = de_get_userdata(c);
+	if(!cc->parent) {
+		de_puts(c, DE_MSGTYPE_MESSAGE, "Exiting\n");
+	}
+}
+
+// "-opt cmd:cbtest" is a developer option that tests DE_OUTPUTSTYLE_CALLBACK.
+// Instead of writing the output files, it prints the name, size, and CRC-32
+// of each one, and checks that the size passed to the close function is the
+// number of bytes that were passed to the write function.
+// "-opt cmd:cbtest=noopen" tests what happens if no open function is set.
+struct cbtest_file {
+	char *name;
+	int file_id;
+	int is_directory;
+	i64 nbytes;
+	u32 crc;
+};
+
+static u32 cbtest_crc32(u32 crc, const u8 *buf, i64 buf_len)
+{
+	i64 i;
+	int k;
+
+	for(i=0; i<buf_len; i++) {
+		crc ^= (u32)buf[i];
+		for(k=0; k<8; k++) {
+			crc = (crc>>1) ^ ((crc & 1) ? 0xedb88320U : 0);
+		}
+	}
+	return crc;
+}
+
+static void *cbtest_open_fn(deark *c, void *userdata,
+	const struct de_output_file_info *ofi)
+{
+	struct cbtest_file *cbf;
+
+	cbf = de_malloc(c, sizeof(struct cbtest_file));
+	cbf->name = de_strdup(c, ofi->name ? ofi->name : "");
+	cbf->file_id = ofi->file_id;
+	cbf->is_directory = ofi->is_directory;
+	cbf->crc = 0xffffffffU;
+	return (void*)cbf;
+}
+
+static void cbtest_write_fn(deark *c, void *userdata, void *handle,
+	const u8 *buf, i64 buf_len)
+{
+	struct cbtest_file *cbf = (struct cbtest_file*)handle;
+
+	cbf->crc = cbtest_crc32(cbf->crc, buf, buf_len);
+	cbf->nbytes += buf_len;
+}
+
+static void cbtest_close_fn(deark *c, void *userdata, void *handle,
+	i64 file_len)
+{
+	struct cmdctx *cc = (struct cmdctx*)userdata;
+	struct cbtest_file *cbf = (struct cbtest_file*)handle;
+
+	if(!cbf) return;
+	de_printf(c, DE_MSGTYPE_MESSAGE, "cbtest: %d %s%s %"I64_FMT" crc32=%08x\n",
+		cbf->file_id, cbf->name, cbf->is_directory?" (dir)":"",
+		cbf->nbytes, (unsigned int)(cbf->crc ^ 0xffffffffU));
+	if(file_len != cbf->nbytes) {
+		de_printf(c, DE_MSGTYPE_MESSAGE, "Error: cbtest: %s: close reported %"I64_FMT
+			" bytes, but %"I64_FMT" were written\n", cbf->name, file_len, cbf->nbytes);
+		cc->error_flag = 1;
+	}
+	de_free(c, cbf->name);
+	de_free(c, cbf);
 }
 
 static void set_ext_option(deark *c, struct cmdctx *cc, const char *optionstring)
@@ -367,6 +480,10 @@ static void set_ext_option(deark *c, struct cmdctx *cc, const char *optionstring
 		// No "=" symbol
 		de_set_ext_option(c, tmp, "");
 	}
+
+	if(!strcmp(tmp, "cmd:cbtest")) {
+		cc->cbtest_mode = (eqpos && !strcmp(eqpos+1, "noopen")) ? 2 : 1;
+	}
 	de_free(c, tmp);
 }
 
@@ -401,10 +518,10 @@ enum opt_id_enum {
  DE_OPT_START, DE_OPT_SIZE, DE_OPT_M, DE_OPT_MODCODES, DE_OPT_O, DE_OPT_OD,
  DE_OPT_K, DE_OPT_K2, DE_OPT_K3, DE_OPT_KA, DE_OPT_KA2, DE_OPT_KA3,
  DE_OPT_ARCFN, DE_OPT_GET, DE_OPT_FIRSTFILE, DE_OPT_MAXFILES,
- DE_OPT_MAXFILESIZE, DE_OPT_MAXTOTALSIZE, DE_OPT_MAXIMGDIM,
+ DE_OPT_MAXFILESIZE, DE_OPT_MAXTOTALSIZE, DE_OPT_MAXIMGDIM, DE_OPT_THREADS,
  DE_OPT_PRINTMODULES, DE_OPT_DPREFIX, DE_OPT_EXTRLIST,
  DE_OPT_ONLYMODS, DE_OPT_DISABLEMODS, DE_OPT_ONLYDETECT, DE_OPT_NODETECT,
- DE_OPT_COLORMODE
+ DE_OPT_COLORMODE, DE_OPT_BATCH, DE_OPT_BATCHLIST, DE_OPT_RECURSE
 };
 
 struct opt_struct {
@@ -472,6 +589,7 @@ struct opt_struct option_array[] = {
 	{ "maxfilesize",  DE_OPT_MAXFILESIZE,  1 },
 	{ "maxtotalsize", DE_OPT_MAXTOTALSIZE, 1 },
 	{ "maxdim",       DE_OPT_MAXIMGDIM,    1 },
+	{ "threads",      DE_OPT_THREADS,      1 },
 	{ "dprefix",      DE_OPT_DPREFIX,      1 },
 	{ "extrlist",     DE_OPT_EXTRLIST,     1 },
 	{ "onlymods",     DE_OPT_ONLYMODS,     1 },
@@ -479,6 +597,9 @@ struct opt_struct option_array[] = {
 	{ "onlydetect",   DE_OPT_ONLYDETECT,   1 },
 	{ "nodetect",     DE_OPT_NODETECT,     1 },
 	{ "colormode",    DE_OPT_COLORMODE,    1 },
+	{ "batch",        DE_OPT_BATCH,        0 },
+	{ "batchlist",    DE_OPT_BATCHLIST,    1 },
+	{ "recurse",      DE_OPT_RECURSE,      0 },
 	{ NULL,           DE_OPT_NULL,         0 }
 };
 
@@ -609,6 +730,9 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 	int module_flag = 0;
 	const struct opt_struct *opt;
 
+	// (Not allocated with c, because it's used after c is destroyed.)
+	cc->input_filenames = de_mallocarray(NULL, argc, sizeof(const char*));
+
 	for(i=1;i<argc;i++) {
 		if(argv[i][0]=='-') {
 			if(argv[i][1]=='-') // Allow a superfluous second '-'
@@ -730,7 +854,6 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 				send_msgs_to_stderr(c, cc);
 				break;
 			case DE_OPT_FROMSTDIN:
-				de_set_input_style(c, DE_INPUTSTYLE_STDIN);
 				cc->from_stdin = 1;
 				break;
 			case DE_OPT_COLOR:
@@ -762,8 +885,7 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 				set_ext_option(c, cc, argv[i+1]);
 				break;
 			case DE_OPT_FILE:
-				cc->input_filename = argv[i+1];
-				de_set_input_filename(c, cc->input_filename);
+				cc->input_filenames[cc->num_input_filenames++] = argv[i+1];
 				break;
 			case DE_OPT_FILE2:
 				de_set_ext_option(c, "file2", argv[i+1]);
@@ -822,6 +944,9 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 			case DE_OPT_MAXIMGDIM:
 				de_set_max_image_dimension(c, de_atoi64(argv[i+1]));
 				break;
+			case DE_OPT_THREADS:
+				de_set_num_threads(c, de_atoi(argv[i+1]));
+				break;
 			case DE_OPT_DPREFIX:
 				de_set_dprefix(c, argv[i+1]);
 				break;
@@ -844,6 +969,16 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 				colormode_opt(cc, argv[i+1]);
 				if(cc->error_flag) return;
 				break;
+			case DE_OPT_RECURSE:
+				de_set_recurse(c, 1);
+				break;
+			case DE_OPT_BATCH:
+				cc->batch_mode = 1;
+				break;
+			case DE_OPT_BATCHLIST:
+				cc->batch_mode = 1;
+				cc->batch_list_filename = argv[i+1];
+				break;
 			default:
 				de_printf(c, DE_MSGTYPE_MESSAGE, "Unrecognized option: %s\n", argv[i]);
 				cc->error_flag = 1;
@@ -854,14 +989,33 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 			i += opt->extra_args;
 		}
 		else {
-			if(cc->input_filename) {
-				cc->error_flag = 1;
-				cc->show_usage_message = 1;
-				return;
-			}
-			cc->input_filename = argv[i];
+			cc->input_filenames[cc->num_input_filenames++] = argv[i];
+		}
+	}
+
+	if(cc->parent) {
+		// A batch-mode file. cc->input_filename was set by the caller.
+		de_set_input_filename(c, cc->input_filename);
+	}
+	else if(cc->batch_mode) {
+		if(cc->from_stdin) {
+			// The list of input files is read from stdin.
+			de_set_input_style(c, DE_INPUTSTYLE_STDIN);
+		}
+	}
+	else {
+		if(cc->num_input_filenames>1) {
+			cc->error_flag = 1;
+			cc->show_usage_message = 1;
+			return;
+		}
+		if(cc->num_input_filenames==1) {
+			cc->input_filename = cc->input_filenames[0];
 			de_set_input_filename(c, cc->input_filename);
 		}
+		if(cc->from_stdin) {
+			de_set_input_style(c, DE_INPUTSTYLE_STDIN);
+		}
 	}
 
 	if(help_flag) {
@@ -875,7 +1029,25 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 		return;
 	}
 
-	if(!cc->input_filename && !cc->special_command_flag && !cc->from_stdin) {
+	if(cc->batch_mode && !cc->special_command_flag) {
+		if(cc->to_stdout || cc->base_output_filename || cc->archive_filename) {
+			de_puts(c, DE_MSGTYPE_MESSAGE, "Error: -tostdout, -o, and -arcfn "
+				"can't be used with -batch\n");
+			cc->error_flag = 1;
+			return;
+		}
+		if(cc->num_input_filenames==0 && !cc->batch_list_filename && !cc->from_stdin) {
+			de_puts(c, DE_MSGTYPE_MESSAGE, "Error: Need an input filename\n");
+			cc->error_flag = 1;
+			cc->show_usage_message = 1;
+			return;
+		}
+		// Output filenames must be distinct, so they always start with the
+		// input filename.
+		if(!cc->option_k_level) cc->option_k_level = 1;
+		if(!cc->option_ka_level) cc->option_ka_level = 1;
+	}
+	else if(!cc->input_filename && !cc->special_command_flag && !cc->from_stdin) {
 		de_puts(c, DE_MSGTYPE_MESSAGE, "Error: Need an input filename\n");
 		cc->error_flag = 1;
 		cc->show_usage_message = 1;
@@ -894,10 +1066,68 @@ static void parse_cmdline(deark *c, struct cmdctx *cc, int argc, char **argv)
 		}
 	}
 
+	if(cc->cbtest_mode) {
+		de_set_output_style(c, DE_OUTPUTSTYLE_CALLBACK, 0);
+		de_set_output_callbacks(c, (cc->cbtest_mode==2) ? NULL : cbtest_open_fn,
+			cbtest_write_fn, cbtest_close_fn, (void*)cc);
+	}
+
 	set_output_basename(cc);
 	set_output_archive_name(cc);
 }
 
+static deark *batch_item_create(deark *c, const char *input_filename)
+{
+	struct cmdctx *cc;
+	struct cmdctx *icc;
+	deark *ic;
+
+	cc = de_get_userdata(c);
+	if(!cc->have_initialized_output_stream) {
+		initialize_output_stream(cc);
+	}
+
+	icc = de_malloc(NULL, sizeof(struct cmdctx));
+	ic = de_create();
+	icc->c = ic;
+	icc->parent = cc;
+	icc->input_filename = input_filename;
+
+	de_set_userdata(ic, (void*)icc);
+	de_set_fatalerror_callback(ic, our_fatalerrorfn);
+	de_set_messages_callback(ic, our_msgfn);
+	de_set_special_messages_callback(ic, our_specialmsgfn);
+
+	// The options were already validated, when parsed for the main context.
+	parse_cmdline(ic, icc, cc->argc, cc->argv);
+
+	// Messages are written to icc->outbuf, so the output stream settings are
+	// the parent's. Windows console colors can't be buffered.
+	icc->have_initialized_output_stream = 1;
+	icc->color_method = cc->color_method;
+	if(icc->color_method==CM_WINCONSOLE) {
+		icc->color_method = CM_NOCOLOR;
+	}
+	return ic;
+}
+
+static void batch_item_finish(deark *c, deark *item_c, int ret)
+{
+	struct cmdctx *cc;
+	struct cmdctx *icc;
+
+	cc = de_get_userdata(c);
+	icc = de_get_userdata(item_c);
+
+	de_destroy(item_c);
+	if(icc->outbuf) {
+		emit_sz(cc, icc->outbuf);
+	}
+	de_free(NULL, icc->outbuf);
+	de_free(NULL, icc->input_filenames);
+	de_free(NULL, icc);
+}
+
 static int main2(int argc, char **argv)
 {
 	deark *c = NULL;
@@ -908,6 +1138,8 @@ static int main2(int argc, char **argv)
 	cc = de_malloc(NULL, sizeof(struct cmdctx));
 	c = de_create();
 	cc->c = c;
+	cc->argc = argc;
+	cc->argv = argv;
 
 	de_set_userdata(c, (void*)cc);
 	de_set_fatalerror_callback(c, our_fatalerrorfn);
@@ -958,7 +1190,13 @@ static int main2(int argc, char **argv)
 	}
 #endif
 
-	ret = de_run(c);
+	if(cc->batch_mode) {
+		ret = de_run_batch(c, cc->input_filenames, (size_t)cc->num_input_filenames,
+			cc->batch_list_filename, batch_item_create, batch_item_finish);
+	}
+	else {
+		ret = de_run(c);
+	}
 	if(!ret) {
 		exit_status = 1;
 	}
@@ -968,6 +1206,7 @@ done:
 	de_platformdata_destroy(cc->plctx);
 	cc->plctx = NULL;
 	if(cc->error_flag) exit_status = 1;
+	de_free(NULL, cc->input_filenames);
 	de_free(NULL, cc);
 	return exit_status;
 }
@@ -0,0 +1,78 @@
+// This file is part of Deark.
+// Copyright (C) 2026 Jason Summers
+// See the file COPYING for terms of use.
+
+// A developer tool that times the crcobj functions. It is not part of
+// Deark, and is not built by default. Use "make crcbench".
+// Usage: deark-crcbench [<megabytes per algorithm>]
+
+#define DE_NOT_IN_MODULE
+#include "deark-config.h"
+#include "deark-private.h"
+#include "deark-user.h"
+
+static void bench_onetype(deark *c, const u8 *buf, i64 buf_len,
+	i64 npasses, UI crcflags, const char *name)
+{
+	struct de_crcobj *crco;
+	struct de_timestamp t1, t2;
+	i64 i;
+	i64 elapsed; // in 100ns units
+	double mb_per_sec = 0.0;
+
+	crco = de_crcobj_create(c, crcflags);
+	de_current_time_to_timestamp(&t1);
+	for(i=0; i<npasses; i++) {
+		de_crcobj_addbuf(crco, buf, buf_len);
+	}
+	de_current_time_to_timestamp(&t2);
+
+	elapsed = de_timestamp_to_FILETIME(&t2) - de_timestamp_to_FILETIME(&t1);
+	if(elapsed>0) {
+		mb_per_sec = ((double)(npasses*buf_len)/1048576.0) /
+			((double)elapsed/10000000.0);
+	}
+	printf("%-24s 0x%08x  %9.1f MB/s\n", name,
+		(UI)de_crcobj_getval(crco), mb_per_sec);
+	de_crcobj_destroy(crco);
+}
+
+int main(int argc, char **argv)
+{
+	deark *c;
+	u8 *buf;
+	const i64 buf_len = 1048576;
+	i64 nmegabytes = 64;
+	u32 x = 1;
+	i64 i;
+
+	if(argc>=2) {
+		nmegabytes = de_atoi64(argv[1]);
+		if(nmegabytes<1) nmegabytes = 1;
+	}
+
+	c = de_create();
+	buf = de_malloc(c, buf_len);
+	for(i=0; i<buf_len; i++) {
+		x = x*1103515245U + 12345U;
+		buf[i] = (u8)(x>>23);
+	}
+
+	printf("Benchmarking, %d MB per algorithm\n", (int)nmegabytes);
+	bench_onetype(c, buf, buf_len, nmegabytes,
+		DE_CRCOBJ_CRC32_IEEE|DE_CRCOBJ_FLAG_BYTEWISE, "CRC-32-IEEE bytewise");
+	bench_onetype(c, buf, buf_len, nmegabytes,
+		DE_CRCOBJ_CRC32_IEEE, "CRC-32-IEEE sliced");
+	bench_onetype(c, buf, buf_len, nmegabytes,
+		DE_CRCOBJ_CRC16_ARC|DE_CRCOBJ_FLAG_BYTEWISE, "CRC-16-IBM/ARC bytewise");
+	bench_onetype(c, buf, buf_len, nmegabytes,
+		DE_CRCOBJ_CRC16_ARC, "CRC-16-IBM/ARC sliced");
+	bench_onetype(c, buf, buf_len, nmegabytes,
+		DE_CRCOBJ_CRC16_CCITT|DE_CRCOBJ_FLAG_BYTEWISE, "CRC-16-CCITT bytewise");
+	bench_onetype(c, buf, buf_len, nmegabytes,
+		DE_CRCOBJ_CRC16_CCITT, "CRC-16-CCITT sliced");
+
+	de_free(c, buf);
+	de_destroy(c);
+	return 0;
+}
@@ -13,26 +13,202 @@
 #define DE_DUMMY_MAX_FILE_SIZE (1LL<<56)
 #define DE_MAX_MEMBUF_SIZE 2000000000
 #define DE_CACHE_SIZE 262144
+#define DE_CACHE_READ_UNIT 4096 // The cache is filled in multiples of this
+#define DE_PAGECACHE_PAGE_SIZE 65536
+#define DE_PAGECACHE_DEFAULT_MAXMEM 16777216
+
+struct de_pagecache_page {
+	i64 pageidx; // The page number; pos/DE_PAGECACHE_PAGE_SIZE
+	i64 nbytes;
+	u64 last_used;
+	u8 *data;
+};
 
-// Fill the cache that remembers the first part of the file.
-// TODO: We should probably use memory-mapped files instead when possible,
-// but this is simple and portable, and does most of what we need.
-static void populate_cache(dbuf *f)
+// pagecache: A least-recently-used cache of fixed-size pages of a file.
+struct de_pagecache {
+	int max_pages;
+	int num_pages;
+	int last_page_used; // Index into pages[]. Checked first, on every lookup.
+	u64 use_counter;
+	struct de_pagecache_page *pages; // array[max_pages], the first num_pages in use
+};
+
+static struct de_pagecache *pagecache_create(deark *c, i64 maxmem)
+{
+	struct de_pagecache *pc;
+
+	pc = de_malloc(c, sizeof(struct de_pagecache));
+	pc->max_pages = (int)de_min_int(maxmem/DE_PAGECACHE_PAGE_SIZE, 65536);
+	if(pc->max_pages<1) pc->max_pages = 1;
+	pc->pages = de_mallocarray(c, pc->max_pages, sizeof(struct de_pagecache_page));
+	return pc;
+}
+
+static void pagecache_destroy(deark *c, struct de_pagecache *pc)
+{
+	int i;
+
+	if(!pc) return;
+	for(i=0; i<pc->num_pages; i++) {
+		de_free(c, pc->pages[i].data);
+	}
+	de_free(c, pc->pages);
+	de_free(c, pc);
+}
+
+// Returns the page containing file position 'pos', reading it if necessary.
+static struct de_pagecache_page *pagecache_get_page(dbuf *f, i64 pos)
+{
+	struct de_pagecache *pc = f->pagecache;
+	struct de_pagecache_page *pg;
+	i64 pageidx;
+	i64 bytes_to_read;
+	int i;
+	int lru_idx;
+
+	pageidx = pos / DE_PAGECACHE_PAGE_SIZE;
+	pc->use_counter++;
+
+	pg = &pc->pages[pc->last_page_used];
+	if(pg->data && pg->pageidx==pageidx) {
+		pg->last_used = pc->use_counter;
+		return pg;
+	}
+
+	lru_idx = 0;
+	for(i=0; i<pc->num_pages; i++) {
+		if(pc->pages[i].pageidx==pageidx) {
+			pc->last_page_used = i;
+			pc->pages[i].last_used = pc->use_counter;
+			return &pc->pages[i];
+		}
+		if(pc->pages[i].last_used < pc->pages[lru_idx].last_used) {
+			lru_idx = i;
+		}
+	}
+
+	// Not found. Use a new page if we can, otherwise the least recently used.
+	if(pc->num_pages < pc->max_pages) {
+		lru_idx = pc->num_pages;
+		pc->num_pages++;
+		pc->pages[lru_idx].data = de_malloc(f->c, DE_PAGECACHE_PAGE_SIZE);
+	}
+	pg = &pc->pages[lru_idx];
+
+	bytes_to_read = de_min_int(DE_PAGECACHE_PAGE_SIZE, f->len - pageidx*DE_PAGECACHE_PAGE_SIZE);
+	if(!f->file_pos_known || f->file_pos!=pageidx*DE_PAGECACHE_PAGE_SIZE) {
+		de_fseek(f->fp, pageidx*DE_PAGECACHE_PAGE_SIZE, SEEK_SET);
+	}
+	pg->nbytes = (i64)fread(pg->data, 1, (size_t)bytes_to_read, f->fp);
+	f->bytes_read_from_file += pg->nbytes;
+	f->file_pos = pageidx*DE_PAGECACHE_PAGE_SIZE + pg->nbytes;
+	f->file_pos_known = 1;
+
+	pg->pageidx = pageidx;
+	pg->last_used = pc->use_counter;
+	pc->last_page_used = lru_idx;
+	return pg;
+}
+
+// Caller must make sure the bytes are within the file.
+// Returns the number of bytes read.
+static i64 pagecache_read(dbuf *f, u8 *buf, i64 pos, i64 len)
+{
+	struct de_pagecache_page *pg;
+	i64 bytes_read = 0;
+
+	while(bytes_read < len) {
+		i64 offset_in_page;
+		i64 n;
+
+		pg = pagecache_get_page(f, pos+bytes_read);
+		offset_in_page = pos + bytes_read - pg->pageidx*DE_PAGECACHE_PAGE_SIZE;
+		if(offset_in_page >= pg->nbytes) break; // File is shorter than expected
+		n = de_min_int(len - bytes_read, pg->nbytes - offset_in_page);
+		de_memcpy(&buf[bytes_read], &pg->data[offset_in_page], (size_t)n);
+		bytes_read += n;
+	}
+	return bytes_read;
+}
+
+// Read more of the file into a cache that is filled on demand, so that (if
+// possible) at least the first 'endpos' bytes are cached.
+// Most modules only look at the first few bytes of a file, at least during
+// format detection, so we don't want to read any more than necessary. But
+// the cache grows by at least doubling, to keep the number of reads small.
+static void cache_extend(dbuf *f, i64 endpos)
 {
+	i64 new_bytes_used;
 	i64 bytes_to_read;
 	i64 bytes_read;
 
+	if(endpos <= f->cache_bytes_used) return;
+	if(endpos > f->cache_fill_limit) return;
+
+	new_bytes_used = de_pad_to_n(endpos, DE_CACHE_READ_UNIT);
+	if(new_bytes_used < 2*f->cache_bytes_used) {
+		new_bytes_used = 2*f->cache_bytes_used;
+	}
+	if(new_bytes_used > f->cache_fill_limit) {
+		new_bytes_used = f->cache_fill_limit;
+	}
+
+	bytes_to_read = new_bytes_used - f->cache_bytes_used;
+	if(!f->file_pos_known || f->file_pos!=f->cache_bytes_used) {
+		de_fseek(f->fp, f->cache_bytes_used, SEEK_SET);
+	}
+	bytes_read = (i64)fread(&f->cache[f->cache_bytes_used], 1, (size_t)bytes_to_read, f->fp);
+	f->bytes_read_from_file += bytes_read;
+	f->cache_bytes_used += bytes_read;
+	f->file_pos = f->cache_bytes_used;
+	f->file_pos_known = 1;
+
+	if(bytes_read < bytes_to_read) {
+		// The file is shorter than expected. Don't try to read any more.
+		f->cache_fill_limit = f->cache_bytes_used;
+	}
+}
+
+// Returns 1 if we'd rather read as little of the input file as possible, and
+// know exactly which bytes were read. That's the case with -id, and with -l
+// (unless "-opt verify" was used, in which case every member gets decoded).
+// Memory-mapping and the page cache both read more than was asked for.
+static int wants_minimal_reads(deark *c)
+{
+	if(c->identify_only) return 1;
+	if(c->list_mode && !de_get_ext_option_bool(c, "verify", 0)) return 1;
+	return 0;
+}
+
+// Set up the cache that remembers the first part of the file. It is filled
+// on demand, by cache_extend().
+// If the file is larger than that, try to memory-map the whole file instead,
+// and use the mapping as the cache. Reads from it don't need any system calls,
+// and the rest of the dbuf code treats it as one contiguous buffer.
+// The trade-off is that on Unix, if another process truncates the file while
+// we're using it, we'll crash with SIGBUS instead of reporting a read error.
+// "-opt mmap=0" avoids that.
+static void populate_cache(dbuf *f)
+{
 	if(f->btype!=DBUF_TYPE_IFILE) return;
 
-	bytes_to_read = DE_CACHE_SIZE;
-	if(f->len < bytes_to_read) {
-		bytes_to_read = f->len;
+	if(f->len > DE_CACHE_SIZE && !wants_minimal_reads(f->c) &&
+		de_get_ext_option_bool(f->c, "mmap", 1))
+	{
+		f->cache = de_mmap_file(f->fp, f->len);
+		if(f->cache) {
+			de_dbg2(f->c, "memory-mapped input file (%"I64_FMT" bytes)", f->len);
+			f->cache_is_mapped = 1;
+			f->cache_bytes_used = f->len;
+			return;
+		}
+		// Not a regular file, changed size since we opened it, or out of
+		// address space. Fall back to stdio.
 	}
 
-	f->cache = de_malloc(f->c, DE_CACHE_SIZE);
-	de_fseek(f->fp, 0, SEEK_SET);
-	bytes_read = fread(f->cache, 1, (size_t)bytes_to_read, f->fp);
-	f->cache_bytes_used = bytes_read;
+	f->cache_fill_limit = de_min_int(f->len, DE_CACHE_SIZE);
+	f->cache = de_malloc(f->c, f->cache_fill_limit);
+	f->cache_bytes_used = 0;
 	f->file_pos_known = 0;
 }
 
@@ -81,6 +257,63 @@ static void populate_cache_from_pipe(dbuf *f)
 	f->len = f->cache_bytes_used;
 }
 
+// One contiguous piece of a DBUF_TYPE_EXTENTS dbuf.
+struct de_dbuf_extent {
+	i64 vpos; // Position in the extents dbuf
+	i64 ppos; // Position in the parent dbuf
+	i64 len;
+};
+
+// Returns the index of the extent containing pos, which must be a valid
+// position in f.
+static i64 find_extent(dbuf *f, i64 pos)
+{
+	const struct de_dbuf_extent *ext;
+	i64 lo, hi;
+
+	// Reads are usually sequential, so check the most recent extent, and the
+	// next one, before doing a binary search.
+	ext = &f->extents[f->last_extent_idx];
+	if(pos >= ext->vpos) {
+		if(pos < ext->vpos + ext->len) {
+			return f->last_extent_idx;
+		}
+		if(f->last_extent_idx+1 < f->num_extents && pos < ext[1].vpos + ext[1].len) {
+			return f->last_extent_idx+1;
+		}
+	}
+
+	lo = 0;
+	hi = f->num_extents-1;
+	while(lo < hi) {
+		i64 mid = (lo+hi+1)/2;
+
+		if(f->extents[mid].vpos <= pos) lo = mid;
+		else hi = mid-1;
+	}
+	return lo;
+}
+
+static void extents_read(dbuf *f, u8 *buf, i64 pos, i64 len)
+{
+	i64 idx;
+
+	idx = find_extent(f, pos);
+	while(len>0 && idx<f->num_extents) {
+		const struct de_dbuf_extent *ext = &f->extents[idx];
+		i64 offset_in_ext = pos - ext->vpos;
+		i64 n;
+
+		n = de_min_int(ext->len - offset_in_ext, len);
+		dbuf_read(f->parent_dbuf, buf, ext->ppos + offset_in_ext, n);
+		f->last_extent_idx = idx;
+		buf += n;
+		pos += n;
+		len -= n;
+		idx++;
+	}
+}
+
 // Read len bytes, starting at file position pos, into buf.
 // Unread bytes will be set to 0.
 void dbuf_read(dbuf *f, u8 *buf, i64 pos, i64 len)
@@ -118,6 +351,10 @@ void dbuf_read(dbuf *f, u8 *buf, i64 pos, i64 len)
 		goto done_read;
 	}
 
+	if(pos + bytes_to_read > f->cache_bytes_used) {
+		cache_extend(f, pos + bytes_to_read);
+	}
+
 	// If the data we need is all cached, get it from cache.
 	if(f->cache &&
 		pos >= 0 &&
@@ -136,6 +373,13 @@ void dbuf_read(dbuf *f, u8 *buf, i64 pos, i64 len)
 			goto done_read;
 		}
 
+		// Small reads go through the page cache. Large ones would just evict
+		// everything from it, so they go straight to the file.
+		if(f->pagecache && bytes_to_read<=DE_PAGECACHE_PAGE_SIZE) {
+			bytes_read = pagecache_read(f, buf, pos, bytes_to_read);
+			break;
+		}
+
 		// For performance reasons, don't call fseek if we're already at the
 		// right position.
 		if(!f->file_pos_known || f->file_pos!=pos) {
@@ -143,6 +387,7 @@ void dbuf_read(dbuf *f, u8 *buf, i64 pos, i64 len)
 		}
 
 		bytes_read = fread(buf, 1, (size_t)bytes_to_read, f->fp);
+		f->bytes_read_from_file += bytes_read;
 
 		f->file_pos = pos + bytes_read;
 		f->file_pos_known = 1;
@@ -156,6 +401,17 @@ void dbuf_read(dbuf *f, u8 *buf, i64 pos, i64 len)
 		bytes_read = bytes_to_read;
 		break;
 
+	case DBUF_TYPE_EXTENTS:
+		extents_read(f, buf, pos, bytes_to_read);
+		bytes_read = bytes_to_read;
+		break;
+
+	case DBUF_TYPE_CUSTOM:
+		if(!f->customread_fn) goto done_read;
+		f->customread_fn(f, f->userdata_for_customread, buf, pos, bytes_to_read);
+		bytes_read = bytes_to_read;
+		break;
+
 	case DBUF_TYPE_MEMBUF:
 		de_memcpy(buf, &f->membuf_buf[pos], (size_t)bytes_to_read);
 		bytes_read = bytes_to_read;
@@ -699,12 +955,107 @@ static int copy_cbfn(struct de_bufferedreadctx *brctx, const u8 *buf,
 	return 1;
 }
 
+// Copies smaller than this aren't worth the overhead of a direct copy.
+#define DE_DIRECTCOPY_MIN_SIZE 65536
+
+// If inf is (a subfile of) an input file, and outf is (nested in) an output
+// file, try to have the OS copy the data directly from one file to the other.
+// Returns the number of bytes copied. This can be less than input_len,
+// including 0 if a direct copy is not possible.
+static i64 dbuf_copy_direct(dbuf *inf, i64 input_offset, i64 input_len, dbuf *outf)
+{
+	dbuf *ifile;
+	dbuf *ofile;
+	dbuf *f;
+	i64 inpos;
+	i64 outpos;
+	i64 n;
+
+	if(input_len < DE_DIRECTCOPY_MIN_SIZE) return 0;
+	if(input_offset<0 || input_offset+input_len > inf->len) return 0;
+
+	ifile = inf;
+	inpos = input_offset;
+	while(ifile->btype==DBUF_TYPE_IDBUF) {
+		inpos += ifile->offset_into_parent_dbuf;
+		ifile = ifile->parent_dbuf;
+	}
+	if(ifile->btype!=DBUF_TYPE_IFILE || !ifile->fp) return 0;
+	if(inpos<0 || inpos+input_len > ifile->len) return 0;
+
+	// We can't skip dbuf_write() if anything wants to see the data.
+	f = outf;
+	while(1) {
+		if(f->writelistener_cb || f->recursion_copy) return 0;
+		if(f->len + input_len > f->max_len_hard) return 0;
+		if(f->btype!=DBUF_TYPE_ODBUF) break;
+		f = f->parent_dbuf;
+	}
+	ofile = f;
+	if(ofile->btype!=DBUF_TYPE_OFILE || !ofile->fp) return 0;
+
+	fflush(ofile->fp);
+	outpos = de_ftell(ofile->fp);
+	if(outpos<0) return 0;
+	n = de_copy_file_range(ifile->fp, inpos, ofile->fp, outpos, input_len);
+	if(n<=0) return 0;
+	de_fseek(ofile->fp, outpos+n, SEEK_SET);
+
+	if(outf->c->debug_level>=3) {
+		de_dbg3(outf->c, "copied %"I64_FMT" bytes directly to %s", n, ofile->name);
+	}
+
+	f = outf;
+	while(1) {
+		f->len += n;
+		if(f->btype!=DBUF_TYPE_ODBUF) break;
+		f = f->parent_dbuf;
+	}
+	return n;
+}
+
+// Copy from a DBUF_TYPE_EXTENTS dbuf, one extent at a time, so that the
+// fast paths can apply to each one.
+static void extents_copy(dbuf *inf, i64 input_offset, i64 input_len, dbuf *outf)
+{
+	i64 idx;
+
+	idx = find_extent(inf, input_offset);
+	while(input_len>0 && idx<inf->num_extents) {
+		const struct de_dbuf_extent *ext = &inf->extents[idx];
+		i64 offset_in_ext = input_offset - ext->vpos;
+		i64 n;
+
+		n = de_min_int(ext->len - offset_in_ext, input_len);
+		dbuf_copy(inf->parent_dbuf, ext->ppos + offset_in_ext, n, outf);
+		input_offset += n;
+		input_len -= n;
+		idx++;
+	}
+}
+
 void dbuf_copy(dbuf *inf, i64 input_offset, i64 input_len, dbuf *outf)
 {
 	u8 tmpbuf[256];
+	i64 n;
+
+	if(inf->btype==DBUF_TYPE_EXTENTS && input_len>0 &&
+		input_offset>=0 && input_offset+input_len<=inf->len)
+	{
+		extents_copy(inf, input_offset, input_len, outf);
+		return;
+	}
+
+	n = dbuf_copy_direct(inf, input_offset, input_len, outf);
+	if(n>0) {
+		input_offset += n;
+		input_len -= n;
+		if(input_len<=0) return;
+	}
 
 	// Fast paths, if the data to copy is all in memory
 
+	cache_extend(inf, input_offset+input_len);
 	if(inf->cache &&
 		(input_offset>=0) && (input_offset+input_len<=inf->cache_bytes_used))
 	{
@@ -1017,7 +1368,7 @@ static dbuf *create_dbuf_lowlevel(deark *c)
 {
 	dbuf *f;
 
-	f = de_malloc(c, sizeof(dbuf));
+	f = de_malloc_tagged(c, sizeof(dbuf), DE_ALLOCTAG_DBUF);
 	f->c = c;
 	f->cache2_pos = -1; // Any offset outside the bounds of the file will do.
 	return f;
@@ -1087,6 +1438,57 @@ static void sanitize_ext(const char *ext1, char *ext, size_t extlen)
 	}
 }
 
+static void output_callback_write_cb(dbuf *f, void *userdata,
+	const u8 *buf, i64 buf_len)
+{
+	if(f->c->output_write_fn) {
+		f->c->output_write_fn(f->c, f->c->output_cb_userdata, userdata, buf, buf_len);
+	}
+}
+
+// Start a file for DE_OUTPUTSTYLE_CALLBACK. f->name and f->fi_copy must
+// already be set.
+static void start_output_callback_file(deark *c, dbuf *f, int file_index,
+	u8 is_directory)
+{
+	struct de_output_file_info ofi;
+
+	if(!c->output_open_fn) {
+		de_err(c, "Internal: Output callbacks not set");
+		f->btype = DBUF_TYPE_NULL;
+		c->serious_error_flag = 1;
+		return;
+	}
+
+	de_zeromem(&ofi, sizeof(struct de_output_file_info));
+	ofi.name = f->name;
+	ofi.file_id = file_index;
+	ofi.is_directory = is_directory;
+	ofi.is_executable = -1;
+	if(f->fi_copy) {
+		const struct de_timestamp *ts;
+
+		if(f->fi_copy->mode_flags&DE_MODEFLAG_EXE) {
+			ofi.is_executable = 1;
+		}
+		else if(f->fi_copy->mode_flags&DE_MODEFLAG_NONEXE) {
+			ofi.is_executable = 0;
+		}
+
+		ts = &f->fi_copy->timestamp[DE_TIMESTAMPIDX_MODIFY];
+		if(c->preserve_file_times && ts->is_valid) {
+			ofi.mod_time_valid = 1;
+			ofi.mod_time = de_timestamp_to_unix_time(ts);
+			ofi.mod_time_subsec = de_timestamp_get_subsec(ts);
+		}
+	}
+
+	f->btype = DBUF_TYPE_CUSTOM;
+	f->writing_to_output_callback = 1;
+	f->userdata_for_customwrite = c->output_open_fn(c, c->output_cb_userdata, &ofi);
+	f->customwrite_fn = output_callback_write_cb;
+}
+
 dbuf *dbuf_create_output_file(deark *c, const char *ext1, de_finfo *fi,
 	unsigned int createflags)
 {
@@ -1100,6 +1502,9 @@ dbuf *dbuf_create_output_file(deark *c, const char *ext1, de_finfo *fi,
 	u8 is_directory = 0;
 	char *name_from_finfo = NULL;
 	i64 name_from_finfo_len = 0;
+	// Callback output uses the same naming rules as archive output.
+	int archive_style_names = (c->output_style==DE_OUTPUTSTYLE_ARCHIVE ||
+		c->output_style==DE_OUTPUTSTYLE_CALLBACK);
 
 	if(ext1) {
 		have_ext = 1;
@@ -1155,13 +1560,13 @@ dbuf *dbuf_create_output_file(deark *c, const char *ext1, de_finfo *fi,
 			DE_ENCODING_UTF8);
 	}
 
-	if(c->output_style==DE_OUTPUTSTYLE_ARCHIVE && !c->base_output_filename &&
+	if(archive_style_names && !c->base_output_filename &&
 		fi && fi->is_directory &&
 		(fi->is_root_dir || (fi->detect_root_dot_dir && fi->orig_name_was_dot)))
 	{
 		de_strlcpy(nbuf, ".", sizeof(nbuf));
 	}
-	else if(c->output_style==DE_OUTPUTSTYLE_ARCHIVE && !c->base_output_filename &&
+	else if(archive_style_names && !c->base_output_filename &&
 		fi && fi->original_filename_flag && name_from_finfo)
 	{
 		// TODO: This is a "temporary" hack to allow us to, when both reading from
@@ -1260,21 +1665,10 @@ dbuf *dbuf_create_output_file(deark *c, const char *ext1, de_finfo *fi,
 		de_tar_start_member_file(c, f);
 	}
 	else if(c->output_style==DE_OUTPUTSTYLE_ARCHIVE) { // ZIP
-		i64 initial_alloc;
 		de_info(c, "Adding %s to ZIP file", f->name);
-		f->btype = DBUF_TYPE_MEMBUF;
-		f->max_len_hard = DE_MAX_MEMBUF_SIZE;
-		if(is_directory) {
-			// A directory entry is not expected to have any data associated
-			// with it (besides the files it contains).
-			initial_alloc = 16;
-		}
-		else {
-			initial_alloc = 65536;
-		}
-		f->membuf_buf = de_malloc(c, initial_alloc);
-		f->membuf_alloc = initial_alloc;
-		f->write_memfile_to_zip_archive = 1;
+		f->btype = DBUF_TYPE_CUSTOM;
+		f->writing_to_zip_archive = 1;
+		de_zip_start_member_file(c, f);
 	}
 	else if(c->output_style==DE_OUTPUTSTYLE_STDOUT) {
 		de_info(c, "Writing %s to [stdout]", f->name);
@@ -1282,6 +1676,10 @@ dbuf *dbuf_create_output_file(deark *c, const char *ext1, de_finfo *fi,
 		// TODO: Should we increase f->max_len_hard?
 		f->fp = stdout;
 	}
+	else if(c->output_style==DE_OUTPUTSTYLE_CALLBACK) {
+		de_info(c, "Writing %s to [callback]", f->name);
+		start_output_callback_file(c, f, file_index, is_directory);
+	}
 	else {
 		de_info(c, "Writing %s", f->name);
 		f->btype = DBUF_TYPE_OFILE;
@@ -1295,6 +1693,14 @@ dbuf *dbuf_create_output_file(deark *c, const char *ext1, de_finfo *fi,
 		}
 	}
 
+	if(c->recurse_max_depth>0 && c->recurse_depth<c->recurse_max_depth &&
+		!(createflags&DE_CREATEFLAG_NORECURSE) && f->btype!=DBUF_TYPE_NULL && f->btype!=DBUF_TYPE_STDOUT && !is_directory)
+	{
+		// Keep a copy of the file's contents, so that we can look for files
+		// inside it, without having to read it back.
+		f->recursion_copy = dbuf_create_membuf(c, 0, 0);
+	}
+
 done:
 	de_free(c, name_from_finfo);
 	return f;
@@ -1361,6 +1767,22 @@ static void membuf_append(dbuf *f, const u8 *m, i64 mlen)
 	f->len += mlen;
 }
 
+static void recursion_copy_write(dbuf *f, const u8 *m, i64 len)
+{
+	deark *c = f->c;
+
+	if(c->recurse_mem_used + len > c->recurse_max_mem) {
+		de_dbg(c, "%s is too large to recurse into", f->name);
+		c->recurse_mem_used -= f->recursion_copy->len;
+		dbuf_close(f->recursion_copy);
+		f->recursion_copy = NULL;
+		return;
+	}
+
+	dbuf_write(f->recursion_copy, m, len);
+	c->recurse_mem_used += len;
+}
+
 void dbuf_write(dbuf *f, const u8 *m, i64 len)
 {
 	if(len<=0) return;
@@ -1374,6 +1796,10 @@ void dbuf_write(dbuf *f, const u8 *m, i64 len)
 		f->writelistener_cb(f, f->userdata_for_writelistener, m, len);
 	}
 
+	if(f->recursion_copy) {
+		recursion_copy_write(f, m, len);
+	}
+
 	switch(f->btype) {
 	case DBUF_TYPE_OFILE:
 	case DBUF_TYPE_STDOUT:
@@ -1691,6 +2117,21 @@ dbuf *dbuf_open_input_file(deark *c, const char *fn)
 		populate_cache(f);
 	}
 
+	if(f->btype==DBUF_TYPE_IFILE && !f->cache_is_mapped && !wants_minimal_reads(c) &&
+		f->len > de_max_int(f->cache_bytes_used, f->cache_fill_limit))
+	{
+		const char *s_opt;
+		i64 maxmem = DE_PAGECACHE_DEFAULT_MAXMEM;
+
+		s_opt = de_get_ext_option(c, "readcache");
+		if(s_opt) {
+			maxmem = de_atoi64(s_opt);
+		}
+		if(maxmem>0) {
+			f->pagecache = pagecache_create(c, maxmem);
+		}
+	}
+
 	return f;
 }
 
@@ -1723,6 +2164,56 @@ dbuf *dbuf_open_input_subfile(dbuf *parent, i64 offset, i64 size)
 	return f;
 }
 
+// Create a read-only dbuf that presents a list of extents (segments) of the
+// parent dbuf as a single contiguous file. Nothing is copied.
+// The dbuf starts out empty. Use dbuf_add_extent() to add the extents, in
+// order. The parent must remain open, and unchanged, while f is in use.
+dbuf *dbuf_open_input_extents(dbuf *parent)
+{
+	dbuf *f;
+
+	f = create_dbuf_lowlevel(parent->c);
+	f->btype = DBUF_TYPE_EXTENTS;
+	f->parent_dbuf = parent;
+	return f;
+}
+
+// Append the 'len' bytes at 'offset' in the parent dbuf to the end of f.
+// The extent need not be within the bounds of the parent. If it isn't,
+// reading the missing bytes will return zeroes, as usual.
+void dbuf_add_extent(dbuf *f, i64 offset, i64 len)
+{
+	struct de_dbuf_extent *ext;
+
+	if(f->btype!=DBUF_TYPE_EXTENTS) return;
+	if(len<=0) return;
+
+	if(f->num_extents>0) {
+		ext = &f->extents[f->num_extents-1];
+		if(offset == ext->ppos + ext->len) {
+			// Merge with the previous extent
+			ext->len += len;
+			f->len += len;
+			return;
+		}
+	}
+
+	if(f->num_extents >= f->extents_alloc) {
+		i64 new_alloc;
+
+		new_alloc = (f->extents_alloc<8) ? 8 : f->extents_alloc*2;
+		f->extents = de_reallocarray(f->c, f->extents, f->extents_alloc,
+			sizeof(struct de_dbuf_extent), new_alloc);
+		f->extents_alloc = new_alloc;
+	}
+
+	ext = &f->extents[f->num_extents++];
+	ext->vpos = f->len;
+	ext->ppos = offset;
+	ext->len = len;
+	f->len += len;
+}
+
 dbuf *dbuf_create_custom_dbuf(deark *c, i64 apparent_size, unsigned int flags)
 {
 	dbuf *f;
@@ -1740,20 +2231,74 @@ void dbuf_set_writelistener(dbuf *f, de_writelistener_cb_type fn, void *userdata
 	f->writelistener_cb = fn;
 }
 
+// Returns 0 if nothing written to f will be kept (e.g. due to -l or -get), so
+// the caller can skip any expensive work, like decompression, that would
+// produce the data. Always returns 1 if "-opt verify" was used.
+// This is intended to be called right after dbuf_create_output_file().
+int dbuf_output_is_wanted(dbuf *f)
+{
+	if(!f) return 0;
+	if(f->btype!=DBUF_TYPE_NULL) return 1;
+	if(f->c->verify_mode) return 1;
+	return 0;
+}
+
+// Used after a fatal error, to close the file that f uses (if any), without
+// doing any of the usual processing. (void* is for
+// de_foreach_tagged_allocation().)
+void dbuf_release_os_resources(deark *c, void *m)
+{
+	dbuf *f = (dbuf*)m;
+
+	switch(f->btype) {
+	case DBUF_TYPE_IFILE:
+	case DBUF_TYPE_OFILE:
+	case DBUF_TYPE_FIFO:
+		if(f->fp) {
+			de_fclose(f->fp);
+			f->fp = NULL;
+		}
+		break;
+	case DBUF_TYPE_STDOUT:
+		if(f->fp) {
+			fflush(f->fp);
+		}
+		break;
+	}
+
+	if(f->cache_is_mapped) {
+		de_munmap_file(f->cache, f->cache_bytes_used);
+		f->cache = NULL;
+		f->cache_bytes_used = 0;
+		f->cache_is_mapped = 0;
+	}
+}
+
 void dbuf_close(dbuf *f)
 {
 	deark *c;
 	if(!f) return;
 	c = f->c;
 
-	if(f->btype==DBUF_TYPE_OFILE || f->btype==DBUF_TYPE_STDOUT) {
+	if(f->btype==DBUF_TYPE_OFILE || f->btype==DBUF_TYPE_STDOUT ||
+		f->writing_to_output_callback)
+	{
 		c->total_output_size += f->len;
 	}
 
-	if(f->btype==DBUF_TYPE_MEMBUF && f->write_memfile_to_zip_archive) {
-		de_zip_add_file_to_archive(c, f);
+	if(f->writing_to_output_callback) {
+		if(c->output_close_fn) {
+			c->output_close_fn(c, c->output_cb_userdata, f->userdata_for_customwrite,
+				f->len);
+		}
+		f->userdata_for_customwrite = NULL;
+		f->customwrite_fn = NULL;
+		f->writing_to_output_callback = 0;
+	}
+	else if(f->writing_to_zip_archive) {
+		de_zip_end_member_file(c, f);
 		if(f->name) {
-			de_dbg3(c, "closing memfile %s", f->name);
+			de_dbg3(c, "closing zip member %s", f->name);
 		}
 	}
 	else if(f->writing_to_tar_archive) {
@@ -1793,13 +2338,31 @@ void dbuf_close(dbuf *f)
 	case DBUF_TYPE_CUSTOM:
 	case DBUF_TYPE_NULL:
 		break;
+	case DBUF_TYPE_EXTENTS:
+		de_free(c, f->extents);
+		f->extents = NULL;
+		break;
 	default:
 		de_err(c, "Internal: Don't know how to close this type of file (%d)", f->btype);
 	}
 
+	if(f->recursion_copy) {
+		dbuf *rcopy = f->recursion_copy;
+
+		// Now that the file is complete, look for files inside it.
+		f->recursion_copy = NULL;
+		de_recurse_into_file(c, rcopy, f->name);
+	}
+
 	de_free(c, f->membuf_buf);
 	de_free(c, f->name);
-	de_free(c, f->cache);
+	pagecache_destroy(c, f->pagecache);
+	if(f->cache_is_mapped) {
+		de_munmap_file(f->cache, f->cache_bytes_used);
+	}
+	else {
+		de_free(c, f->cache);
+	}
 	if(f->fi_copy) de_finfo_destroy(c, f->fi_copy);
 	de_free(c, f);
 
@@ -2217,6 +2780,7 @@ int dbuf_buffered_read(dbuf *f, i64 pos1, i64 len,
 	}
 
 	// Use an optimized routine if all the data we need to read is already in memory.
+	cache_extend(f, pos1+len);
 	if(f->cache && (pos1>=0) && (pos1+len<=f->cache_bytes_used)) {
 		return buffered_read_from_mem(&brctx, f, f->cache, pos1, len, cbfn);
 	}
@@ -2288,6 +2852,95 @@ void de_bitbuf_lowelevel_empty(struct de_bitbuf_lowlevel *bbll)
 	bbll->nbits_in_bitbuf = 0;
 }
 
+// If the bytes of f starting at pos are available in contiguous memory, returns
+// a pointer to them, and sets *pnbytes_avail to the number of such bytes.
+// Otherwise returns NULL.
+// The pointer is only valid until the next time f is modified.
+static const u8 *dbuf_get_contiguous_data(dbuf *f, i64 pos, i64 *pnbytes_avail)
+{
+	const u8 *ptr;
+
+	if(pos<0 || pos>=f->len) return NULL;
+
+	cache_extend(f, pos+1);
+	if(f->cache && pos<f->cache_bytes_used) {
+		*pnbytes_avail = f->cache_bytes_used - pos;
+		return &f->cache[pos];
+	}
+
+	switch(f->btype) {
+	case DBUF_TYPE_MEMBUF:
+		*pnbytes_avail = f->len - pos;
+		return &f->membuf_buf[pos];
+	case DBUF_TYPE_IDBUF:
+		ptr = dbuf_get_contiguous_data(f->parent_dbuf, f->offset_into_parent_dbuf+pos,
+			pnbytes_avail);
+		if(ptr && *pnbytes_avail > f->len - pos) {
+			*pnbytes_avail = f->len - pos;
+		}
+		return ptr;
+	case DBUF_TYPE_EXTENTS:
+		{
+			i64 idx = find_extent(f, pos);
+			const struct de_dbuf_extent *ext = &f->extents[idx];
+
+			f->last_extent_idx = idx;
+			ptr = dbuf_get_contiguous_data(f->parent_dbuf, ext->ppos + (pos - ext->vpos),
+				pnbytes_avail);
+			if(ptr && *pnbytes_avail > ext->vpos + ext->len - pos) {
+				*pnbytes_avail = ext->vpos + ext->len - pos;
+			}
+			return ptr;
+		}
+	}
+	return NULL;
+}
+
+// Add as many whole bytes to the bit buffer as will fit (or as remain).
+static void bitreader_refill(struct de_bitreader *bitrd)
+{
+	struct de_bitbuf_lowlevel *bbll = &bitrd->bbll;
+	i64 nbytes_avail;
+	UI nbytes;
+	UI k;
+	u64 w = 0;
+	const u8 *ptr;
+	u8 tmpbuf[8];
+
+	if(bbll->nbits_in_bitbuf>56) return;
+	nbytes = (64 - bbll->nbits_in_bitbuf)/8;
+	if((i64)nbytes > bitrd->endpos - bitrd->curpos) {
+		if(bitrd->curpos >= bitrd->endpos) return;
+		nbytes = (UI)(bitrd->endpos - bitrd->curpos);
+	}
+
+	ptr = dbuf_get_contiguous_data(bitrd->f, bitrd->curpos, &nbytes_avail);
+	if(!ptr || nbytes_avail<(i64)nbytes) {
+		dbuf_read(bitrd->f, tmpbuf, bitrd->curpos, (i64)nbytes);
+		ptr = tmpbuf;
+	}
+
+	if(bbll->is_lsb==0) {
+		for(k=0; k<nbytes; k++) {
+			w = (w<<8) | ptr[k];
+		}
+		if(nbytes>=8) {
+			bbll->bit_buf = w;
+		}
+		else {
+			bbll->bit_buf = (bbll->bit_buf<<(8*nbytes)) | w;
+		}
+	}
+	else {
+		for(k=0; k<nbytes; k++) {
+			w |= (u64)ptr[k] << (8*k);
+		}
+		bbll->bit_buf |= w << bbll->nbits_in_bitbuf;
+	}
+	bbll->nbits_in_bitbuf += 8*nbytes;
+	bitrd->curpos += (i64)nbytes;
+}
+
 u64 de_bitreader_getbits(struct de_bitreader *bitrd, UI nbits)
 {
 	if(bitrd->eof_flag) return 0;
@@ -2301,20 +2954,64 @@ u64 de_bitreader_getbits(struct de_bitreader *bitrd, UI nbits)
 		return 0;
 	}
 
-	while(bitrd->bbll.nbits_in_bitbuf < nbits) {
-		u8 b;
-
-		if(bitrd->curpos >= bitrd->endpos) {
+	if(bitrd->bbll.nbits_in_bitbuf < nbits) {
+		bitreader_refill(bitrd);
+		if(bitrd->bbll.nbits_in_bitbuf < nbits) {
 			bitrd->eof_flag = 1;
 			return 0;
 		}
-		b = dbuf_getbyte_p(bitrd->f, &bitrd->curpos);
-		de_bitbuf_lowelevel_add_byte(&bitrd->bbll, b);
 	}
 
 	return de_bitbuf_lowelevel_get_bits(&bitrd->bbll, nbits);
 }
 
+// Look at the next nbits bits, without consuming them.
+// Returns 0 if there are not that many bits left (this does not set eof_flag).
+// In *pval, the bits are in the same order that de_bitreader_getbits() would
+// return them.
+// After a successful call, it is safe to consume up to nbits bits using
+// de_bitreader_skipbits().
+int de_bitreader_peekbits(struct de_bitreader *bitrd, UI nbits, u64 *pval)
+{
+	struct de_bitbuf_lowlevel *bbll = &bitrd->bbll;
+
+	*pval = 0;
+	if(bitrd->eof_flag) return 0;
+	if(nbits==0) return 1;
+	if(nbits > 57) return 0;
+
+	if(bbll->nbits_in_bitbuf < nbits) {
+		bitreader_refill(bitrd);
+		if(bbll->nbits_in_bitbuf < nbits) return 0;
+	}
+
+	if(bbll->is_lsb==0) {
+		*pval = (bbll->bit_buf >> (bbll->nbits_in_bitbuf - nbits)) & (((u64)1 << nbits)-1);
+	}
+	else {
+		*pval = bbll->bit_buf & (((u64)1 << nbits)-1);
+	}
+	return 1;
+}
+
+// Consume nbits bits (usually bits that have been examined using
+// de_bitreader_peekbits()).
+void de_bitreader_skipbits(struct de_bitreader *bitrd, UI nbits)
+{
+	if(nbits <= bitrd->bbll.nbits_in_bitbuf) {
+		(void)de_bitbuf_lowelevel_get_bits(&bitrd->bbll, nbits);
+		return;
+	}
+	(void)de_bitreader_getbits(bitrd, nbits);
+}
+
+// Returns the position of the next byte that has not been (fully or partially)
+// consumed. Bytes that are only in the bit buffer are not counted as consumed.
+i64 de_bitreader_get_curpos(struct de_bitreader *bitrd)
+{
+	return bitrd->curpos - (i64)(bitrd->bbll.nbits_in_bitbuf / 8);
+}
+
 char *de_bitreader_describe_curpos(struct de_bitreader *bitrd, char *buf, size_t buf_len)
 {
 	i64 curpos;
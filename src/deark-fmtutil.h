@@ -11,11 +11,16 @@ struct de_dfilter_in_params {
 struct de_dfilter_out_params {
 	dbuf *f;
 	u8 len_known;
+	// If set, the decompressor does nothing (and sets dres->output_skipped)
+	// if nothing written to f would be kept. See dbuf_output_is_wanted().
+	// Only set this if the caller doesn't need dres->bytes_consumed.
+	u8 skip_if_unwanted;
 	i64 expected_len;
 };
 
 struct de_dfilter_results {
 	int errcode;
+	u8 output_skipped;
 	u8 bytes_consumed_valid;
 	i64 bytes_consumed;
 	char errmsg[80];
@@ -486,6 +491,10 @@ const char *de_dfilter_get_errmsg(deark *c, struct de_dfilter_results *dres);
 void de_dfilter_results_clear(deark *c, struct de_dfilter_results *dres);
 void de_dfilter_init_objects(deark *c, struct de_dfilter_in_params *dcmpri,
 	struct de_dfilter_out_params *dcmpro, struct de_dfilter_results *dres);
+int de_dfilter_skip_unwanted_output(deark *c, struct de_dfilter_out_params *dcmpro,
+	struct de_dfilter_results *dres);
+int de_dfilter_write_to_output(struct de_dfilter_out_params *dcmpro,
+	i64 *pnbytes_written, const u8 *buf, i64 buf_len);
 
 struct de_riscos_file_attrs {
 	u8 file_type_known;
@@ -552,11 +561,14 @@ int fmtutil_huffman_record_a_code_length(deark *c, struct fmtutil_huffman_tree *
 int fmtutil_huffman_make_canonical_tree(deark *c, struct fmtutil_huffman_tree *ht);
 
 struct de_lz77buffer;
-typedef void (*fmtutil_lz77buffer_cb_type)(struct de_lz77buffer *rb, u8 n);
+typedef void (*fmtutil_lz77buffer_bulk_cb_type)(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len);
 
 struct de_lz77buffer {
 	void *userdata;
-	fmtutil_lz77buffer_cb_type writebyte_cb;
+	// Each match is copied in blocks, and output in (usually) one or two calls.
+	// Decompressors usually just call de_dfilter_write_to_output() from this.
+	fmtutil_lz77buffer_bulk_cb_type writebytes_cb;
 	UI curpos; // Must be kept valid at all times (0...bufsize-1)
 	UI mask;
 	UI bufsize; // Required to be a power of 2
@@ -16,16 +16,33 @@
 #define CODE_IDAT 0x49444154U
 #define CODE_IEND 0x49454e44U
 #define CODE_IHDR 0x49484452U
+#define CODE_PLTE 0x504c5445U
 #define CODE_htSP 0x68745350U
 #define CODE_pHYs 0x70485973U
 #define CODE_tEXt 0x74455874U
 #define CODE_tIME 0x74494d45U
+#define CODE_tRNS 0x74524e53U
+
+// Compressed image data is written in IDAT chunks of (up to) this size, as
+// soon as it is available.
+#define PNG_IDAT_CHUNK_SIZE 65536
+
+#define PNG_FILTER_NONE  0
+#define PNG_FILTER_SUB   1
+#define PNG_FILTER_UP    2
+#define PNG_FILTER_AVG   3
+#define PNG_FILTER_PAETH 4
 
 struct deark_png_encode_info {
 	deark *c;
 	dbuf *outf;
 	int width, height;
-	int num_chans;
+	int num_chans; // 1-4, or 1 for paletted images
+	int bit_depth;
+	i64 rowspan; // Bytes per row, in the pixels to be filtered
+	int filter_bpp; // Bytes per complete pixel, or 1 if less than a byte
+	const de_color *pal; // Set for paletted images
+	int num_pal_entries;
 	int flip;
 	unsigned int level;
 	int has_phys;
@@ -37,8 +54,27 @@ struct deark_png_encode_info {
 	u8 has_hotspot;
 	int hotspot_x, hotspot_y;
 	struct de_crcobj *crco;
+	u8 *idat_buf; // Compressed data not yet written, up to PNG_IDAT_CHUNK_SIZE
+	i64 idat_buf_used;
 };
 
+static void write_png_chunk_from_mem(struct deark_png_encode_info *pei,
+	const u8 *data, i64 len, u32 chunktype)
+{
+	u32 crc;
+	u8 buf[4];
+
+	de_crcobj_reset(pei->crco);
+	dbuf_writeu32be(pei->outf, len);
+	de_writeu32be_direct(buf, (i64)chunktype);
+	de_crcobj_addbuf(pei->crco, buf, 4);
+	dbuf_write(pei->outf, buf, 4);
+	de_crcobj_addbuf(pei->crco, data, len);
+	dbuf_write(pei->outf, data, len);
+	crc = de_crcobj_getval(pei->crco);
+	dbuf_writeu32be(pei->outf, (i64)crc);
+}
+
 static void write_png_chunk_from_cdbuf(struct deark_png_encode_info *pei,
 	dbuf *cdbuf, u32 chunktype)
 {
@@ -71,12 +107,43 @@ static void write_png_chunk_IHDR(struct deark_png_encode_info *pei,
 
 	dbuf_writeu32be(cdbuf, (i64)pei->width);
 	dbuf_writeu32be(cdbuf, (i64)pei->height);
-	dbuf_writebyte(cdbuf, 8); // bit depth
-	dbuf_writebyte(cdbuf, color_type_code[pei->num_chans]);
+	dbuf_writebyte(cdbuf, (u8)pei->bit_depth);
+	dbuf_writebyte(cdbuf, pei->pal ? 0x03 : color_type_code[pei->num_chans]);
 	dbuf_truncate(cdbuf, 13); // rest of chunk is zeroes
 	write_png_chunk_from_cdbuf(pei, cdbuf, CODE_IHDR);
 }
 
+static void write_png_chunk_PLTE(struct deark_png_encode_info *pei,
+	dbuf *cdbuf)
+{
+	int k;
+
+	for(k=0; k<pei->num_pal_entries; k++) {
+		dbuf_writebyte(cdbuf, DE_COLOR_R(pei->pal[k]));
+		dbuf_writebyte(cdbuf, DE_COLOR_G(pei->pal[k]));
+		dbuf_writebyte(cdbuf, DE_COLOR_B(pei->pal[k]));
+	}
+	write_png_chunk_from_cdbuf(pei, cdbuf, CODE_PLTE);
+}
+
+// Only the palette entries up to the last non-opaque one are written.
+static void write_png_chunk_tRNS(struct deark_png_encode_info *pei,
+	dbuf *cdbuf)
+{
+	int k;
+	int num_trns_entries = 0;
+
+	for(k=0; k<pei->num_pal_entries; k++) {
+		if(DE_COLOR_A(pei->pal[k])<255) num_trns_entries = k+1;
+	}
+	if(num_trns_entries<1) return;
+
+	for(k=0; k<num_trns_entries; k++) {
+		dbuf_writebyte(cdbuf, DE_COLOR_A(pei->pal[k]));
+	}
+	write_png_chunk_from_cdbuf(pei, cdbuf, CODE_tRNS);
+}
+
 static void write_png_chunk_pHYs(struct deark_png_encode_info *pei,
 	dbuf *cdbuf)
 {
@@ -128,38 +195,359 @@ static void write_png_chunk_tEXt(struct deark_png_encode_info *pei,
 	write_png_chunk_from_cdbuf(pei, cdbuf, CODE_tEXt);
 }
 
-static int write_png_chunk_IDAT(struct deark_png_encode_info *pei, dbuf *cdbuf,
-	const u8 *src_pixels)
+static void flush_idat_buf(struct deark_png_encode_info *pei)
 {
-	int bpl = pei->width * pei->num_chans; // bytes per row in src_pixels
-	int y;
-	static const char nulbyte = '\0';
-	int retval = 0;
+	if(pei->idat_buf_used<1) return;
+	write_png_chunk_from_mem(pei, pei->idat_buf, pei->idat_buf_used, CODE_IDAT);
+	pei->idat_buf_used = 0;
+}
+
+// Receives the output of the deflate encoder.
+static void idat_customwrite_cb(dbuf *f, void *userdata, const u8 *buf, i64 buf_len)
+{
+	struct deark_png_encode_info *pei = (struct deark_png_encode_info*)userdata;
+
+	while(buf_len>0) {
+		i64 n;
+
+		n = de_min_int(buf_len, PNG_IDAT_CHUNK_SIZE - pei->idat_buf_used);
+		de_memcpy(&pei->idat_buf[pei->idat_buf_used], buf, (size_t)n);
+		pei->idat_buf_used += n;
+		buf += n;
+		buf_len -= n;
+		if(pei->idat_buf_used >= PNG_IDAT_CHUNK_SIZE) {
+			flush_idat_buf(pei);
+		}
+	}
+}
+
+static u8 paeth_predictor(u8 a, u8 b, u8 c)
+{
+	int p, pa, pb, pc;
+
+	p = (int)a + (int)b - (int)c;
+	pa = p - (int)a;
+	pb = p - (int)b;
+	pc = p - (int)c;
+	if(pa<0) pa = -pa;
+	if(pb<0) pb = -pb;
+	if(pc<0) pc = -pc;
+	if(pa<=pb && pa<=pc) return a;
+	if(pb<=pc) return b;
+	return c;
+}
+
+// Apply PNG filter ftype to the row cur (whose predecessor is prev), writing
+// rowlen bytes to dst. bpp = bytes per pixel.
+// The loops are kept simple, so that compilers can vectorize them.
+static void png_filter_row(int ftype, int bpp, const u8 *cur, const u8 *prev,
+	u8 *dst, int rowlen)
+{
+	int i;
+
+	switch(ftype) {
+	case PNG_FILTER_SUB:
+		for(i=0; i<bpp; i++) {
+			dst[i] = cur[i];
+		}
+		for(i=bpp; i<rowlen; i++) {
+			dst[i] = (u8)(cur[i] - cur[i-bpp]);
+		}
+		break;
+	case PNG_FILTER_UP:
+		for(i=0; i<rowlen; i++) {
+			dst[i] = (u8)(cur[i] - prev[i]);
+		}
+		break;
+	case PNG_FILTER_AVG:
+		for(i=0; i<bpp; i++) {
+			dst[i] = (u8)(cur[i] - (prev[i]>>1));
+		}
+		for(i=bpp; i<rowlen; i++) {
+			dst[i] = (u8)(cur[i] - (u8)(((UI)cur[i-bpp] + (UI)prev[i])>>1));
+		}
+		break;
+	case PNG_FILTER_PAETH:
+		for(i=0; i<bpp; i++) {
+			dst[i] = (u8)(cur[i] - prev[i]);
+		}
+		for(i=bpp; i<rowlen; i++) {
+			dst[i] = (u8)(cur[i] - paeth_predictor(cur[i-bpp], prev[i], prev[i-bpp]));
+		}
+		break;
+	default:
+		de_memcpy(dst, cur, (size_t)rowlen);
+	}
+}
+
+// The "minimum sum of absolute differences" heuristic. Filtered bytes are
+// treated as signed.
+static UI png_filter_cost(const u8 *dst, int rowlen)
+{
+	int i;
+	UI cost = 0;
+
+	for(i=0; i<rowlen; i++) {
+		cost += (dst[i]<128) ? (UI)dst[i] : (UI)(256-dst[i]);
+	}
+	return cost;
+}
+
+// A range of rows that is filtered and compressed independently of the other
+// ranges, possibly in a worker thread. Each segment except the last ends with
+// a sync flush, so the segments can simply be concatenated.
+struct png_segment {
+	struct deark_png_encode_info *pei;
+	const u8 *src_pixels;
+	int y0, y1; // The rows, in output order
+	u8 is_first, is_last;
+	u8 errflag;
+	dbuf *cmpr_data;
+	u32 adler; // Adler-32 of the filtered data
+	struct de_workerpool_job *job;
+};
+
+#define ADLER32_BASE 65521U
+
+static u32 adler32_update(u32 adler, const u8 *buf, size_t len)
+{
+	u32 s1 = adler & 0xffff;
+	u32 s2 = adler >> 16;
+
+	while(len>0) {
+		// 5552 is the most bytes we can process before s2 could overflow.
+		size_t n = (len<5552) ? len : 5552;
+		size_t i;
+
+		for(i=0; i<n; i++) {
+			s1 += buf[i];
+			s2 += s1;
+		}
+		s1 %= ADLER32_BASE;
+		s2 %= ADLER32_BASE;
+		buf += n;
+		len -= n;
+	}
+	return (s2<<16) | s1;
+}
+
+// Returns the Adler-32 of the concatenation of two byte sequences, given
+// their individual Adler-32 values, and the length of the second one.
+static u32 adler32_combine(u32 adler1, u32 adler2, i64 len2)
+{
+	u32 rem = (u32)(len2 % ADLER32_BASE);
+	u32 s1, s2;
+
+	s1 = adler1 & 0xffff;
+	s2 = (u32)(((u64)rem * s1) % ADLER32_BASE);
+	s1 += (adler2 & 0xffff) + ADLER32_BASE - 1;
+	s2 += (adler1 >> 16) + (adler2 >> 16) + ADLER32_BASE - rem;
+	if(s1 >= ADLER32_BASE) s1 -= ADLER32_BASE;
+	if(s1 >= ADLER32_BASE) s1 -= ADLER32_BASE;
+	if(s2 >= 2*ADLER32_BASE) s2 -= 2*ADLER32_BASE;
+	if(s2 >= ADLER32_BASE) s2 -= ADLER32_BASE;
+	return (s2<<16) | s1;
+}
+
+// This may run in a worker thread, so it must not print anything, or touch
+// anything but seg (pei is only read).
+static void png_compress_segment(struct png_segment *seg)
+{
+	struct deark_png_encode_info *pei = seg->pei;
 	deark *c = pei->c;
+	int bpl = (int)pei->rowspan; // bytes per row in src_pixels
+	int y;
+	int ftype;
+	int use_filters;
+	int tdflags;
 	struct fmtutil_tdefl_ctx *tdctx = NULL;
+	u8 *zerorow = NULL;
+	u8 *rowbuf1 = NULL;
+	u8 *rowbuf2 = NULL;
+	const u8 *prevrow;
+	enum fmtutil_tdefl_status ret;
 	static const unsigned int my_s_tdefl_num_probes[11] = { 0, 1, 6, 32,  16, 32, 128, 256,  512, 768, 1500 };
 
-	// compress image data
-	tdctx = fmtutil_tdefl_create(c, cdbuf,
-		my_s_tdefl_num_probes[MY_MZ_MIN(10, pei->level)] | MY_TDEFL_WRITE_ZLIB_HEADER);
+#define PNG_SRC_ROW(y) (&seg->src_pixels[(pei->flip ? (pei->height - 1 - (y)) : (y)) * bpl])
 
-	for (y = 0; y < pei->height; ++y) {
-		fmtutil_tdefl_compress_buffer(tdctx, &nulbyte, 1, FMTUTIL_TDEFL_NO_FLUSH);
-		fmtutil_tdefl_compress_buffer(tdctx, &src_pixels[(pei->flip ? (pei->height - 1 - y) : y) * bpl],
-			bpl, FMTUTIL_TDEFL_NO_FLUSH);
+	seg->cmpr_data = dbuf_create_membuf(c, 0, 0);
+	seg->adler = 1;
+
+	// Filtering is pointless if we're not really compressing. It also tends
+	// not to help paletted images.
+	use_filters = (pei->level>0 && !pei->pal);
+
+	// Each row buffer has room for the filter type byte, followed by the row.
+	rowbuf1 = de_malloc(c, (i64)bpl+1);
+	rowbuf2 = de_malloc(c, (i64)bpl+1);
+	if(seg->y0==0) {
+		zerorow = de_malloc(c, (i64)bpl);
+		prevrow = zerorow;
 	}
-	if (fmtutil_tdefl_compress_buffer(tdctx, NULL, 0, FMTUTIL_TDEFL_FINISH) !=
-		FMTUTIL_TDEFL_STATUS_DONE)
-	{
-		goto done;
+	else {
+		prevrow = PNG_SRC_ROW(seg->y0 - 1);
+	}
+
+	// Only the first segment has a zlib header. If there's only one segment,
+	// tdefl also writes the zlib trailer.
+	tdflags = (int)my_s_tdefl_num_probes[MY_MZ_MIN(10, pei->level)];
+	if(seg->is_first) tdflags |= MY_TDEFL_WRITE_ZLIB_HEADER;
+	tdctx = fmtutil_tdefl_create(c, seg->cmpr_data, tdflags);
+
+	for (y = seg->y0; y < seg->y1; ++y) {
+		const u8 *currow;
+		u8 *bestbuf = rowbuf1;
+
+		currow = PNG_SRC_ROW(y);
+
+		bestbuf[0] = PNG_FILTER_NONE;
+		png_filter_row(PNG_FILTER_NONE, pei->filter_bpp, currow, prevrow, &bestbuf[1], bpl);
+
+		if(use_filters) {
+			u8 *trialbuf = rowbuf2;
+			UI bestcost;
+
+			bestcost = png_filter_cost(&bestbuf[1], bpl);
+			for(ftype=PNG_FILTER_SUB; ftype<=PNG_FILTER_PAETH; ftype++) {
+				UI cost;
+
+				trialbuf[0] = (u8)ftype;
+				png_filter_row(ftype, pei->filter_bpp, currow, prevrow, &trialbuf[1], bpl);
+				cost = png_filter_cost(&trialbuf[1], bpl);
+				if(cost < bestcost) {
+					u8 *tmpp = bestbuf;
+
+					bestbuf = trialbuf;
+					trialbuf = tmpp;
+					bestcost = cost;
+				}
+			}
+		}
+
+		seg->adler = adler32_update(seg->adler, bestbuf, (size_t)bpl+1);
+		fmtutil_tdefl_compress_buffer(tdctx, bestbuf, (size_t)bpl+1, FMTUTIL_TDEFL_NO_FLUSH);
+		prevrow = currow;
+	}
+
+	if(seg->is_last) {
+		ret = fmtutil_tdefl_compress_buffer(tdctx, NULL, 0, FMTUTIL_TDEFL_FINISH);
+		if(ret != FMTUTIL_TDEFL_STATUS_DONE) seg->errflag = 1;
+	}
+	else {
+		ret = fmtutil_tdefl_compress_buffer(tdctx, NULL, 0, FMTUTIL_TDEFL_SYNC_FLUSH);
+		if(ret != FMTUTIL_TDEFL_STATUS_OKAY) seg->errflag = 1;
+	}
+
+#undef PNG_SRC_ROW
+	fmtutil_tdefl_destroy(tdctx);
+	de_free(c, zerorow);
+	de_free(c, rowbuf1);
+	de_free(c, rowbuf2);
+}
+
+static void png_compress_segment_job(void *userdata)
+{
+	png_compress_segment((struct png_segment*)userdata);
+}
+
+// The image is divided into segments of about this many bytes of filtered
+// data, which can be compressed in parallel. This depends only on the image
+// size, so that the output does not depend on the number of threads.
+#define PNG_SEGMENT_SIZE (4*1024*1024)
+
+static int write_png_chunk_IDAT(struct deark_png_encode_info *pei,
+	const u8 *src_pixels)
+{
+	i64 filtered_rowsize = pei->rowspan + 1;
+	int rows_per_seg;
+	int nsegs;
+	int nsubmitted = 0;
+	int nwritten = 0;
+	int max_queue_len;
+	int k;
+	int retval = 0;
+	u32 adler = 1;
+	deark *c = pei->c;
+	dbuf *zoutf = NULL;
+	struct de_workerpool *wp = NULL;
+	struct png_segment *segs = NULL;
+
+	rows_per_seg = (int)de_max_int(1, PNG_SEGMENT_SIZE / filtered_rowsize);
+	nsegs = (int)((pei->height + (i64)rows_per_seg - 1) / rows_per_seg);
+	if(nsegs<1) nsegs = 1;
+
+	segs = de_mallocarray(c, nsegs, sizeof(struct png_segment));
+	for(k=0; k<nsegs; k++) {
+		segs[k].pei = pei;
+		segs[k].src_pixels = src_pixels;
+		segs[k].y0 = k*rows_per_seg;
+		segs[k].y1 = (k==nsegs-1) ? pei->height : (k+1)*rows_per_seg;
+		segs[k].is_first = (k==0);
+		segs[k].is_last = (k==nsegs-1);
+	}
+
+	pei->idat_buf = de_malloc(c, PNG_IDAT_CHUNK_SIZE);
+	pei->idat_buf_used = 0;
+	zoutf = dbuf_create_custom_dbuf(c, 0, 0);
+	zoutf->userdata_for_customwrite = (void*)pei;
+	zoutf->customwrite_fn = idat_customwrite_cb;
+
+	if(nsegs>1 && c->num_threads>0) {
+		wp = de_workerpool_create(c, c->num_threads);
 	}
+	// Limit the amount of compressed data waiting to be written.
+	max_queue_len = wp ? 2*de_max_int(1, de_workerpool_get_nthreads(wp)) : 1;
 
-	write_png_chunk_from_cdbuf(pei, cdbuf, CODE_IDAT);
+	while(nwritten < nsegs) {
+		struct png_segment *seg;
 
+		if(nsubmitted<nsegs && nsubmitted-nwritten<max_queue_len) {
+			seg = &segs[nsubmitted++];
+			if(wp) {
+				seg->job = de_workerpool_submit(wp, png_compress_segment_job, (void*)seg);
+			}
+			else {
+				png_compress_segment(seg);
+			}
+			continue;
+		}
+
+		// Write the oldest segment, waiting for it if necessary.
+		seg = &segs[nwritten++];
+		if(seg->job) {
+			de_workerpool_finish_job(wp, seg->job);
+			seg->job = NULL;
+		}
+		if(seg->errflag) goto done;
+		dbuf_copy(seg->cmpr_data, 0, seg->cmpr_data->len, zoutf);
+		dbuf_close(seg->cmpr_data);
+		seg->cmpr_data = NULL;
+		adler = adler32_combine(adler, seg->adler,
+			(i64)(seg->y1 - seg->y0) * filtered_rowsize);
+	}
+
+	if(nsegs>1) {
+		// zlib trailer
+		dbuf_writeu32be(zoutf, (i64)adler);
+	}
+
+	flush_idat_buf(pei);
 	retval = 1;
 
 done:
-	fmtutil_tdefl_destroy(tdctx);
+	if(segs) {
+		for(k=0; k<nsegs; k++) {
+			if(segs[k].job) {
+				de_workerpool_finish_job(wp, segs[k].job);
+			}
+			dbuf_close(segs[k].cmpr_data);
+		}
+		de_free(c, segs);
+	}
+	de_workerpool_destroy(wp);
+	dbuf_close(zoutf);
+	de_free(c, pei->idat_buf);
+	pei->idat_buf = NULL;
 	return retval;
 }
 
@@ -176,6 +564,13 @@ static int do_generate_png(struct deark_png_encode_info *pei, const u8 *src_pixe
 
 	write_png_chunk_IHDR(pei, cdbuf);
 
+	if(pei->pal) {
+		dbuf_truncate(cdbuf, 0);
+		write_png_chunk_PLTE(pei, cdbuf);
+		dbuf_truncate(cdbuf, 0);
+		write_png_chunk_tRNS(pei, cdbuf);
+	}
+
 	if(pei->has_phys) {
 		dbuf_truncate(cdbuf, 0);
 		write_png_chunk_pHYs(pei, cdbuf);
@@ -196,8 +591,7 @@ static int do_generate_png(struct deark_png_encode_info *pei, const u8 *src_pixe
 		write_png_chunk_tEXt(pei, cdbuf, "Software", "Deark");
 	}
 
-	dbuf_truncate(cdbuf, 0);
-	if(!write_png_chunk_IDAT(pei, cdbuf, src_pixels)) goto done;
+	if(!write_png_chunk_IDAT(pei, src_pixels)) goto done;
 
 	dbuf_truncate(cdbuf, 0);
 	write_png_chunk_from_cdbuf(pei, cdbuf, CODE_IEND);
@@ -208,11 +602,35 @@ done:
 	return retval;
 }
 
+// Pack 8-bit palette indices into pei->bit_depth bits each. Each row starts
+// on a byte boundary.
+static u8 *pack_indices(struct deark_png_encode_info *pei, const u8 *indices)
+{
+	u8 *packed;
+	i64 i, j;
+	int pixels_per_byte = 8/pei->bit_depth;
+
+	packed = de_malloc(pei->c, pei->rowspan * pei->height);
+	for(j=0; j<pei->height; j++) {
+		const u8 *srow = &indices[j * pei->width];
+		u8 *drow = &packed[j * pei->rowspan];
+
+		for(i=0; i<pei->width; i++) {
+			int shift = 8 - pei->bit_depth * (1 + (int)(i % pixels_per_byte));
+
+			drow[i / pixels_per_byte] |= (u8)(srow[i] << shift);
+		}
+	}
+	return packed;
+}
+
 int de_write_png(deark *c, de_bitmap *img, dbuf *f)
 {
 	const char *opt_level;
 	int retval = 0;
 	struct deark_png_encode_info *pei = NULL;
+	const u8 *src_pixels;
+	u8 *packed_pixels = NULL;
 
 	pei = de_malloc(c, sizeof(struct deark_png_encode_info));
 	pei->c = c;
@@ -261,7 +679,25 @@ int de_write_png(deark *c, de_bitmap *img, dbuf *f)
 	pei->height = (int)img->height;
 	pei->flip = img->flipped;
 	pei->num_chans = img->bytes_per_pixel;
+	pei->bit_depth = 8;
+	pei->rowspan = (i64)pei->width * pei->num_chans;
+	pei->filter_bpp = pei->num_chans;
 	pei->include_text_chunk_software = 0;
+	src_pixels = img->bitmap;
+
+	if(img->pal) {
+		pei->pal = img->pal;
+		pei->num_pal_entries = img->num_pal_entries;
+		if(pei->num_pal_entries<=2) pei->bit_depth = 1;
+		else if(pei->num_pal_entries<=4) pei->bit_depth = 2;
+		else if(pei->num_pal_entries<=16) pei->bit_depth = 4;
+		pei->filter_bpp = 1;
+		if(pei->bit_depth<8) {
+			pei->rowspan = ((i64)pei->width * pei->bit_depth + 7)/8;
+			packed_pixels = pack_indices(pei, img->bitmap);
+			src_pixels = packed_pixels;
+		}
+	}
 
 	if(!c->pngcprlevel_valid) {
 		c->pngcmprlevel = 9; // default
@@ -297,7 +733,7 @@ int de_write_png(deark *c, de_bitmap *img, dbuf *f)
 
 	pei->crco = de_crcobj_create(c, DE_CRCOBJ_CRC32_IEEE);
 
-	if(!do_generate_png(pei, img->bitmap)) {
+	if(!do_generate_png(pei, src_pixels)) {
 		de_err(c, "PNG write failed");
 		goto done;
 	}
@@ -309,5 +745,6 @@ done:
 		de_crcobj_destroy(pei->crco);
 		de_free(c, pei);
 	}
+	de_free(c, packed_pixels);
 	return retval;
 }
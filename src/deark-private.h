@@ -12,6 +12,7 @@
 #ifndef DEARK_H_INC
 #include "deark.h"
 #endif
+#include <setjmp.h>
 
 #define DE_MAX_SANE_OBJECT_SIZE 100000000
 
@@ -67,6 +68,11 @@ struct de_ucstring_struct;
 typedef struct de_ucstring_struct de_ucstring;
 struct dbuf_struct;
 typedef struct dbuf_struct dbuf;
+struct de_pagecache;
+struct de_sigindex;
+struct de_alloc_hdr;
+struct de_mutex;
+struct de_crctables;
 struct de_finfo_struct;
 typedef struct de_finfo_struct de_finfo;
 
@@ -99,6 +105,17 @@ struct deark_module_info {
 	u32 unique_id; // or 0. Rarely used.
 #define DE_MAX_MODULE_ALIASES 2
 	const char *id_alias[DE_MAX_MODULE_ALIASES];
+	// Optional magic-byte signatures, added with de_module_add_signature().
+	// If a module has any signatures, its identify_fn promises to return 0
+	// for files that match none of them, and autodetection will skip calling
+	// it for such files.
+#define DE_MAX_MODULE_SIGNATURES 3
+#define DE_SIGINDEX_PREFIX_LEN 64 // Signatures must be within this many bytes
+	struct de_module_signature {
+		const char *bytes;
+		u8 offset;
+		u8 len;
+	} sig[DE_MAX_MODULE_SIGNATURES];
 };
 typedef void (*de_module_getinfo_fn)(deark *c, struct deark_module_info *mi);
 
@@ -140,6 +157,8 @@ typedef void (*de_writelistener_cb_type)(dbuf *f, void *userdata, const u8 *buf,
 typedef void (*de_dbufcustomread_type)(dbuf *f, void *userdata, u8 *buf, i64 pos, i64 len);
 typedef void (*de_dbufcustomwrite_type)(dbuf *f, void *userdata, const u8 *buf, i64 buf_len);
 
+struct de_dbuf_extent;
+
 // dbuf is our generalized I/O object. Used for many purposes.
 struct dbuf_struct {
 #define DBUF_TYPE_NULL    0
@@ -152,6 +171,7 @@ struct dbuf_struct {
 #define DBUF_TYPE_FIFO    7
 #define DBUF_TYPE_ODBUF   8 // nested dbuf, for output
 #define DBUF_TYPE_CUSTOM  9
+#define DBUF_TYPE_EXTENTS 10 // list of extents in a parent dbuf, for input
 	int btype;
 	u8 is_managed;
 
@@ -166,11 +186,18 @@ struct dbuf_struct {
 	int file_pos_known;
 	i64 file_pos;
 
-	struct dbuf_struct *parent_dbuf; // used for DBUF_TYPE_DBUF
+	struct dbuf_struct *parent_dbuf; // used for DBUF_TYPE_DBUF, _EXTENTS
 	i64 offset_into_parent_dbuf; // used for DBUF_TYPE_DBUF
 
-	u8 write_memfile_to_zip_archive;
+	// Used for DBUF_TYPE_EXTENTS
+	struct de_dbuf_extent *extents;
+	i64 num_extents;
+	i64 extents_alloc;
+	i64 last_extent_idx; // The extent most recently read from
+
+	u8 writing_to_zip_archive;
 	u8 writing_to_tar_archive;
+	u8 writing_to_output_callback;
 	char *name; // used for DBUF_TYPE_OFILE (utf-8)
 
 	i64 membuf_alloc;
@@ -187,7 +214,15 @@ struct dbuf_struct {
 #define DE_CACHE_POLICY_ENABLED 1
 	int cache_policy;
 	i64 cache_bytes_used;
+	// If this is more than cache_bytes_used, the cache is filled on demand,
+	// and can grow to this many bytes.
+	i64 cache_fill_limit;
 	u8 *cache; // first 'cache_bytes_used' bytes of the file
+	u8 cache_is_mapped; // cache is a memory-mapped view of the file
+	i64 bytes_read_from_file; // For DBUF_TYPE_IFILE: Total bytes read with fread()
+
+	// For DBUF_TYPE_IFILE: Cached pages of the part of the file after 'cache'.
+	struct de_pagecache *pagecache;
 
 	// cache2 is a simple 1-byte cache, mainly to speed up de_get_bits_symbol().
 	i64 cache2_pos;
@@ -195,6 +230,10 @@ struct dbuf_struct {
 
 	// Things copied from the de_finfo object at file creation
 	de_finfo *fi_copy;
+
+	// For recursive extraction: A membuf copy of everything written to this
+	// output file. NULL if the file is not to be recursed into.
+	struct dbuf_struct *recursion_copy;
 };
 
 // Image density (resolution) settings
@@ -249,6 +288,11 @@ struct deark_bitmap_struct {
 	i64 bitmap_size; // bytes allocated for bitmap
 	int orig_colortype; // Optional; can be used by modules
 	int orig_bitdepth; // Optional; can be used by modules
+	// If pal is set, this is a paletted image: bytes_per_pixel is 1, and each
+	// byte of 'bitmap' is an index into pal. Such images are made only when
+	// writing to a file, and most functions don't support them.
+	de_color *pal;
+	int num_pal_entries;
 };
 typedef struct deark_bitmap_struct de_bitmap;
 
@@ -368,6 +412,11 @@ struct deark_struct {
 
 	int output_style; // DE_OUTPUTSTYLE_*
 	int archive_fmt; // If output_style==DE_OUTPUTSTYLE_ARCHIVE
+	// If output_style==DE_OUTPUTSTYLE_CALLBACK
+	de_output_open_fn output_open_fn;
+	de_output_write_fn output_write_fn;
+	de_output_close_fn output_close_fn;
+	void *output_cb_userdata;
 	int input_style; // DE_INPUTSTYLE_*
 	u8 archive_to_stdout;
 	u8 allow_subdirs;
@@ -376,11 +425,19 @@ struct deark_struct {
 	int extract_level;
 	u8 list_mode;
 	u8 list_mode_include_file_id;
+	u8 verify_mode;
 	int first_output_file; // first file = 0
 	int max_output_files; // -1 = no limit
 	i64 max_image_dimension;
 	i64 max_output_file_size;
 	i64 max_total_output_size;
+	int num_threads; // Number of worker threads allowed. 0 = none.
+	u8 recurse_req;
+	int recurse_max_depth; // 0 = recursion disabled
+	int recurse_depth; // Nesting level of the file currently being processed
+	i64 recurse_max_mem;
+	i64 recurse_mem_used; // Total size of all recursion_copy membufs
+	struct de_strarray *recurse_curpath; // Names of the files we're inside of
 	int show_infomessages;
 	int show_warnings;
 	int dbg_indent_amount;
@@ -413,6 +470,8 @@ struct deark_struct {
 	u8 tmpflag2;
 	u8 pngcprlevel_valid;
 	unsigned int pngcmprlevel;
+	u8 pngpalette_valid;
+	u8 pngpalette; // Allow writing paletted PNG images
 	void *zip_data;
 	void *tar_data;
 	dbuf *extrlist_dbuf;
@@ -432,15 +491,38 @@ struct deark_struct {
 
 	int num_modules;
 	struct deark_module_info *module_info; // Pointer to an array
+	u8 module_info_is_shared; // module_info belongs to a batch-mode parent
+	struct de_sigindex *sigindex; // Also shared, if module_info is shared
+	u8 is_batch_item;
 
 #define DE_MAX_EXT_OPTIONS 16
 	int num_ext_options;
 	struct deark_ext_option ext_option[DE_MAX_EXT_OPTIONS];
+
+	// All the memory allocated with this context, that hasn't been freed.
+	struct de_alloc_hdr *alloc_list;
+	struct de_mutex *alloc_mtx; // Protects alloc_list, once there are worker threads
+	struct de_crctables *crctables; // Shared by all crcobjs. Built on first use.
+	jmp_buf *fatalerror_jmpbuf; // Set while de_run() is running
+	u64 run_thread_id; // The thread that is running de_run()
+	u8 fatal_error_flag;
 };
 
 void de_fatalerror(deark *c);
 
+// Used with de_malloc_tagged(), for objects that need special handling if
+// a fatal error occurs.
+#define DE_ALLOCTAG_DBUF       1
+#define DE_ALLOCTAG_WORKERPOOL 2
+void *de_malloc_tagged(deark *c, i64 n, unsigned int tag);
+void de_free_all_allocations(deark *c);
+void *de_find_tagged_allocation(deark *c, unsigned int tag);
+void de_foreach_tagged_allocation(deark *c, unsigned int tag,
+	void (*fn)(deark *c, void *m));
+void de_release_resources_after_fatal_error(deark *c);
+
 deark *de_create_internal(void);
+void de_recurse_into_file(deark *c, dbuf *f, char *name);
 int de_run_module(deark *c, struct deark_module_info *mi, de_module_params *mparams,
 	enum de_moddisp_enum moddisp);
 int de_run_module_by_id(deark *c, const char *id, de_module_params *mparams);
@@ -450,6 +532,8 @@ int de_run_module_by_id_on_slice2(deark *c, const char *id, const char *codes,
 	dbuf *f, i64 pos, i64 len);
 int de_get_module_idx_by_id(deark *c, const char *module_id);
 struct deark_module_info *de_get_module_by_id(deark *c, const char *module_id);
+void de_module_add_signature(deark *c, struct deark_module_info *mi, i64 offset,
+	const char *bytes, i64 len);
 
 void de_strlcpy(char *dst, const char *src, size_t dstlen);
 char *de_strchr(const char *s, int c);
@@ -499,8 +583,52 @@ FILE* de_fopen_for_write(deark *c, const char *fn,
 int de_fseek(FILE *fp, i64 offs, int whence);
 i64 de_ftell(FILE *fp);
 int de_fclose(FILE *fp);
+// Maps the first 'len' bytes of a file into memory, read-only.
+// Returns NULL on failure, or if not supported.
+u8 *de_mmap_file(FILE *fp, i64 len);
+void de_munmap_file(u8 *mem, i64 len);
+// Copies up to 'len' bytes from offset 'inpos' of infp to offset 'outpos' of
+// outfp, using the operating system's file-to-file copy feature. outfp must
+// have been flushed. Does not update outfp's stdio position.
+// Returns the number of bytes copied, or 0 if not supported.
+i64 de_copy_file_range(FILE *infp, i64 inpos, FILE *outfp, i64 outpos, i64 len);
 void de_update_file_attribs(dbuf *f, u8 preserve_file_times);
 
+// Threads, and synchronization objects. Implemented in the platform-specific
+// files. Most of the library is not thread-safe, so code that runs in a
+// secondary thread must be careful about what it calls.
+struct de_thread;
+struct de_mutex;
+struct de_semaphore;
+typedef void (*de_thread_fn)(void *userdata);
+struct de_thread *de_thread_create(deark *c, de_thread_fn fn, void *userdata);
+void de_thread_join(deark *c, struct de_thread *th);
+struct de_mutex *de_mutex_create(deark *c);
+void de_mutex_destroy(deark *c, struct de_mutex *mtx);
+void de_mutex_lock(struct de_mutex *mtx);
+void de_mutex_unlock(struct de_mutex *mtx);
+u64 de_get_current_thread_id(void);
+struct de_semaphore *de_semaphore_create(deark *c);
+void de_semaphore_destroy(deark *c, struct de_semaphore *sem);
+void de_semaphore_post(struct de_semaphore *sem);
+void de_semaphore_wait(struct de_semaphore *sem);
+
+// A pool of worker threads, for running independent jobs. Jobs are started
+// in the order submitted. With 0 threads, a job runs immediately, in the
+// calling thread.
+// Every job must eventually be passed to de_workerpool_finish_job(), by the
+// thread that created the pool.
+struct de_workerpool;
+struct de_workerpool_job;
+typedef void (*de_workerpool_job_fn)(void *userdata);
+struct de_workerpool *de_workerpool_create(deark *c, int nthreads);
+void de_workerpool_destroy(struct de_workerpool *wp);
+int de_workerpool_get_nthreads(struct de_workerpool *wp);
+struct de_workerpool_job *de_workerpool_submit(struct de_workerpool *wp,
+	de_workerpool_job_fn fn, void *userdata);
+int de_workerpool_job_is_done(struct de_workerpool *wp, struct de_workerpool_job *job);
+void de_workerpool_finish_job(struct de_workerpool *wp, struct de_workerpool_job *job);
+
 void de_declare_fmt(deark *c, const char *fmtname);
 void de_declare_fmtf(deark *c, const char *fmt, ...)
   de_gnuc_attribute ((format (printf, 2, 3)));
@@ -545,7 +673,8 @@ void de_tar_close_file(deark *c);
 ///////////////////////////////////////////
 
 int de_zip_create_file(deark *c);
-void de_zip_add_file_to_archive(deark *c, dbuf *f);
+void de_zip_start_member_file(deark *c, dbuf *f);
+void de_zip_end_member_file(deark *c, dbuf *f);
 void de_zip_close_file(deark *c);
 
 int de_write_png(deark *c, de_bitmap *img, dbuf *f);
@@ -651,7 +780,8 @@ void dbuf_read_to_ucstring_n(dbuf *f, i64 pos, i64 len, i64 max_len,
 
 // At least one of 'ext' or 'fi' should be non-NULL.
 #define DE_CREATEFLAG_IS_AUX   0x1
-#define DE_CREATEFLAG_OPT_IMAGE 0x2
+#define DE_CREATEFLAG_OPT_IMAGE 0x2 // Obsolete; images are now always optimized
+#define DE_CREATEFLAG_NORECURSE 0x4 // File is in a format Deark created; don't -recurse into it
 dbuf *dbuf_create_output_file(deark *c, const char *ext, de_finfo *fi, unsigned int createflags);
 
 dbuf *dbuf_create_unmanaged_file(deark *c, const char *fname, int overwrite_mode, unsigned int flags);
@@ -659,6 +789,8 @@ dbuf *dbuf_create_unmanaged_file_stdout(deark *c, const char *name);
 dbuf *dbuf_open_input_file(deark *c, const char *fn);
 dbuf *dbuf_open_input_stdin(deark *c);
 dbuf *dbuf_open_input_subfile(dbuf *parent, i64 offset, i64 size);
+dbuf *dbuf_open_input_extents(dbuf *parent);
+void dbuf_add_extent(dbuf *f, i64 offset, i64 len);
 dbuf *dbuf_create_custom_dbuf(deark *c, i64 apparent_size, unsigned int flags);
 
 // Flag:
@@ -667,8 +799,10 @@ dbuf *dbuf_create_membuf(deark *c, i64 initialsize, unsigned int flags);
 
 // If f is NULL, this is a no-op.
 void dbuf_close(dbuf *f);
+void dbuf_release_os_resources(deark *c, void *m);
 
 void dbuf_set_writelistener(dbuf *f, de_writelistener_cb_type fn, void *userdata);
+int dbuf_output_is_wanted(dbuf *f);
 
 void dbuf_write(dbuf *f, const u8 *m, i64 len);
 void dbuf_write_at(dbuf *f, i64 pos, const u8 *m, i64 len);
@@ -788,12 +922,18 @@ void de_bitbuf_lowelevel_empty(struct de_bitbuf_lowlevel *bbll);
 
 struct de_bitreader {
 	dbuf *f;
+	// curpos is the position of the next byte to be added to the bit buffer.
+	// The buffer may hold several bytes that haven't been read yet, so use
+	// de_bitreader_get_curpos() to find out how much data was consumed.
 	i64 curpos;
 	i64 endpos;
 	u8 eof_flag;
 	struct de_bitbuf_lowlevel bbll;
 };
 u64 de_bitreader_getbits(struct de_bitreader *bitrd, UI nbits);
+int de_bitreader_peekbits(struct de_bitreader *bitrd, UI nbits, u64 *pval);
+void de_bitreader_skipbits(struct de_bitreader *bitrd, UI nbits);
+i64 de_bitreader_get_curpos(struct de_bitreader *bitrd);
 char *de_bitreader_describe_curpos(struct de_bitreader *bitrd, char *buf, size_t buf_len);
 
 ///////////////////////////////////////////
@@ -860,7 +1000,11 @@ void de_read_palette_rgb(dbuf *f,
 	de_color *pal, i64 ncolors_in_pal,
 	unsigned int flags);
 
-// Utility function that will work for many of the common kinds of paletted images.
+// Utility functions that will work for many of the common kinds of paletted
+// images. bpp must be 1, 2, 4, or 8.
+// flags: DE_CVTF_LSBFIRST
+void de_convert_row_paletted(dbuf *f, i64 fpos, i64 bpp,
+	const de_color *pal, de_bitmap *img, i64 rownum, unsigned int flags);
 void de_convert_image_paletted(dbuf *f, i64 fpos,
 	i64 bpp, i64 rowspan, const de_color *pal,
 	de_bitmap *img, unsigned int flags);
@@ -1048,9 +1192,13 @@ int de_inthashtable_remove_any_item(deark *c, struct de_inthashtable *ht, i64 *p
 #define DE_CRCOBJ_CRC32_IEEE   0x10
 #define DE_CRCOBJ_CRC16_CCITT  0x20
 #define DE_CRCOBJ_CRC16_ARC    0x21
+#define DE_CRCOBJ_TYPEMASK     0xff
+// Use the slow byte-at-a-time algorithms. For testing and benchmarking.
+#define DE_CRCOBJ_FLAG_BYTEWISE 0x100
 
 struct de_crcobj;
 
+void de_crc_init_tables(deark *c);
 struct de_crcobj *de_crcobj_create(deark *c, unsigned int flags);
 void de_crcobj_destroy(struct de_crcobj *crco);
 void de_crcobj_reset(struct de_crcobj *crco);
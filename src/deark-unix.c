@@ -5,6 +5,9 @@
 // Functions specific to Unix and other non-Windows builds
 
 #define DE_NOT_IN_MODULE
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // For copy_file_range()
+#endif
 #include "deark-config.h"
 
 #ifdef DE_UNIX
@@ -12,9 +15,17 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <utime.h>
 #include <errno.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#if defined(__GLIBC__) && (__GLIBC__>2 || (__GLIBC__==2 && __GLIBC_MINOR__>=27))
+#define DE_HAVE_COPY_FILE_RANGE
+#endif
+#endif
 
 // This file is overloaded, in that it contains functions intended to only
 // be used internally, as well as functions intended only for the
@@ -34,19 +45,6 @@ void de_vsnprintf(char *buf, size_t buflen, const char *fmt, va_list ap)
 	buf[buflen-1]='\0';
 }
 
-char *de_strdup(deark *c, const char *s)
-{
-	char *s2;
-
-	s2 = strdup(s);
-	if(!s2) {
-		de_err(c, "Memory allocation failed");
-		de_fatalerror(c);
-		return NULL;
-	}
-	return s2;
-}
-
 i64 de_strtoll(const char *string, char **endptr, int base)
 {
 	return strtoll(string, endptr, base);
@@ -188,6 +186,83 @@ int de_fclose(FILE *fp)
 	return fclose(fp);
 }
 
+// Map the first len bytes of fp. Returns NULL if that can't be done.
+// If the file is truncated while it is mapped, reading the missing part
+// raises SIGBUS. We can't prevent that, but we at least make sure the file is
+// a regular file, and still has all the bytes we expect, right before
+// mapping it.
+u8 *de_mmap_file(FILE *fp, i64 len)
+{
+	void *mem;
+	struct stat stbuf;
+
+	if(len<1 || (i64)(size_t)len!=len) return NULL;
+	de_zeromem(&stbuf, sizeof(struct stat));
+	if(0 != fstat(fileno(fp), &stbuf)) return NULL;
+	if(!S_ISREG(stbuf.st_mode)) return NULL;
+	if((i64)stbuf.st_size < len) return NULL;
+	mem = mmap(NULL, (size_t)len, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if(mem==MAP_FAILED) return NULL;
+	return (u8*)mem;
+}
+
+void de_munmap_file(u8 *mem, i64 len)
+{
+	munmap((void*)mem, (size_t)len);
+}
+
+i64 de_copy_file_range(FILE *infp, i64 inpos, FILE *outfp, i64 outpos, i64 len)
+{
+#ifdef __linux__
+	int infd = fileno(infp);
+	int outfd = fileno(outfp);
+	i64 total = 0;
+	int use_sendfile = 0;
+
+#ifndef DE_HAVE_COPY_FILE_RANGE
+	use_sendfile = 1;
+#endif
+	if(use_sendfile) {
+		// sendfile() writes at the current file position.
+		if(lseek(outfd, (off_t)outpos, SEEK_SET)!=(off_t)outpos) return 0;
+	}
+
+	while(total < len) {
+		size_t n;
+		ssize_t ret;
+
+		n = (size_t)de_min_int(len-total, 0x40000000);
+#ifdef DE_HAVE_COPY_FILE_RANGE
+		if(!use_sendfile) {
+			loff_t off_in = (loff_t)(inpos+total);
+			loff_t off_out = (loff_t)(outpos+total);
+
+			ret = copy_file_range(infd, &off_in, outfd, &off_out, n, 0);
+			if(ret<0 && total==0 && (errno==ENOSYS || errno==EXDEV ||
+				errno==EINVAL || errno==EOPNOTSUPP || errno==EBADF))
+			{
+				// Not supported for these files. Try sendfile().
+				use_sendfile = 1;
+				if(lseek(outfd, (off_t)outpos, SEEK_SET)!=(off_t)outpos) return 0;
+				continue;
+			}
+		}
+		else
+#endif
+		{
+			off_t off_in = (off_t)(inpos+total);
+
+			ret = sendfile(outfd, infd, &off_in, n);
+		}
+		if(ret<=0) break;
+		total += (i64)ret;
+	}
+	return total;
+#else
+	return 0;
+#endif
+}
+
 struct upd_attr_ctx {
 	int tried_stat;
 	int stat_ret;
@@ -309,6 +384,124 @@ void de_exitprocess(int s)
 	exit(s);
 }
 
+struct de_thread {
+	pthread_t th;
+	de_thread_fn fn;
+	void *userdata;
+};
+
+static void *thread_start_fn(void *userdata)
+{
+	struct de_thread *th = (struct de_thread*)userdata;
+
+	th->fn(th->userdata);
+	return NULL;
+}
+
+// Returns NULL on failure.
+struct de_thread *de_thread_create(deark *c, de_thread_fn fn, void *userdata)
+{
+	struct de_thread *th;
+
+	th = de_malloc(c, sizeof(struct de_thread));
+	th->fn = fn;
+	th->userdata = userdata;
+	if(pthread_create(&th->th, NULL, thread_start_fn, (void*)th) != 0) {
+		de_free(c, th);
+		return NULL;
+	}
+	return th;
+}
+
+// Waits for the thread to finish, and frees th.
+void de_thread_join(deark *c, struct de_thread *th)
+{
+	if(!th) return;
+	pthread_join(th->th, NULL);
+	de_free(c, th);
+}
+
+struct de_mutex {
+	pthread_mutex_t m;
+};
+
+struct de_mutex *de_mutex_create(deark *c)
+{
+	struct de_mutex *mtx;
+
+	mtx = de_malloc(c, sizeof(struct de_mutex));
+	pthread_mutex_init(&mtx->m, NULL);
+	return mtx;
+}
+
+void de_mutex_destroy(deark *c, struct de_mutex *mtx)
+{
+	if(!mtx) return;
+	pthread_mutex_destroy(&mtx->m);
+	de_free(c, mtx);
+}
+
+void de_mutex_lock(struct de_mutex *mtx)
+{
+	pthread_mutex_lock(&mtx->m);
+}
+
+void de_mutex_unlock(struct de_mutex *mtx)
+{
+	pthread_mutex_unlock(&mtx->m);
+}
+
+u64 de_get_current_thread_id(void)
+{
+	// pthread_t is an opaque type, but in practice it is an integer or a
+	// pointer.
+	return (u64)(size_t)pthread_self();
+}
+
+// A counting semaphore. (POSIX unnamed semaphores are not available
+// everywhere, so we make our own.)
+struct de_semaphore {
+	pthread_mutex_t m;
+	pthread_cond_t cv;
+	i64 count;
+};
+
+struct de_semaphore *de_semaphore_create(deark *c)
+{
+	struct de_semaphore *sem;
+
+	sem = de_malloc(c, sizeof(struct de_semaphore));
+	pthread_mutex_init(&sem->m, NULL);
+	pthread_cond_init(&sem->cv, NULL);
+	return sem;
+}
+
+void de_semaphore_destroy(deark *c, struct de_semaphore *sem)
+{
+	if(!sem) return;
+	pthread_cond_destroy(&sem->cv);
+	pthread_mutex_destroy(&sem->m);
+	de_free(c, sem);
+}
+
+void de_semaphore_post(struct de_semaphore *sem)
+{
+	pthread_mutex_lock(&sem->m);
+	sem->count++;
+	pthread_cond_signal(&sem->cv);
+	pthread_mutex_unlock(&sem->m);
+}
+
+void de_semaphore_wait(struct de_semaphore *sem)
+{
+	pthread_mutex_lock(&sem->m);
+	while(sem->count<1) {
+		pthread_cond_wait(&sem->cv, &sem->m);
+	}
+	sem->count--;
+	pthread_mutex_unlock(&sem->m);
+}
+
 struct de_platform_data *de_platformdata_create(void)
 {
 	struct de_platform_data *plctx;
@@ -15,6 +15,140 @@
 #define DE_DEFAULT_MAX_FILE_SIZE 0x280000000LL // 10GiB
 #define DE_DEFAULT_MAX_TOTAL_OUTPUT_SIZE 0x3c0000000LL // 15GiB
 #define DE_DEFAULT_MAX_IMAGE_DIMENSION 10000
+#define DE_DEFAULT_RECURSE_MAX_DEPTH 10
+#define DE_DEFAULT_RECURSE_MAX_MEM 0x10000000LL // 256MiB
+
+// An index of the modules' magic-byte signatures, used to avoid calling
+// identify functions that could not possibly succeed.
+// Signatures are grouped by their offset, and then by their first byte.
+struct de_sigindex_entry {
+	int module_idx;
+	int sig_idx;
+	int next; // Index of the next entry in this bucket, or -1
+};
+
+struct de_sigindex_group {
+	u8 offset;
+	int bucket[256]; // Index of the first entry, or -1
+};
+
+struct de_sigindex {
+	u8 *module_has_sig; // [num_modules]
+	i64 prefix_len; // Number of leading bytes of the file we need to look at
+	int num_groups;
+	struct de_sigindex_group *groups;
+	int num_entries;
+	struct de_sigindex_entry *entries;
+};
+
+static struct de_sigindex_group *sigindex_get_group(deark *c, struct de_sigindex *si,
+	u8 offset)
+{
+	int i;
+	struct de_sigindex_group *grp;
+
+	for(i=0; i<si->num_groups; i++) {
+		if(si->groups[i].offset==offset) return &si->groups[i];
+	}
+	grp = &si->groups[si->num_groups++];
+	grp->offset = offset;
+	for(i=0; i<256; i++) {
+		grp->bucket[i] = -1;
+	}
+	return grp;
+}
+
+static void sigindex_create(deark *c)
+{
+	struct de_sigindex *si;
+	int i, k;
+	int max_entries = 0;
+
+	if(c->sigindex) return;
+	si = de_malloc(c, sizeof(struct de_sigindex));
+	c->sigindex = si;
+	si->module_has_sig = de_malloc(c, c->num_modules);
+
+	for(i=0; i<c->num_modules; i++) {
+		for(k=0; k<DE_MAX_MODULE_SIGNATURES; k++) {
+			if(c->module_info[i].sig[k].len) max_entries++;
+		}
+	}
+	if(max_entries<1) return;
+
+	// There can't be more groups than signatures.
+	si->groups = de_mallocarray(c, max_entries, sizeof(struct de_sigindex_group));
+	si->entries = de_mallocarray(c, max_entries, sizeof(struct de_sigindex_entry));
+
+	for(i=0; i<c->num_modules; i++) {
+		struct deark_module_info *mi = &c->module_info[i];
+
+		if(!mi->identify_fn) continue;
+		// Modules that share their detection results with other modules must
+		// always be run.
+		if(mi->flags & DE_MODFLAG_SHAREDDETECTION) continue;
+
+		for(k=0; k<DE_MAX_MODULE_SIGNATURES; k++) {
+			const struct de_module_signature *sig = &mi->sig[k];
+			struct de_sigindex_group *grp;
+			struct de_sigindex_entry *e;
+			u8 firstbyte;
+
+			if(sig->len==0) continue;
+			grp = sigindex_get_group(c, si, sig->offset);
+			firstbyte = (u8)sig->bytes[0];
+			e = &si->entries[si->num_entries];
+			e->module_idx = i;
+			e->sig_idx = k;
+			e->next = grp->bucket[firstbyte];
+			grp->bucket[firstbyte] = si->num_entries;
+			si->num_entries++;
+
+			if((i64)sig->offset + (i64)sig->len > si->prefix_len) {
+				si->prefix_len = (i64)sig->offset + (i64)sig->len;
+			}
+			si->module_has_sig[i] = 1;
+		}
+	}
+}
+
+static void sigindex_destroy(deark *c, struct de_sigindex *si)
+{
+	if(!si) return;
+	de_free(c, si->module_has_sig);
+	de_free(c, si->groups);
+	de_free(c, si->entries);
+	de_free(c, si);
+}
+
+// Sets is_candidate[i] for each module i that has a signature that matches
+// the current input file.
+static void sigindex_find_candidates(deark *c, struct de_sigindex *si,
+	u8 *is_candidate)
+{
+	u8 prefix[DE_SIGINDEX_PREFIX_LEN];
+	int i;
+
+	// Like dbuf_memcmp(), treat bytes past the end of the file as 0.
+	dbuf_read(c->infile, prefix, 0, si->prefix_len);
+
+	for(i=0; i<si->num_groups; i++) {
+		const struct de_sigindex_group *grp = &si->groups[i];
+		int eidx;
+
+		eidx = grp->bucket[prefix[grp->offset]];
+		while(eidx>=0) {
+			const struct de_sigindex_entry *e = &si->entries[eidx];
+			const struct de_module_signature *sig;
+
+			sig = &c->module_info[e->module_idx].sig[e->sig_idx];
+			if(!de_memcmp(&prefix[sig->offset], sig->bytes, (size_t)sig->len)) {
+				is_candidate[e->module_idx] = 1;
+			}
+			eidx = e->next;
+		}
+	}
+}
 
 // Returns the best module to use, by looking at the file contents, etc.
 static struct deark_module_info *detect_module_for_file(deark *c, int *errflag)
@@ -22,6 +156,9 @@ static struct deark_module_info *detect_module_for_file(deark *c, int *errflag)
 	int i;
 	int result;
 	int orig_errcount;
+	int num_identify_calls = 0;
+	struct de_sigindex *si = NULL;
+	u8 *is_candidate = NULL;
 	struct deark_module_info *best_module = NULL;
 
 	*errflag = 0;
@@ -29,6 +166,12 @@ static struct deark_module_info *detect_module_for_file(deark *c, int *errflag)
 		c->detection_data = de_malloc(c, sizeof(struct de_detection_data_struct));
 	}
 
+	if(c->sigindex && de_get_ext_option_bool(c, "sigindex", 1)) {
+		si = c->sigindex;
+		is_candidate = de_malloc(c, c->num_modules);
+		sigindex_find_candidates(c, si, is_candidate);
+	}
+
 	// This value is made available to modules' identification functions, so
 	// that they can potentially skip expensive tests that cannot possibly return
 	// a high enough confidence.
@@ -47,13 +190,19 @@ static struct deark_module_info *detect_module_for_file(deark *c, int *errflag)
 			continue;
 		}
 
+		// If the module has signatures, and none of them match, its
+		// identify function would return 0.
+		if(si && si->module_has_sig[i] && !is_candidate[i]) continue;
+
 		result = c->module_info[i].identify_fn(c);
+		num_identify_calls++;
 
 		if(c->error_count > orig_errcount) {
 			// Detection routines don't normally produce errors. If one does,
 			// it's probably an internal error, or other serious problem.
 			*errflag = 1;
-			return NULL;
+			best_module = NULL;
+			goto done;
 		}
 
 		if(c->module_info[i].flags & DE_MODFLAG_DISABLEDETECT) {
@@ -69,6 +218,9 @@ static struct deark_module_info *detect_module_for_file(deark *c, int *errflag)
 		if(c->detection_data->best_confidence_so_far>=100) break;
 	}
 
+done:
+	de_dbg2(c, "identify functions called: %d", num_identify_calls);
+	de_free(c, is_candidate);
 	return best_module;
 }
 
@@ -189,6 +341,119 @@ void de_register_modules(deark *c)
 		return;
 	}
 	c->module_register_fn(c);
+	if(!c->module_info_is_shared) {
+		sigindex_create(c);
+	}
+}
+
+// Runs the autodetected module on a file that was extracted by a module,
+// with output filenames based on the extracted file's name.
+// This is called by dbuf_close(), as soon as the extracted file has been
+// written, so it usually happens while the module that extracted it is still
+// running. Takes ownership of f (a membuf containing the file's contents).
+void de_recurse_into_file(deark *c, dbuf *f, char *name)
+{
+	struct de_strarray *curpath = c->recurse_curpath;
+	struct deark_module_info *module_to_use = NULL;
+	de_ucstring *tmps = NULL;
+	dbuf *old_infile;
+	const char *old_input_filename;
+	int old_suppress_detection_by_filename;
+	char *old_base_output_filename;
+	int old_file_count;
+	int old_first_output_file;
+	int old_max_output_files;
+	int old_format_declared;
+	int old_module_nesting_level;
+	int old_dbg_indent_amount;
+	struct de_detection_data_struct *old_detection_data;
+	const char *basefn;
+	const char *name_in_container;
+	size_t n;
+	int errflag;
+
+	if(!curpath) goto done;
+
+	old_infile = c->infile;
+	old_input_filename = c->input_filename;
+	old_suppress_detection_by_filename = c->suppress_detection_by_filename;
+	old_base_output_filename = c->base_output_filename;
+	old_file_count = c->file_count;
+	old_first_output_file = c->first_output_file;
+	old_max_output_files = c->max_output_files;
+	old_format_declared = c->format_declared;
+	old_module_nesting_level = c->module_nesting_level;
+	old_dbg_indent_amount = c->dbg_indent_amount;
+	old_detection_data = c->detection_data;
+
+	// The nested file is processed as if it were a top-level file, not by a
+	// submodule of the module that extracted it.
+	c->module_nesting_level = 0;
+	c->dbg_indent_amount = 0;
+	c->infile = f;
+	// Detection data describes a particular input file, so the nested file
+	// needs its own.
+	c->detection_data = NULL;
+	// The extracted file's name (with its extension) can help autodetection.
+	c->input_filename = name;
+	c->suppress_detection_by_filename = 0;
+
+	module_to_use = detect_module_for_file(c, &errflag);
+	if(errflag || !module_to_use) goto restore;
+	if(module_to_use->unique_id==1) goto restore; // id 1 == "unsupported"
+	if(module_to_use->flags&(DE_MODFLAG_SECURITYWARNING|DE_MODFLAG_NOEXTRACT)) {
+		de_dbg(c, "not recursing into %s (%s)", name, module_to_use->id);
+		goto restore;
+	}
+
+	// For messages, the path is made up of the part of each nested file's
+	// name that isn't just a copy of its container's name.
+	tmps = ucstring_create(c);
+	basefn = c->base_output_filename ? c->base_output_filename : "output";
+	name_in_container = name;
+	n = de_strlen(basefn);
+	if(!de_strncmp(name, basefn, n) && name[n]=='.') {
+		name_in_container = &name[n+1];
+	}
+	ucstring_append_sz(tmps, name_in_container, DE_ENCODING_UTF8);
+	if(!de_strarray_push(curpath, tmps)) goto restore;
+	ucstring_empty(tmps);
+	de_strarray_make_path(curpath, tmps, DE_MPFLAG_NOTRAILINGSLASH);
+	de_info(c, "Recursing into %s", ucstring_getpsz_d(tmps));
+	de_info(c, "Module: %s", module_to_use->id);
+
+	c->recurse_depth++;
+	c->base_output_filename = name;
+	c->file_count = 0;
+	c->first_output_file = 0;
+	c->max_output_files = -1;
+	c->format_declared = 0;
+
+	de_run_module(c, module_to_use, NULL, DE_MODDISP_AUTODETECT);
+
+	c->recurse_depth--;
+	de_strarray_pop(curpath);
+
+restore:
+	c->infile = old_infile;
+	c->input_filename = old_input_filename;
+	c->suppress_detection_by_filename = old_suppress_detection_by_filename;
+	c->base_output_filename = old_base_output_filename;
+	c->file_count = old_file_count;
+	c->first_output_file = old_first_output_file;
+	c->max_output_files = old_max_output_files;
+	c->format_declared = old_format_declared;
+	c->module_nesting_level = old_module_nesting_level;
+	c->dbg_indent_amount = old_dbg_indent_amount;
+	if(c->detection_data) {
+		de_free(c, c->detection_data);
+	}
+	c->detection_data = old_detection_data;
+	ucstring_destroy(tmps);
+
+done:
+	c->recurse_mem_used -= f->len;
+	dbuf_close(f);
 }
 
 static void open_extrlist(deark *c)
@@ -206,7 +471,7 @@ static void open_extrlist(deark *c)
 }
 
 // Returns 0 on "serious" error; e.g. input file not found.
-int de_run(deark *c)
+static int de_run_internal(deark *c)
 {
 	dbuf *orig_ifile = NULL;
 	dbuf *subfile = NULL;
@@ -262,6 +527,11 @@ int de_run(deark *c)
 		de_dbg(c, "Input file: %s[%d]", ucstring_getpsz_d(friendly_infn),
 			(int)c->slice_start_req);
 	}
+	else if(c->is_batch_item) {
+		// In batch mode, there's otherwise no way to tell which file the
+		// messages are about.
+		de_info(c, "Input file: %s", ucstring_getpsz_d(friendly_infn));
+	}
 	else {
 		de_dbg(c, "Input file: %s", ucstring_getpsz_d(friendly_infn));
 	}
@@ -337,6 +607,11 @@ int de_run(deark *c)
 	}
 
 	if(c->identify_only) {
+		if(orig_ifile->btype==DBUF_TYPE_IFILE) {
+			de_dbg(c, "bytes read from input file: %"I64_FMT" of %"I64_FMT,
+				orig_ifile->bytes_read_from_file, orig_ifile->len);
+		}
+
 		// Stop here, unless we're using the "unsupported" module.
 		if(module_to_use->unique_id!=1) {
 			goto done;
@@ -345,10 +620,13 @@ int de_run(deark *c)
 
 	de_dbg2(c, "file size: %" I64_FMT "", c->infile->len);
 
-	if(c->output_style==DE_OUTPUTSTYLE_ARCHIVE) {
+	if(c->output_style==DE_OUTPUTSTYLE_ARCHIVE ||
+		c->output_style==DE_OUTPUTSTYLE_CALLBACK)
+	{
 		subdirs_opt = de_get_ext_option_bool(c, "archive:subdirs", -1);
 		if(subdirs_opt<0) {
-			// By default, for archive output, enable subdirs unless -o was used.
+			// By default, for archive and callback output, enable subdirs
+			// unless -o was used.
 			if(!c->base_output_filename) {
 				c->allow_subdirs = 1;
 			}
@@ -363,7 +641,8 @@ int de_run(deark *c)
 		// By default, only keep dir entries if there is some way that
 		// files can be present in such a subdir.
 		c->keep_dir_entries = (u8)(
-			(c->output_style==DE_OUTPUTSTYLE_ARCHIVE) &&
+			(c->output_style==DE_OUTPUTSTYLE_ARCHIVE ||
+				c->output_style==DE_OUTPUTSTYLE_CALLBACK) &&
 			c->allow_subdirs &&
 			(!c->base_output_filename));
 	}
@@ -407,6 +686,28 @@ int de_run(deark *c)
 		c->list_mode_include_file_id = 1;
 	}
 
+	if(de_get_ext_option_bool(c, "verify", 0)) {
+		c->verify_mode = 1;
+	}
+
+	if(c->recurse_req) {
+		const char *s_opt;
+
+		c->recurse_max_depth = DE_DEFAULT_RECURSE_MAX_DEPTH;
+		s_opt = de_get_ext_option(c, "recurse:maxdepth");
+		if(s_opt) {
+			c->recurse_max_depth = de_atoi(s_opt);
+		}
+		c->recurse_max_mem = DE_DEFAULT_RECURSE_MAX_MEM;
+		s_opt = de_get_ext_option(c, "recurse:maxmem");
+		if(s_opt) {
+			c->recurse_max_mem = de_atoi64(s_opt);
+		}
+		if(c->recurse_max_depth>0 && !c->recurse_curpath) {
+			c->recurse_curpath = de_strarray_create(c, (size_t)c->recurse_max_depth);
+		}
+	}
+
 	if(c->modcodes_req) {
 		if(!mparams)
 			mparams = de_malloc(c, sizeof(de_module_params));
@@ -436,8 +737,19 @@ int de_run(deark *c)
 		de_info(c, "No files found to extract!");
 	}
 
+	if(c->list_mode && orig_ifile->btype==DBUF_TYPE_IFILE &&
+		!orig_ifile->cache_is_mapped)
+	{
+		de_dbg(c, "bytes read from input file: %"I64_FMT" of %"I64_FMT,
+			orig_ifile->bytes_read_from_file, orig_ifile->len);
+	}
+
 done:
-	if(c->extrlist_dbuf) { dbuf_close(c->extrlist_dbuf); c->extrlist_dbuf=NULL; }
+	// (In batch mode, the extrlist dbuf is owned by de_run_batch().)
+	if(c->extrlist_dbuf && !c->is_batch_item) {
+		dbuf_close(c->extrlist_dbuf);
+		c->extrlist_dbuf = NULL;
+	}
 	ucstring_destroy(friendly_infn);
 	if(subfile) dbuf_close(subfile);
 	if(orig_ifile) dbuf_close(orig_ifile);
@@ -445,6 +757,225 @@ done:
 	return c->serious_error_flag ? 0 : 1;
 }
 
+// Returns 0 on failure.
+// If a fatal error occurs, the process does not exit (unless the fatalerror
+// callback does that). Instead, this returns 0, and c can no longer be used
+// for anything except de_destroy().
+int de_run(deark *c)
+{
+	jmp_buf jb;
+	int ret;
+
+	if(c->fatal_error_flag) return 0;
+
+	c->run_thread_id = de_get_current_thread_id();
+	if(setjmp(jb)) {
+		// We got here from de_fatalerror().
+		c->fatalerror_jmpbuf = NULL;
+		de_release_resources_after_fatal_error(c);
+		return 0;
+	}
+	c->fatalerror_jmpbuf = &jb;
+	ret = de_run_internal(c);
+	c->fatalerror_jmpbuf = NULL;
+	return ret;
+}
+
+struct batch_item {
+	char *filename;
+	deark *c;
+	int ret;
+	struct de_workerpool_job *job;
+};
+
+struct batchctx {
+	deark *c;
+	de_batch_create_fn createfn;
+	de_batch_finish_fn finishfn;
+	struct de_workerpool *wp;
+	size_t max_queue_len;
+	size_t queue_len;
+	size_t queue_start;
+	struct batch_item *queue; // Circular buffer of [max_queue_len] items
+	int num_errors;
+};
+
+static void batch_job(void *userdata)
+{
+	struct batch_item *item = (struct batch_item*)userdata;
+
+	item->ret = de_run(item->c);
+}
+
+// Runs on the calling thread, in the same order the files were listed.
+static void batch_finish_oldest_item(struct batchctx *bctx)
+{
+	deark *c = bctx->c;
+	struct batch_item *item;
+
+	item = &bctx->queue[bctx->queue_start];
+	de_workerpool_finish_job(bctx->wp, item->job);
+	item->job = NULL;
+
+	if(item->c->extrlist_dbuf) {
+		if(c->extrlist_dbuf) {
+			dbuf_copy(item->c->extrlist_dbuf, 0, item->c->extrlist_dbuf->len,
+				c->extrlist_dbuf);
+			dbuf_flush(c->extrlist_dbuf);
+		}
+		dbuf_close(item->c->extrlist_dbuf);
+		item->c->extrlist_dbuf = NULL;
+	}
+
+	if(!item->ret) bctx->num_errors++;
+	bctx->finishfn(c, item->c, item->ret);
+	item->c = NULL;
+	de_free(c, item->filename);
+	item->filename = NULL;
+
+	bctx->queue_start = (bctx->queue_start+1) % bctx->max_queue_len;
+	bctx->queue_len--;
+}
+
+static void batch_add_file(struct batchctx *bctx, const char *fn, size_t fnlen)
+{
+	deark *c = bctx->c;
+	struct batch_item *item;
+
+	if(fnlen==0) return;
+
+	if(bctx->queue_len >= bctx->max_queue_len) {
+		batch_finish_oldest_item(bctx);
+	}
+
+	item = &bctx->queue[(bctx->queue_start+bctx->queue_len) % bctx->max_queue_len];
+	de_zeromem(item, sizeof(struct batch_item));
+	item->filename = de_malloc(c, (i64)fnlen+1);
+	de_memcpy(item->filename, fn, fnlen);
+	item->filename[fnlen] = '\0';
+
+	item->c = bctx->createfn(c, item->filename);
+	if(!item->c) {
+		bctx->num_errors++;
+		de_free(c, item->filename);
+		item->filename = NULL;
+		return;
+	}
+
+	// Share the parent's module table, instead of registering the modules
+	// again for every file.
+	if(!item->c->module_info) {
+		item->c->module_info = c->module_info;
+		item->c->num_modules = c->num_modules;
+		item->c->module_info_is_shared = 1;
+		item->c->sigindex = c->sigindex;
+	}
+	item->c->is_batch_item = 1;
+	// Parallelism is across files, so don't also use threads within a file.
+	item->c->num_threads = 0;
+
+	// The extrlist file is shared by all the input files, so each file's
+	// entries are collected in memory, and appended when the file is finished.
+	if(c->extrlist_dbuf) {
+		de_set_extrlist_filename(item->c, NULL);
+		item->c->extrlist_dbuf = dbuf_create_membuf(item->c, 0, 0);
+	}
+
+	bctx->queue_len++;
+	item->job = de_workerpool_submit(bctx->wp, batch_job, (void*)item);
+}
+
+static void batch_add_files_from_list(struct batchctx *bctx, dbuf *listf)
+{
+	deark *c = bctx->c;
+	i64 pos = 0;
+	i64 content_len, total_len;
+	char *fnbuf = NULL;
+	i64 fnbuf_alloc = 0;
+
+	// One filename per line. Blank lines are ignored.
+	while(dbuf_find_line(listf, pos, &content_len, &total_len)) {
+		if(content_len+1 > fnbuf_alloc) {
+			i64 new_alloc = content_len+1;
+
+			if(new_alloc<256) new_alloc = 256;
+			fnbuf = de_realloc(c, fnbuf, fnbuf_alloc, new_alloc);
+			fnbuf_alloc = new_alloc;
+		}
+		dbuf_read(listf, (u8*)fnbuf, pos, content_len);
+		batch_add_file(bctx, fnbuf, (size_t)content_len);
+		pos += total_len;
+	}
+
+	de_free(c, fnbuf);
+}
+
+// Runs de_run() on each of the files in fnarray[], followed by each of the
+// files named in list_filename (one per line). If list_filename is NULL, and
+// the input style is DE_INPUTSTYLE_STDIN, the list is read from stdin.
+// For each file, createfn is called to create and configure a new deark
+// context. If c->num_threads>0, the files are processed in parallel.
+// Returns 0 if any file had a serious error.
+int de_run_batch(deark *c, const char **fnarray, size_t num_fns,
+	const char *list_filename, de_batch_create_fn createfn,
+	de_batch_finish_fn finishfn)
+{
+	struct batchctx *bctx = NULL;
+	dbuf *listf = NULL;
+	size_t i;
+	int retval = 0;
+
+	bctx = de_malloc(c, sizeof(struct batchctx));
+	bctx->c = c;
+	bctx->createfn = createfn;
+	bctx->finishfn = finishfn;
+
+	if(c->extrlist_filename) {
+		open_extrlist(c);
+		if(c->serious_error_flag) goto done;
+	}
+
+	if(list_filename) {
+		listf = dbuf_open_input_file(c, list_filename);
+		if(!listf) goto done;
+	}
+	else if(c->input_style==DE_INPUTSTYLE_STDIN) {
+		listf = dbuf_open_input_stdin(c);
+		if(!listf) goto done;
+	}
+
+	de_register_modules(c);
+
+	bctx->wp = de_workerpool_create(c, c->num_threads);
+	// Let a few files get ahead of the oldest unfinished one, so that a single
+	// slow file doesn't leave the other threads idle.
+	bctx->max_queue_len = 1 + 2*(size_t)de_workerpool_get_nthreads(bctx->wp);
+	bctx->queue = de_mallocarray(c, (i64)bctx->max_queue_len, sizeof(struct batch_item));
+
+	for(i=0; i<num_fns; i++) {
+		batch_add_file(bctx, fnarray[i], de_strlen(fnarray[i]));
+	}
+	if(listf) {
+		batch_add_files_from_list(bctx, listf);
+	}
+
+	while(bctx->queue_len>0) {
+		batch_finish_oldest_item(bctx);
+	}
+
+	retval = (bctx->num_errors==0);
+
+done:
+	if(bctx) {
+		de_workerpool_destroy(bctx->wp);
+		de_free(c, bctx->queue);
+		de_free(c, bctx);
+	}
+	dbuf_close(listf);
+	if(c->extrlist_dbuf) { dbuf_close(c->extrlist_dbuf); c->extrlist_dbuf=NULL; }
+	return retval;
+}
+
 deark *de_create_internal(void)
 {
 	deark *c;
@@ -471,8 +1002,14 @@ deark *de_create_internal(void)
 void de_destroy(deark *c)
 {
 	i64 i;
+	struct de_mutex *mtx;
 
 	if(!c) return;
+
+	// After a fatal error, things may be in an inconsistent state, so don't
+	// try to clean up. Just free all the memory.
+	if(c->fatal_error_flag) goto free_memory;
+
 	if(c->zip_data) { de_zip_close_file(c); }
 	if(c->tar_data) { de_tar_close_file(c); }
 	if(c->extrlist_dbuf) { dbuf_close(c->extrlist_dbuf); }
@@ -484,7 +1021,19 @@ void de_destroy(deark *c)
 	if(c->output_archive_filename) { de_free(c, c->output_archive_filename); }
 	if(c->extrlist_filename) { de_free(c, c->extrlist_filename); }
 	if(c->detection_data) { de_free(c, c->detection_data); }
-	de_free(c, c->module_info);
+	if(c->crctables) { de_free(c, c->crctables); }
+	if(c->recurse_curpath) { de_strarray_destroy(c->recurse_curpath); }
+	if(!c->module_info_is_shared) {
+		sigindex_destroy(c, c->sigindex);
+		de_free(c, c->module_info);
+	}
+
+free_memory:
+	// Free anything that's left over, including any memory leaked by modules.
+	mtx = c->alloc_mtx;
+	c->alloc_mtx = NULL;
+	de_mutex_destroy(c, mtx);
+	de_free_all_allocations(c);
 	de_free(NULL,c);
 }
 
@@ -724,6 +1273,15 @@ void de_set_output_style(deark *c, int x, int subtype)
 	}
 }
 
+void de_set_output_callbacks(deark *c, de_output_open_fn openfn,
+	de_output_write_fn writefn, de_output_close_fn closefn, void *userdata)
+{
+	c->output_open_fn = openfn;
+	c->output_write_fn = writefn;
+	c->output_close_fn = closefn;
+	c->output_cb_userdata = userdata;
+}
+
 void de_set_debug_level(deark *c, int x)
 {
 	c->debug_level = x;
@@ -754,6 +1312,11 @@ void de_set_want_modhelp(deark *c, int x)
 	c->modhelp_req = x?1:0;
 }
 
+void de_set_recurse(deark *c, int x)
+{
+	c->recurse_req = x?1:0;
+}
+
 void de_set_id_mode(deark *c, int x)
 {
 	c->identify_only = x?1:0;
@@ -791,6 +1354,12 @@ void de_set_max_image_dimension(deark *c, i64 n)
 	c->max_image_dimension = n;
 }
 
+void de_set_num_threads(deark *c, int n)
+{
+	if(n<0) n=0;
+	c->num_threads = n;
+}
+
 void de_set_infomessages(deark *c, int x)
 {
 	c->show_infomessages = x;
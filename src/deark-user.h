@@ -23,8 +23,21 @@ void de_set_input_timezone(deark *c, i64 tzoffs_seconds);
 void de_set_input_file_slice_start(deark *c, i64 n);
 void de_set_input_file_slice_size(deark *c, i64 n);
 
+// Returns 0 on failure. After a fatal error, c may only be passed to
+// de_destroy(), which frees all the memory allocated with it.
+// Different deark objects can be used by different threads at the same time.
 int de_run(deark *c);
 
+// Batch mode. createfn must return a new, fully configured deark context for
+// the given input file (or NULL to skip it). finishfn is called on the
+// calling thread, in list order, after the file has been processed, and must
+// destroy item_c.
+typedef deark *(*de_batch_create_fn)(deark *c, const char *input_filename);
+typedef void (*de_batch_finish_fn)(deark *c, deark *item_c, int ret);
+int de_run_batch(deark *c, const char **fnarray, size_t num_fns,
+	const char *list_filename, de_batch_create_fn createfn,
+	de_batch_finish_fn finishfn);
+
 void de_print_module_list(deark *c);
 
 void de_set_userdata(deark *c, void *x);
@@ -43,11 +56,13 @@ void de_set_extract_level(deark *c, int x);
 void de_set_listmode(deark *c, int x);
 void de_set_want_modhelp(deark *c, int x);
 void de_set_id_mode(deark *c, int x);
+void de_set_recurse(deark *c, int x);
 void de_set_first_output_file(deark *c, int x);
 void de_set_max_output_files(deark *c, int n);
 void de_set_max_output_file_size(deark *c, i64 n);
 void de_set_max_total_output_size(deark *c, i64 n);
 void de_set_max_image_dimension(deark *c, i64 n);
+void de_set_num_threads(deark *c, int n);
 void de_set_infomessages(deark *c, int x);
 void de_set_warnings(deark *c, int x);
 
@@ -73,7 +88,9 @@ void de_set_ext_option(deark *c, const char *name, const char *val);
 void de_set_messages_callback(deark *c, de_msgfn_type fn);
 void de_set_special_messages_callback(deark *c, de_specialmsgfn_type fn);
 
-// The caller's fatalerror callback is not expected to return.
+// The fatalerror callback is called before a fatal error is handled. If it
+// returns, and the error happened during de_run(), de_run() will return 0.
+// Otherwise, the process will exit.
 void de_set_fatalerror_callback(deark *c, de_fatalerrorfn_type fn);
 
 void de_set_input_format(deark *c, const char *fmtname);
@@ -82,6 +99,10 @@ void de_set_module_init_codes(deark *c, const char *codes);
 // See DE_OUTPUTSTYLE_ defs in deark.h
 void de_set_output_style(deark *c, int x, int subtype);
 
+// For DE_OUTPUTSTYLE_CALLBACK. See de_output_open_fn, etc., in deark.h.
+void de_set_output_callbacks(deark *c, de_output_open_fn openfn,
+	de_output_write_fn writefn, de_output_close_fn closefn, void *userdata);
+
 void de_set_base_output_filename(deark *c, const char *dirname, const char *fn,
 	unsigned int flags);
 
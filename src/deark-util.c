@@ -295,18 +295,33 @@ void de_dbg3(deark *c, const char *fmt, ...)
 	va_end(ap);
 }
 
+// Decompressors that run in worker threads call the indent functions, but
+// they do not print debug messages, and must not touch the indent level that
+// belongs to the main thread. So only the thread running de_run() tracks it.
+static int is_indent_owner(deark *c)
+{
+	if(c->num_threads<1) return 1;
+	return (de_get_current_thread_id()==c->run_thread_id);
+}
+
 void de_dbg_indent(deark *c, int n)
 {
+	if(!is_indent_owner(c)) return;
 	c->dbg_indent_amount += n;
 }
 
 void de_dbg_indent_save(deark *c, int *saved_indent_level)
 {
+	if(!is_indent_owner(c)) {
+		*saved_indent_level = 0;
+		return;
+	}
 	*saved_indent_level = c->dbg_indent_amount;
 }
 
 void de_dbg_indent_restore(deark *c, int saved_indent_level)
 {
+	if(!is_indent_owner(c)) return;
 	c->dbg_indent_amount = saved_indent_level;
 }
 
@@ -639,14 +654,71 @@ void de_msg(deark *c, const char *fmt, ...)
 }
 
 // c can be NULL.
+// If this is called on the thread that is running de_run(), it does not
+// return, but jumps back to de_run(), which returns an error. Otherwise, it
+// ends the process.
 void de_fatalerror(deark *c)
 {
 	if(c && c->fatalerrorfn) {
 		c->fatalerrorfn(c);
 	}
+	if(c && c->fatalerror_jmpbuf && de_get_current_thread_id()==c->run_thread_id) {
+		c->fatal_error_flag = 1;
+		longjmp(*c->fatalerror_jmpbuf, 1);
+	}
 	de_exitprocess(1);
 }
 
+// Every memory block allocated by de_malloc() and friends starts with this
+// header. If the block was allocated with a deark context, it is on that
+// context's list of allocations, so that de_destroy() can free everything,
+// even after a fatal error.
+struct de_alloc_hdr {
+	deark *owner; // NULL if the block is not on any list
+	struct de_alloc_hdr *prev;
+	struct de_alloc_hdr *next;
+	unsigned int tag;
+};
+
+// The header size is a multiple of 16, so that we don't make the memory that
+// the caller sees less aligned than what malloc() returns.
+#define DE_ALLOC_HDR_SIZE 32
+
+static struct de_alloc_hdr *alloc_hdr_from_mem(void *m)
+{
+	return (struct de_alloc_hdr*)(((u8*)m) - DE_ALLOC_HDR_SIZE);
+}
+
+static void *mem_from_alloc_hdr(struct de_alloc_hdr *h)
+{
+	return (void*)(((u8*)h) + DE_ALLOC_HDR_SIZE);
+}
+
+static void alloc_list_add(deark *c, struct de_alloc_hdr *h)
+{
+	h->owner = c;
+	if(!c) return;
+	if(c->alloc_mtx) de_mutex_lock(c->alloc_mtx);
+	h->prev = NULL;
+	h->next = c->alloc_list;
+	if(c->alloc_list) c->alloc_list->prev = h;
+	c->alloc_list = h;
+	if(c->alloc_mtx) de_mutex_unlock(c->alloc_mtx);
+}
+
+static void alloc_list_remove(struct de_alloc_hdr *h)
+{
+	deark *c = h->owner;
+
+	if(!c) return;
+	if(c->alloc_mtx) de_mutex_lock(c->alloc_mtx);
+	if(h->prev) h->prev->next = h->next;
+	else c->alloc_list = h->next;
+	if(h->next) h->next->prev = h->prev;
+	if(c->alloc_mtx) de_mutex_unlock(c->alloc_mtx);
+	h->owner = NULL;
+}
+
 // TODO: Make de_malloc use de_mallocarray internally, instead of vice versa.
 void *de_mallocarray(deark *c, i64 nmemb, size_t membsize)
 {
@@ -659,12 +731,12 @@ void *de_mallocarray(deark *c, i64 nmemb, size_t membsize)
 	return de_malloc(c, nmemb*(i64)membsize);
 }
 
-// Memory returned is always zeroed.
-// c can be NULL.
-// Always succeeds; never returns NULL.
-void *de_malloc(deark *c, i64 n)
+// Like de_malloc, but also sets a DE_ALLOCTAG_* code, which tells
+// de_destroy() how to release the object after a fatal error.
+void *de_malloc_tagged(deark *c, i64 n, unsigned int tag)
 {
-	void *m;
+	struct de_alloc_hdr *h;
+
 	if(n==0) n=1;
 	if(n<0 || n>500000000) {
 		de_err(c, "Out of memory (%d bytes requested)",(int)n);
@@ -672,13 +744,24 @@ void *de_malloc(deark *c, i64 n)
 		return NULL;
 	}
 
-	m = calloc((size_t)n,1);
-	if(!m) {
+	h = calloc((size_t)n + DE_ALLOC_HDR_SIZE, 1);
+	if(!h) {
 		de_err(c, "Memory allocation failed (%d bytes)",(int)n);
 		de_fatalerror(c);
 		return NULL;
 	}
-	return m;
+	h->tag = tag;
+	alloc_list_add(c, h);
+	return mem_from_alloc_hdr(h);
+}
+
+// Memory returned is always zeroed.
+// c can be NULL. If not, the memory belongs to c, and will be freed by
+// de_destroy(c) if it hasn't been freed already.
+// Always succeeds; never returns NULL.
+void *de_malloc(deark *c, i64 n)
+{
+	return de_malloc_tagged(c, n, 0);
 }
 
 // TODO: Make de_realloc use de_reallocarray internally, instead of vice versa.
@@ -702,19 +785,34 @@ void *de_reallocarray(deark *c, void *m, i64 oldnmemb, size_t membsize,
 // If oldmem is NULL, this behaves the same as de_malloc, and all bytes are zeroed.
 void *de_realloc(deark *c, void *oldmem, i64 oldsize, i64 newsize)
 {
+	struct de_alloc_hdr *h;
+	deark *owner;
 	void *newmem;
 
 	if(!oldmem) {
 		return de_malloc(c, newsize);
 	}
 
-	newmem = realloc(oldmem, (size_t)newsize);
+	if(newsize<0 || newsize>500000000) {
+		de_err(c, "Out of memory (%d bytes requested)",(int)newsize);
+		de_fatalerror(c);
+		return NULL;
+	}
+
+	// The block may move, so take it off its owner's list while we realloc it.
+	h = alloc_hdr_from_mem(oldmem);
+	owner = h->owner;
+	alloc_list_remove(h);
+	newmem = realloc(h, (size_t)newsize + DE_ALLOC_HDR_SIZE);
 	if(!newmem) {
 		de_err(c, "Memory reallocation failed (%d bytes)",(int)newsize);
-		free(oldmem);
+		free(h);
 		de_fatalerror(c);
 		return NULL;
 	}
+	h = (struct de_alloc_hdr*)newmem;
+	alloc_list_add(owner, h);
+	newmem = mem_from_alloc_hdr(h);
 
 	if(oldsize<newsize) {
 		// zero out any newly-allocated bytes
@@ -724,9 +822,69 @@ void *de_realloc(deark *c, void *oldmem, i64 oldsize, i64 newsize)
 	return newmem;
 }
 
+// The memory is removed from the list of whichever context it was allocated
+// with, which need not be c.
 void de_free(deark *c, void *m)
 {
-	free(m);
+	struct de_alloc_hdr *h;
+
+	if(!m) return;
+	h = alloc_hdr_from_mem(m);
+	alloc_list_remove(h);
+	free(h);
+}
+
+// Frees all of c's memory that hasn't been freed yet.
+// Any other threads using c must have been stopped.
+void de_free_all_allocations(deark *c)
+{
+	struct de_alloc_hdr *h;
+
+	while(c->alloc_list) {
+		h = c->alloc_list;
+		c->alloc_list = h->next;
+		free(h);
+	}
+}
+
+// Returns one of c's live objects that was allocated with the given
+// DE_ALLOCTAG_* code, or NULL if there are none.
+void *de_find_tagged_allocation(deark *c, unsigned int tag)
+{
+	struct de_alloc_hdr *h;
+
+	for(h=c->alloc_list; h; h=h->next) {
+		if(h->tag==tag) {
+			return mem_from_alloc_hdr(h);
+		}
+	}
+	return NULL;
+}
+
+// Calls fn for each of c's live objects that were allocated with the given
+// DE_ALLOCTAG_* code. fn must not free or allocate memory.
+void de_foreach_tagged_allocation(deark *c, unsigned int tag,
+	void (*fn)(deark *c, void *m))
+{
+	struct de_alloc_hdr *h;
+
+	for(h=c->alloc_list; h; h=h->next) {
+		if(h->tag==tag) {
+			fn(c, mem_from_alloc_hdr(h));
+		}
+	}
+}
+
+// The returned string must be freed with de_free().
+char *de_strdup(deark *c, const char *s)
+{
+	char *s2;
+	size_t len;
+
+	len = de_strlen(s);
+	s2 = de_malloc(c, (i64)len+1);
+	de_memcpy(s2, s, len+1);
+	return s2;
 }
 
 // Returns the index into c->module_info[], or -1 if no found.
@@ -760,6 +918,32 @@ struct deark_module_info *de_get_module_by_id(deark *c, const char *module_id)
 	return &c->module_info[idx];
 }
 
+// For use by a module's getinfo function.
+// 'bytes' must be a string literal, or otherwise remain valid.
+void de_module_add_signature(deark *c, struct deark_module_info *mi, i64 offset,
+	const char *bytes, i64 len)
+{
+	int k;
+
+	if(offset<0 || offset>255 || len<1 || offset+len>DE_SIGINDEX_PREFIX_LEN) {
+		goto bad;
+	}
+	for(k=0; k<DE_MAX_MODULE_SIGNATURES; k++) {
+		if(mi->sig[k].len==0) {
+			mi->sig[k].bytes = bytes;
+			mi->sig[k].offset = (u8)offset;
+			mi->sig[k].len = (u8)len;
+			return;
+		}
+	}
+
+bad:
+	// A signature that was silently dropped could cause the module to be
+	// wrongly skipped, so treat this as a fatal internal error.
+	de_err(c, "Internal: Bad signature for module %s", mi->id);
+	de_fatalerror(c);
+}
+
 int de_run_module(deark *c, struct deark_module_info *mi, de_module_params *mparams,
 	enum de_moddisp_enum moddisp)
 {
@@ -1800,23 +1984,43 @@ int de_inthashtable_remove_any_item(deark *c, struct de_inthashtable *ht, i64 *p
 // crcobj: Functions for performing CRC calculations, and other checksum-like
 // functions for which the result can fit in a 32-bit int.l
 
+// Number of bytes processed per iteration by the "slicing-by-N" algorithms.
+#define DE_CRC_NSLICES 8
+
+// The lookup tables. There is one set per deark context, built on first use
+// and never changed after that, so that creating a crcobj is cheap.
+// Each CRC type has DE_CRC_NSLICES tables of 256 entries each. Table 0 is
+// the usual byte-at-a-time table. Table k gives the effect of a byte followed
+// by k zero bytes.
+struct de_crctables {
+	u32 crc32[256*DE_CRC_NSLICES];
+	u16 crc16ccitt[256*DE_CRC_NSLICES];
+	u16 crc16arc[256*DE_CRC_NSLICES];
+};
+
 struct de_crcobj {
 	u32 val;
 	unsigned int crctype;
+	unsigned int flags;
 	deark *c;
-	u16 *table16;
+	// For the CRC-16 types. Points into c->crctables.
+	const u16 *table16;
+	// For CRC-32. NULL if DE_CRCOBJ_FLAG_BYTEWISE is set.
+	const u32 *table32;
 };
 
 #define DE_CRC32_INIT 0
 
-// crc32_calc() is based on public domain code by Jon Mayo, downloaded
+// crc32_calc_bytewise() is based on public domain code by Jon Mayo, downloaded
 // from <http://orangetide.com/code/crc.c>.
 // It includes minor changes for Deark. I disclaim any copyright on these
 // minor changes. -JS
 // Note: I have found several other seemingly-independent implementations
 // of the same algorithm, such as the one by Karl Malbrain, used in miniz.
 // I don't know its origin.
-static u32 crc32_calc(const u8 *ptr, size_t cnt, u32 crc)
+// It is slow, but needs no tables to be set up. It is used only if
+// DE_CRCOBJ_FLAG_BYTEWISE is set.
+static u32 crc32_calc_bytewise(const u8 *ptr, size_t cnt, u32 crc)
 {
 	static const u32 crc32_tab[16] = {
 		0x00000000U, 0x1db71064U, 0x3b6e20c8U, 0x26d930acU,
@@ -1834,92 +2038,225 @@ static u32 crc32_calc(const u8 *ptr, size_t cnt, u32 crc)
 	return ~crc;
 }
 
-// For a one-shot CRC calculations, or the first part of a multi-part
-// calculation.
-// buf can be NULL (in which case buf_len should be 0, but is ignored)
-static u32 de_crc32(const void *buf, i64 buf_len)
+// Build the slicing-by-8 tables for the reflected polynomial 0xedb88320.
+static void crc32_make_tables(u32 *t)
 {
-	if(!buf) return DE_CRC32_INIT;
-	return (u32)crc32_calc((const u8*)buf, (size_t)buf_len, DE_CRC32_INIT);
+	UI i, k;
+
+	for(i=0; i<256; i++) {
+		u32 x = (u32)i;
+
+		for(k=0; k<8; k++) {
+			x = (x>>1) ^ ((x & 1) ? 0xedb88320U : 0);
+		}
+		t[i] = x;
+	}
+
+	for(k=1; k<DE_CRC_NSLICES; k++) {
+		for(i=0; i<256; i++) {
+			u32 x = t[(k-1)*256+i];
+			t[k*256+i] = (x>>8) ^ t[x & 0xff];
+		}
+	}
+}
+
+// Slicing-by-8: Processes 8 bytes per iteration, using 8 table lookups that
+// are independent of one another. The bytes are assembled manually, so
+// neither the alignment nor the byte order of the host matters.
+static u32 crc32_calc_sliced(const u32 *t, const u8 *ptr, size_t cnt, u32 crc)
+{
+	crc = ~crc;
+
+	while(cnt >= 8) {
+		u32 lo, hi;
+
+		lo = crc ^ ((u32)ptr[0] | ((u32)ptr[1]<<8) | ((u32)ptr[2]<<16) |
+			((u32)ptr[3]<<24));
+		hi = (u32)ptr[4] | ((u32)ptr[5]<<8) | ((u32)ptr[6]<<16) |
+			((u32)ptr[7]<<24);
+		crc = t[7*256 + (lo & 0xff)] ^
+			t[6*256 + ((lo>>8) & 0xff)] ^
+			t[5*256 + ((lo>>16) & 0xff)] ^
+			t[4*256 + (lo>>24)] ^
+			t[3*256 + (hi & 0xff)] ^
+			t[2*256 + ((hi>>8) & 0xff)] ^
+			t[1*256 + ((hi>>16) & 0xff)] ^
+			t[hi>>24];
+		ptr += 8;
+		cnt -= 8;
+	}
+
+	while(cnt--) {
+		crc = (crc>>8) ^ t[(crc ^ (u32)*ptr++) & 0xff];
+	}
+	return ~crc;
+}
+
+static void de_crc32_continue(struct de_crcobj *crco, const u8 *buf, i64 buf_len)
+{
+	if(crco->table32) {
+		crco->val = crc32_calc_sliced(crco->table32, buf, (size_t)buf_len, crco->val);
+	}
+	else {
+		crco->val = crc32_calc_bytewise(buf, (size_t)buf_len, crco->val);
+	}
 }
 
-static u32 de_crc32_continue(u32 prev_crc, const void *buf, i64 buf_len)
+// Fill in tables 1 through DE_CRC_NSLICES-1, given table 0.
+// is_reflected: 1 for LSB-first CRCs (e.g. ARC), 0 for MSB-first (e.g. CCITT).
+static void crc16_make_slices(u16 *t, int is_reflected)
 {
-	return (u32)crc32_calc((const u8*)buf, (size_t)buf_len, prev_crc);
+	UI i, k;
+
+	for(k=1; k<DE_CRC_NSLICES; k++) {
+		for(i=0; i<256; i++) {
+			UI x = (UI)t[(k-1)*256+i];
+
+			if(is_reflected) {
+				t[k*256+i] = (u16)((x>>8) ^ (UI)t[x & 0xff]);
+			}
+			else {
+				t[k*256+i] = (u16)(((x<<8) & 0xffff) ^ (UI)t[x>>8]);
+			}
+		}
+	}
 }
 
 // This is the CRC-16 algorithm used in MacBinary.
 // It is in the x^16 + x^12 + x^5 + 1 family.
 // CRC-16-CCITT is probably the best name for it, though I'm not completely
 // sure, and there are several algorithms that have been called "CRC-16-CCITT".
-static void de_crc16ccitt_init(struct de_crcobj *crco)
+static void crc16ccitt_make_tables(u16 *t)
 {
 	const unsigned int polynomial = 0x1021;
 	unsigned int index;
 
-	crco->table16 = de_mallocarray(crco->c, 256, sizeof(u16));
-	crco->table16[0] = 0;
+	t[0] = 0;
 	for(index=0; index<128; index++) {
-		unsigned int carry = crco->table16[index] & 0x8000;
-		unsigned int temp = (crco->table16[index] << 1) & 0xffff;
-		crco->table16[index * 2 + (carry ? 0 : 1)] = temp ^ polynomial;
-		crco->table16[index * 2 + (carry ? 1 : 0)] = temp;
+		unsigned int carry = t[index] & 0x8000;
+		unsigned int temp = (t[index] << 1) & 0xffff;
+		t[index * 2 + (carry ? 0 : 1)] = temp ^ polynomial;
+		t[index * 2 + (carry ? 1 : 0)] = temp;
 	}
+	crc16_make_slices(t, 0);
 }
 
 static void de_crc16ccitt_continue(struct de_crcobj *crco, const u8 *buf, i64 buf_len)
 {
-	i64 k;
+	const u16 *t = crco->table16;
+	u32 crc;
+	i64 k = 0;
+
+	if(!t) return;
+	crc = crco->val;
+
+	if(!(crco->flags & DE_CRCOBJ_FLAG_BYTEWISE)) {
+		for(; k+8<=buf_len; k+=8) {
+			const u8 *p = &buf[k];
+
+			crc = (u32)t[7*256 + (((crc>>8) ^ (u32)p[0]) & 0xff)] ^
+				(u32)t[6*256 + ((crc ^ (u32)p[1]) & 0xff)] ^
+				(u32)t[5*256 + p[2]] ^
+				(u32)t[4*256 + p[3]] ^
+				(u32)t[3*256 + p[4]] ^
+				(u32)t[2*256 + p[5]] ^
+				(u32)t[1*256 + p[6]] ^
+				(u32)t[p[7]];
+		}
+	}
 
-	if(!crco->table16) return;
-	for(k=0; k<buf_len; k++) {
-		crco->val = ((crco->val<<8)&0xffff) ^
-			(u32)crco->table16[((crco->val>>8) ^ (u32)buf[k]) & 0xff];
+	for(; k<buf_len; k++) {
+		crc = ((crc<<8)&0xffff) ^ (u32)t[((crc>>8) ^ (u32)buf[k]) & 0xff];
 	}
+	crco->val = crc;
 }
 
 // This is the CRC-16 algorithm used in ARC, LHA, ZOO, etc.
 // It is in the x^16 + x^15 + x^2 + 1 family.
 // It's some variant of CRC-16-IBM, and sometimes simply called "CRC-16". But
 // both these names are more ambiguous than I'd like, so I'm calling it "ARC".
-static void de_crc16arc_init(struct de_crcobj *crco)
+static void crc16arc_make_tables(u16 *t)
 {
 	u32 i, k;
 
-	crco->table16 = de_mallocarray(crco->c, 256, sizeof(u16));
 	for(i=0; i<256; i++) {
-		crco->table16[i] = i;
+		t[i] = i;
 		for(k=0; k<8; k++)
-			crco->table16[i] = (crco->table16[i]>>1) ^ ((crco->table16[i] & 1) ? 0xa001 : 0);
+			t[i] = (t[i]>>1) ^ ((t[i] & 1) ? 0xa001 : 0);
 	}
+	crc16_make_slices(t, 1);
 }
 
 static void de_crc16arc_continue(struct de_crcobj *crco, const u8 *buf, i64 buf_len)
 {
-	i64 k;
+	const u16 *t = crco->table16;
+	u32 crc;
+	i64 k = 0;
+
+	if(!t) return;
+	crc = crco->val;
+
+	if(!(crco->flags & DE_CRCOBJ_FLAG_BYTEWISE)) {
+		for(; k+8<=buf_len; k+=8) {
+			const u8 *p = &buf[k];
+
+			crc = (u32)t[7*256 + ((crc ^ (u32)p[0]) & 0xff)] ^
+				(u32)t[6*256 + (((crc>>8) ^ (u32)p[1]) & 0xff)] ^
+				(u32)t[5*256 + p[2]] ^
+				(u32)t[4*256 + p[3]] ^
+				(u32)t[3*256 + p[4]] ^
+				(u32)t[2*256 + p[5]] ^
+				(u32)t[1*256 + p[6]] ^
+				(u32)t[p[7]];
+		}
+	}
 
-	if(!crco->table16) return;
-	for(k=0; k<buf_len; k++) {
-		crco->val = ((crco->val>>8) ^
-			(u32)crco->table16[(crco->val ^ buf[k]) & 0xff]);
+	for(; k<buf_len; k++) {
+		crc = (crc>>8) ^ (u32)t[(crc ^ (u32)buf[k]) & 0xff];
 	}
+	crco->val = crc;
+}
+
+// Builds c's CRC tables, if they don't exist yet.
+// This is not thread-safe. Worker threads may still create crcobjs, because
+// de_workerpool_create() calls this before it starts any threads.
+void de_crc_init_tables(deark *c)
+{
+	struct de_crctables *t;
+
+	if(c->crctables) return;
+	t = de_malloc(c, sizeof(struct de_crctables));
+	crc32_make_tables(t->crc32);
+	crc16ccitt_make_tables(t->crc16ccitt);
+	crc16arc_make_tables(t->crc16arc);
+	c->crctables = t;
 }
 
 // Allocate, initializes, and resets a new object
+// flags: One of the DE_CRCOBJ_* CRC types, optionally combined with
+// DE_CRCOBJ_FLAG_*.
 struct de_crcobj *de_crcobj_create(deark *c, unsigned int flags)
 {
 	struct de_crcobj *crco;
 
+	de_crc_init_tables(c);
+
 	crco = de_malloc(c, sizeof(struct de_crcobj));
 	crco->c = c;
-	crco->crctype = flags;
+	crco->crctype = flags & DE_CRCOBJ_TYPEMASK;
+	crco->flags = flags & ~DE_CRCOBJ_TYPEMASK;
 
 	switch(crco->crctype) {
+	case DE_CRCOBJ_CRC32_IEEE:
+		if(!(crco->flags & DE_CRCOBJ_FLAG_BYTEWISE)) {
+			crco->table32 = c->crctables->crc32;
+		}
+		break;
 	case DE_CRCOBJ_CRC16_CCITT:
-		de_crc16ccitt_init(crco);
+		crco->table16 = c->crctables->crc16ccitt;
 		break;
 	case DE_CRCOBJ_CRC16_ARC:
-		de_crc16arc_init(crco);
+		crco->table16 = c->crctables->crc16arc;
 		break;
 	}
 
@@ -1929,12 +2266,8 @@ struct de_crcobj *de_crcobj_create(deark *c, unsigned int flags)
 
 void de_crcobj_destroy(struct de_crcobj *crco)
 {
-	deark *c;
-
 	if(!crco) return;
-	c = crco->c;
-	de_free(c, crco->table16);
-	de_free(c, crco);
+	de_free(crco->c, crco);
 }
 
 void de_crcobj_reset(struct de_crcobj *crco)
@@ -1943,7 +2276,7 @@ void de_crcobj_reset(struct de_crcobj *crco)
 
 	switch(crco->crctype) {
 	case DE_CRCOBJ_CRC32_IEEE:
-		crco->val = de_crc32(NULL, 0);
+		crco->val = DE_CRC32_INIT;
 		break;
 	}
 }
@@ -1959,7 +2292,7 @@ void de_crcobj_addbuf(struct de_crcobj *crco, const u8 *buf, i64 buf_len)
 
 	switch(crco->crctype) {
 	case DE_CRCOBJ_CRC32_IEEE:
-		crco->val = de_crc32_continue(crco->val, buf, buf_len);
+		de_crc32_continue(crco, buf, buf_len);
 		break;
 	case DE_CRCOBJ_CRC16_CCITT:
 		de_crc16ccitt_continue(crco, buf, buf_len);
@@ -1972,11 +2305,13 @@ void de_crcobj_addbuf(struct de_crcobj *crco, const u8 *buf, i64 buf_len)
 
 void de_crcobj_addzeroes(struct de_crcobj *crco, i64 len)
 {
-	i64 i;
-	const u8 z = 0;
+	static const u8 zeroes[256] = { 0 };
+
+	while(len>0) {
+		i64 n = de_min_int(len, (i64)sizeof(zeroes));
 
-	for(i=0; i<len; i++) {
-		de_crcobj_addbuf(crco, &z, 1);
+		de_crcobj_addbuf(crco, zeroes, n);
+		len -= n;
 	}
 }
 
@@ -2017,3 +2352,184 @@ int de_archive_initialize(deark *c)
 	}
 	return 0;
 }
+
+// workerpool: A simple thread pool.
+
+#define DE_MAX_WORKER_THREADS 64
+
+struct de_workerpool_job {
+	de_workerpool_job_fn fn;
+	void *userdata;
+	struct de_workerpool_job *next;
+	u8 done;
+};
+
+struct de_workerpool {
+	deark *c;
+	int nthreads;
+	struct de_thread **threads;
+	struct de_mutex *mtx; // Protects the queue, and the jobs' 'done' flags
+	struct de_semaphore *sem_queue; // Posted once per job, and once per thread at shutdown
+	struct de_semaphore *sem_done; // Posted whenever a job finishes
+	struct de_workerpool_job *queue_head;
+	struct de_workerpool_job *queue_tail;
+};
+
+static void workerpool_thread_fn(void *userdata)
+{
+	struct de_workerpool *wp = (struct de_workerpool*)userdata;
+	struct de_workerpool_job *job;
+
+	while(1) {
+		de_semaphore_wait(wp->sem_queue);
+
+		de_mutex_lock(wp->mtx);
+		job = wp->queue_head;
+		if(job) {
+			wp->queue_head = job->next;
+			if(!wp->queue_head) wp->queue_tail = NULL;
+		}
+		de_mutex_unlock(wp->mtx);
+
+		// An empty queue means we're shutting down.
+		if(!job) break;
+
+		job->fn(job->userdata);
+
+		de_mutex_lock(wp->mtx);
+		job->done = 1;
+		de_mutex_unlock(wp->mtx);
+		de_semaphore_post(wp->sem_done);
+	}
+}
+
+// If nthreads<1, or threads can't be created, jobs will be run synchronously.
+struct de_workerpool *de_workerpool_create(deark *c, int nthreads)
+{
+	struct de_workerpool *wp;
+	int i;
+
+	wp = de_malloc_tagged(c, sizeof(struct de_workerpool), DE_ALLOCTAG_WORKERPOOL);
+	wp->c = c;
+	if(nthreads<1) return wp;
+	if(nthreads>DE_MAX_WORKER_THREADS) nthreads = DE_MAX_WORKER_THREADS;
+
+	// The worker threads may allocate memory with c.
+	if(!c->alloc_mtx) {
+		c->alloc_mtx = de_mutex_create(c);
+	}
+	// ... and create crcobjs.
+	de_crc_init_tables(c);
+
+	wp->mtx = de_mutex_create(c);
+	wp->sem_queue = de_semaphore_create(c);
+	wp->sem_done = de_semaphore_create(c);
+	wp->threads = de_mallocarray(c, nthreads, sizeof(struct de_thread*));
+
+	for(i=0; i<nthreads; i++) {
+		wp->threads[i] = de_thread_create(c, workerpool_thread_fn, (void*)wp);
+		if(!wp->threads[i]) {
+			de_warn(c, "Failed to create thread");
+			break;
+		}
+		wp->nthreads++;
+	}
+
+	de_dbg(c, "worker threads: %d", wp->nthreads);
+	return wp;
+}
+
+// Called by de_run() after a fatal error. Stops any worker threads (after
+// they finish their jobs, so that they are no longer using c's memory), and
+// closes any open files.
+// The memory itself is freed later, by de_destroy().
+void de_release_resources_after_fatal_error(deark *c)
+{
+	struct de_workerpool *wp;
+
+	while(1) {
+		wp = (struct de_workerpool*)de_find_tagged_allocation(c, DE_ALLOCTAG_WORKERPOOL);
+		if(!wp) break;
+		de_workerpool_destroy(wp);
+	}
+
+	de_foreach_tagged_allocation(c, DE_ALLOCTAG_DBUF, dbuf_release_os_resources);
+}
+
+int de_workerpool_get_nthreads(struct de_workerpool *wp)
+{
+	return wp->nthreads;
+}
+
+// Waits for all threads to finish.
+void de_workerpool_destroy(struct de_workerpool *wp)
+{
+	deark *c;
+	int i;
+
+	if(!wp) return;
+	c = wp->c;
+
+	for(i=0; i<wp->nthreads; i++) {
+		de_semaphore_post(wp->sem_queue);
+	}
+	for(i=0; i<wp->nthreads; i++) {
+		de_thread_join(c, wp->threads[i]);
+	}
+
+	de_free(c, wp->threads);
+	de_semaphore_destroy(c, wp->sem_queue);
+	de_semaphore_destroy(c, wp->sem_done);
+	de_mutex_destroy(c, wp->mtx);
+	de_free(c, wp);
+}
+
+struct de_workerpool_job *de_workerpool_submit(struct de_workerpool *wp,
+	de_workerpool_job_fn fn, void *userdata)
+{
+	struct de_workerpool_job *job;
+
+	job = de_malloc(wp->c, sizeof(struct de_workerpool_job));
+	job->fn = fn;
+	job->userdata = userdata;
+
+	if(wp->nthreads<1) {
+		fn(userdata);
+		job->done = 1;
+		return job;
+	}
+
+	de_mutex_lock(wp->mtx);
+	if(wp->queue_tail) {
+		wp->queue_tail->next = job;
+	}
+	else {
+		wp->queue_head = job;
+	}
+	wp->queue_tail = job;
+	de_mutex_unlock(wp->mtx);
+	de_semaphore_post(wp->sem_queue);
+	return job;
+}
+
+int de_workerpool_job_is_done(struct de_workerpool *wp, struct de_workerpool_job *job)
+{
+	int done;
+
+	if(wp->nthreads<1) return 1;
+	de_mutex_lock(wp->mtx);
+	done = (int)job->done;
+	de_mutex_unlock(wp->mtx);
+	return done;
+}
+
+// Waits for the job to finish, then frees it.
+void de_workerpool_finish_job(struct de_workerpool *wp, struct de_workerpool_job *job)
+{
+	if(!job) return;
+	while(!de_workerpool_job_is_done(wp, job)) {
+		// Some job finished. Maybe it was this one.
+		de_semaphore_wait(wp->sem_done);
+	}
+	de_free(wp->c, job);
+}
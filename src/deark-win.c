@@ -11,6 +11,8 @@
 #ifdef DE_WINDOWS
 
 #include <windows.h>
+#include <process.h>
+#include <io.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -39,19 +41,6 @@ void de_vsnprintf(char *buf, size_t buflen, const char *fmt, va_list ap)
 	_vsnprintf_s(buf, buflen, _TRUNCATE, fmt, ap);
 }
 
-char *de_strdup(deark *c, const char *s)
-{
-	char *s2;
-
-	s2 = _strdup(s);
-	if(!s2) {
-		de_err(c, "Memory allocation failed");
-		de_fatalerror(c);
-		return NULL;
-	}
-	return s2;
-}
-
 i64 de_strtoll(const char *string, char **endptr, int base)
 {
 	return _strtoi64(string, endptr, base);
@@ -282,6 +271,40 @@ int de_fclose(FILE *fp)
 	return fclose(fp);
 }
 
+// Map the first len bytes of fp. Returns NULL if that can't be done.
+// Windows won't let a file be truncated while it is mapped.
+u8 *de_mmap_file(FILE *fp, i64 len)
+{
+	HANDLE fh;
+	HANDLE mh;
+	void *mem;
+	struct __stat64 stbuf;
+
+	if(len<1 || (i64)(SIZE_T)len!=len) return NULL;
+	de_zeromem(&stbuf, sizeof(struct __stat64));
+	if(0 != _fstat64(_fileno(fp), &stbuf)) return NULL;
+	if(!(stbuf.st_mode & _S_IFREG)) return NULL;
+	if((i64)stbuf.st_size < len) return NULL;
+	fh = (HANDLE)_get_osfhandle(_fileno(fp));
+	if(fh==INVALID_HANDLE_VALUE) return NULL;
+	mh = CreateFileMappingW(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!mh) return NULL;
+	mem = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, (SIZE_T)len);
+	// The view keeps a reference to the mapping object.
+	CloseHandle(mh);
+	return (u8*)mem;
+}
+
+void de_munmap_file(u8 *mem, i64 len)
+{
+	UnmapViewOfFile((LPCVOID)mem);
+}
+
+i64 de_copy_file_range(FILE *infp, i64 inpos, FILE *outfp, i64 outpos, i64 len)
+{
+	return 0;
+}
+
 static void update_file_time(dbuf *f)
 {
 	WCHAR *fnW = NULL;
@@ -487,6 +510,115 @@ void de_current_time_to_timestamp(struct de_timestamp *ts)
 	de_FILETIME_to_timestamp(ft, ts, 0x1);
 }
 
+struct de_thread {
+	HANDLE h;
+	de_thread_fn fn;
+	void *userdata;
+};
+
+static unsigned int __stdcall thread_start_fn(void *userdata)
+{
+	struct de_thread *th = (struct de_thread*)userdata;
+
+	th->fn(th->userdata);
+	return 0;
+}
+
+// Returns NULL on failure.
+struct de_thread *de_thread_create(deark *c, de_thread_fn fn, void *userdata)
+{
+	struct de_thread *th;
+
+	th = de_malloc(c, sizeof(struct de_thread));
+	th->fn = fn;
+	th->userdata = userdata;
+	// Use _beginthreadex, not CreateThread, since the thread uses the C library.
+	th->h = (HANDLE)_beginthreadex(NULL, 0, thread_start_fn, (void*)th, 0, NULL);
+	if(!th->h) {
+		de_free(c, th);
+		return NULL;
+	}
+	return th;
+}
+
+// Waits for the thread to finish, and frees th.
+void de_thread_join(deark *c, struct de_thread *th)
+{
+	if(!th) return;
+	WaitForSingleObject(th->h, INFINITE);
+	CloseHandle(th->h);
+	de_free(c, th);
+}
+
+struct de_mutex {
+	CRITICAL_SECTION cs;
+};
+
+struct de_mutex *de_mutex_create(deark *c)
+{
+	struct de_mutex *mtx;
+
+	mtx = de_malloc(c, sizeof(struct de_mutex));
+	InitializeCriticalSection(&mtx->cs);
+	return mtx;
+}
+
+void de_mutex_destroy(deark *c, struct de_mutex *mtx)
+{
+	if(!mtx) return;
+	DeleteCriticalSection(&mtx->cs);
+	de_free(c, mtx);
+}
+
+void de_mutex_lock(struct de_mutex *mtx)
+{
+	EnterCriticalSection(&mtx->cs);
+}
+
+void de_mutex_unlock(struct de_mutex *mtx)
+{
+	LeaveCriticalSection(&mtx->cs);
+}
+
+u64 de_get_current_thread_id(void)
+{
+	return (u64)GetCurrentThreadId();
+}
+
+struct de_semaphore {
+	HANDLE h;
+};
+
+struct de_semaphore *de_semaphore_create(deark *c)
+{
+	struct de_semaphore *sem;
+
+	sem = de_malloc(c, sizeof(struct de_semaphore));
+	sem->h = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+	if(!sem->h) {
+		de_err(c, "Failed to create semaphore");
+		de_fatalerror(c);
+	}
+	return sem;
+}
+
+void de_semaphore_destroy(deark *c, struct de_semaphore *sem)
+{
+	if(!sem) return;
+	CloseHandle(sem->h);
+	de_free(c, sem);
+}
+
+void de_semaphore_post(struct de_semaphore *sem)
+{
+	ReleaseSemaphore(sem->h, 1, NULL);
+}
+
+void de_semaphore_wait(struct de_semaphore *sem)
+{
+	WaitForSingleObject(sem->h, INFINITE);
+}
+
 void de_exitprocess(int s)
 {
 	exit(s);
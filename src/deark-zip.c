@@ -41,6 +41,42 @@ struct zipw_md {
 	dbuf *efcentral;
 };
 
+// Members larger than this are streamed to the ZIP file, if possible.
+#define ZIPW_STREAMING_THRESHOLD 1048576
+// Size of the local extra field we reserve for streamed members.
+#define ZIPW_RESERVED_EF_LEN 20
+
+struct zipw_member {
+	deark *c;
+	struct zipw_md *md;
+	char *name; // The name to write. Directory names end with "/".
+	unsigned int level_and_flags;
+	dbuf *data; // Buffered data. NULL after streaming has started.
+	struct zipw_member *next_queued;
+	u8 is_finished; // Set when the member file has been closed
+
+	// Set by zipw_compress_member(), which may run in a worker thread
+	struct de_workerpool_job *job;
+	dbuf *cmpr_data;
+	u8 using_compression;
+	u8 cmpr_failed;
+
+	unsigned int ver_needed;
+	unsigned int bit_flags;
+	unsigned int cmpr_method;
+	u32 crc;
+	i64 cmpr_len;
+	i64 uncmpr_len;
+	i64 ldir_offset;
+
+	// Used if is_streaming is set
+	u8 is_streaming;
+	i64 reserved_ef_pos;
+	i64 cmpr_data_pos;
+	struct de_crcobj *crco;
+	struct fmtutil_tdefl_ctx *tdctx; // NULL if not compressing
+};
+
 struct zipw_ctx {
 	deark *c;
 	const char *pFilename;
@@ -48,7 +84,13 @@ struct zipw_ctx {
 	i64 membercount;
 	dbuf *outf;
 	dbuf *cdir; // central directory
-	struct de_crcobj *crc32o;
+	int opt_zip64; // 1=always, 0=never, -1=auto
+	// Members that have not been written yet, in the order they were created
+	struct zipw_member *queue_head;
+	struct zipw_member *queue_tail;
+	i64 queue_len; // Number of finished members in the queue
+	i64 max_queue_len;
+	struct de_workerpool *wp; // NULL if not using threads
 };
 
 static int is_valid_32bit_unix_time(i64 ut)
@@ -67,9 +109,17 @@ int de_zip_create_file(deark *c)
 	zzz = de_malloc(c, sizeof(struct zipw_ctx));
 	zzz->c = c;
 	c->zip_data = (void*)zzz;
-	zzz->crc32o = de_crcobj_create(c, DE_CRCOBJ_CRC32_IEEE);
+
+	// Note: The low-level dbuf functions may print debugging messages at -d3,
+	// and message printing is not thread-safe.
+	if(c->num_threads>0 && c->debug_level<3) {
+		zzz->wp = de_workerpool_create(c, c->num_threads);
+		// Limit how many finished members can be held in memory.
+		zzz->max_queue_len = 2*(i64)de_workerpool_get_nthreads(zzz->wp);
+	}
 
 	zzz->cmprlevel = MZ_BEST_COMPRESSION; // default
+	zzz->opt_zip64 = de_get_ext_option_bool(c, "archive:zip64", -1);
 	opt_level = de_get_ext_option(c, "archive:zipcmprlevel");
 	if(opt_level) {
 		i64 opt_level_n = de_atoi64(opt_level);
@@ -215,31 +265,25 @@ static void do_ntfs_times(deark *c, struct zipw_md *md,
 	dbuf_writeu64le(ef, crtm);
 }
 
+// Note: This may run in a worker thread, so it doesn't print anything.
 static int my_deflate_cbfn(struct de_bufferedreadctx *brctx, const u8 *buf,
 	i64 buf_len)
 {
 	struct fmtutil_tdefl_ctx *tdctx = (struct fmtutil_tdefl_ctx*)brctx->userdata;
 	enum fmtutil_tdefl_status ret;
-	int retval = 0;
 
 	if(!brctx->eof_flag) {
 		// We could handle this case pretty easily, but it can't happen, due to
 		// how dbuf_buffered_read() handles membufs.
-		goto done;
+		return 0;
 	}
 
 	ret = fmtutil_tdefl_compress_buffer(tdctx, buf, buf_len, FMTUTIL_TDEFL_FINISH);
-	if(ret != FMTUTIL_TDEFL_STATUS_DONE) goto done;
-	retval = 1;
-
-done:
-	if(retval==0) {
-		de_err(brctx->c, "Deflate compression error");
-	}
-	return retval;
+	if(ret != FMTUTIL_TDEFL_STATUS_DONE) return 0;
+	return 1;
 }
 
-static int zipw_deflate(deark *c, struct zipw_ctx *zzz, dbuf *uncmpr_data,
+static int zipw_deflate(deark *c, dbuf *uncmpr_data,
 	dbuf *cmpr_data, unsigned int level)
 {
 	int retval = 0;
@@ -257,19 +301,185 @@ done:
 	return retval;
 }
 
-static void zipw_add_memberfile(deark *c, struct zipw_ctx *zzz, struct zipw_md *md,
-	dbuf *f, const char *name, unsigned int level_and_flags)
+static unsigned int zipw_get_level(struct zipw_member *mbr)
+{
+	if((int)mbr->level_and_flags < 0)
+		return MZ_DEFAULT_LEVEL;
+	return mbr->level_and_flags & 0xF;
+}
+
+static void zipw_set_cmpr_bit_flags(struct zipw_member *mbr, unsigned int level)
+{
+	// This is the logic used by Info-Zip
+	if(level<=2) mbr->bit_flags |= 4;
+	else if(level>=8) mbr->bit_flags |= 2;
+}
+
+// Write the local header, using the fields in mbr.
+// If mbr->is_streaming, we don't know the sizes or CRC yet. We write zeroes,
+// and reserve space for a Zip64 extra field, to be patched by
+// zipw_finish_streaming().
+static void zipw_write_local_header(deark *c, struct zipw_ctx *zzz, struct zipw_member *mbr)
 {
-	i64 ldir_offset;
 	i64 fnlen;
-	u32 crc;
-	int try_compression = 0;
-	int using_compression = 0;
-	dbuf *cmpr_data = NULL;
-	i64 cmpr_len;
-	unsigned int bit_flags = 0;
+	i64 eflen;
+
+	fnlen = de_strlen(mbr->name);
+	eflen = mbr->md->eflocal->len;
+	if(mbr->is_streaming) {
+		eflen += ZIPW_RESERVED_EF_LEN;
+	}
+
+	dbuf_writeu32le(zzz->outf, CODE_PK34);
+	dbuf_writeu16le(zzz->outf, mbr->ver_needed);
+	dbuf_writeu16le(zzz->outf, mbr->bit_flags);
+	dbuf_writeu16le(zzz->outf, mbr->cmpr_method);
+	dbuf_writeu16le(zzz->outf, mbr->md->modtime_dostime);
+	dbuf_writeu16le(zzz->outf, mbr->md->modtime_dosdate);
+	dbuf_writeu32le(zzz->outf, mbr->crc);
+	dbuf_writeu32le(zzz->outf, mbr->cmpr_len);
+	dbuf_writeu32le(zzz->outf, mbr->uncmpr_len);
+	dbuf_writeu16le(zzz->outf, fnlen);
+	dbuf_writeu16le(zzz->outf, eflen);
+	dbuf_write(zzz->outf, (const u8*)mbr->name, fnlen);
+	dbuf_copy(mbr->md->eflocal, 0, mbr->md->eflocal->len, zzz->outf);
+
+	if(mbr->is_streaming) {
+		// A "growth hint" field, to be overwritten with a Zip64 field if needed.
+		mbr->reserved_ef_pos = zzz->outf->len;
+		dbuf_writeu16le(zzz->outf, 0xa220);
+		dbuf_writeu16le(zzz->outf, ZIPW_RESERVED_EF_LEN-4);
+		dbuf_writeu16le(zzz->outf, 0xa028); // signature
+		dbuf_writeu16le(zzz->outf, 0); // initial padding value
+		dbuf_write_zeroes(zzz->outf, ZIPW_RESERVED_EF_LEN-8);
+	}
+}
+
+// Write the central directory entry, using the fields in mbr.
+static void zipw_write_cdir_entry(deark *c, struct zipw_ctx *zzz, struct zipw_member *mbr)
+{
+	i64 fnlen;
+	i64 num_zip64_fields = 0;
 	unsigned int ext_attributes;
 	unsigned int ver_needed;
+	u8 zip64_uncmpr_len = 0;
+	u8 zip64_cmpr_len = 0;
+	u8 zip64_offset = 0;
+
+	if(mbr->uncmpr_len >= 0xffffffffLL) {
+		zip64_uncmpr_len = 1;
+		num_zip64_fields++;
+	}
+	if(mbr->cmpr_len >= 0xffffffffLL) {
+		zip64_cmpr_len = 1;
+		num_zip64_fields++;
+	}
+	if(mbr->ldir_offset >= 0xffffffffLL) {
+		zip64_offset = 1;
+		num_zip64_fields++;
+	}
+
+	ver_needed = mbr->ver_needed;
+	if(num_zip64_fields>0 && ver_needed<45) {
+		ver_needed = 45;
+	}
+
+	dbuf_writeu32le(zzz->cdir, CODE_PK12);
+	dbuf_writeu16le(zzz->cdir, ZIPENC_VER_MADE_BY);
+	dbuf_writeu16le(zzz->cdir, ver_needed);
+	dbuf_writeu16le(zzz->cdir, mbr->bit_flags);
+	dbuf_writeu16le(zzz->cdir, mbr->cmpr_method);
+	dbuf_writeu16le(zzz->cdir, mbr->md->modtime_dostime);
+	dbuf_writeu16le(zzz->cdir, mbr->md->modtime_dosdate);
+	dbuf_writeu32le(zzz->cdir, mbr->crc);
+	dbuf_writeu32le(zzz->cdir, zip64_cmpr_len ? 0xffffffffLL : mbr->cmpr_len);
+	dbuf_writeu32le(zzz->cdir, zip64_uncmpr_len ? 0xffffffffLL : mbr->uncmpr_len);
+
+	fnlen = de_strlen(mbr->name);
+	dbuf_writeu16le(zzz->cdir, fnlen);
+	dbuf_writeu16le(zzz->cdir, mbr->md->efcentral->len +
+		((num_zip64_fields>0) ? (4+8*num_zip64_fields) : 0)); // eflen
+	dbuf_writeu16le(zzz->cdir, 0); // file comment len
+	dbuf_writeu16le(zzz->cdir, 0); // disk number start
+	dbuf_writeu16le(zzz->cdir, 0); // int attrib
+
+	// Set the Unix (etc.) file attributes to "-rw-r--r--" or
+	// "-rwxr-xr-x", etc.
+	if(mbr->md->is_directory)
+		ext_attributes = (0040755U << 16) | 0x10;
+	else if(mbr->md->is_executable)
+		ext_attributes = (0100755U << 16);
+	else
+		ext_attributes = (0100644U << 16);
+
+	dbuf_writeu32le(zzz->cdir, (i64)ext_attributes); // ext attrib
+	dbuf_writeu32le(zzz->cdir, zip64_offset ? 0xffffffffLL : mbr->ldir_offset);
+
+	dbuf_write(zzz->cdir, (const u8*)mbr->name, fnlen);
+
+	if(num_zip64_fields>0) {
+		// The fields must be in this order, and only the ones whose 32-bit
+		// counterparts are 0xffffffff are present.
+		dbuf_writeu16le(zzz->cdir, 0x0001);
+		dbuf_writeu16le(zzz->cdir, 8*num_zip64_fields);
+		if(zip64_uncmpr_len) dbuf_writeu64le(zzz->cdir, (u64)mbr->uncmpr_len);
+		if(zip64_cmpr_len) dbuf_writeu64le(zzz->cdir, (u64)mbr->cmpr_len);
+		if(zip64_offset) dbuf_writeu64le(zzz->cdir, (u64)mbr->ldir_offset);
+	}
+
+	dbuf_copy(mbr->md->efcentral, 0, mbr->md->efcentral->len, zzz->cdir);
+}
+
+// Calculate the CRC, and compress the data if that helps.
+// This may run in a worker thread, so it must not print anything, or touch
+// anything but mbr.
+static void zipw_compress_member(struct zipw_member *mbr)
+{
+	deark *c = mbr->c;
+	dbuf *f = mbr->data;
+	struct de_crcobj *crco;
+
+	crco = de_crcobj_create(c, DE_CRCOBJ_CRC32_IEEE);
+	de_crcobj_addslice(crco, f, 0, f->len);
+	mbr->crc = de_crcobj_getval(crco);
+	de_crcobj_destroy(crco);
+
+	if(f->len>5 && f->len<=0xffffffffLL && !mbr->md->is_directory) {
+		unsigned int level;
+
+		mbr->cmpr_data = dbuf_create_membuf(c, 0, 0);
+		level = zipw_get_level(mbr);
+
+		if(!zipw_deflate(c, f, mbr->cmpr_data, level)) {
+			mbr->cmpr_failed = 1;
+		}
+		else if(mbr->cmpr_data->len < f->len) {
+			mbr->using_compression = 1;
+			zipw_set_cmpr_bit_flags(mbr, level);
+		}
+
+		if(!mbr->using_compression) {
+			// No savings - Discard compressed data
+			dbuf_close(mbr->cmpr_data);
+			mbr->cmpr_data = NULL;
+		}
+	}
+}
+
+static void zipw_compress_job(void *userdata)
+{
+	zipw_compress_member((struct zipw_member*)userdata);
+}
+
+// Write a member whose data is all in mbr->data, after zipw_compress_member()
+// has been called.
+static void zipw_write_member(deark *c, struct zipw_ctx *zzz, struct zipw_member *mbr)
+{
+	dbuf *f = mbr->data;
+
+	if(mbr->cmpr_failed) {
+		de_err(c, "Deflate compression error");
+	}
 
 	// Just a sanity check; we'll run into some other limit long before this
 	if(zzz->membercount >= 0x7fffffff) {
@@ -277,12 +487,8 @@ static void zipw_add_memberfile(deark *c, struct zipw_ctx *zzz, struct zipw_md *
 		goto done;
 	}
 
-	de_crcobj_reset(zzz->crc32o);
-	de_crcobj_addslice(zzz->crc32o, f, 0, f->len);
-	crc = de_crcobj_getval(zzz->crc32o);
-
-	ldir_offset = zzz->outf->len;
-	if(ldir_offset > 0xffffffffLL) {
+	mbr->ldir_offset = zzz->outf->len;
+	if(zzz->opt_zip64==0 && mbr->ldir_offset > 0xffffffffLL) {
 		de_err(c, "Maximum ZIP file size exceeded");
 		goto done;
 	}
@@ -290,135 +496,263 @@ static void zipw_add_memberfile(deark *c, struct zipw_ctx *zzz, struct zipw_md *
 		de_err(c, "Maximum ZIP member file size exceeded");
 		goto done;
 	}
-	cmpr_len = f->len; // default
+	mbr->uncmpr_len = f->len;
+	mbr->cmpr_len = mbr->using_compression ? mbr->cmpr_data->len : f->len;
 
-	if(f->len>5 && !md->is_directory) {
-		try_compression = 1;
+	mbr->cmpr_method = mbr->using_compression ? 8 : 0;
+	if(mbr->using_compression) mbr->ver_needed = 20;
+	else if(mbr->md->is_directory) mbr->ver_needed = 20;
+	else mbr->ver_needed = 10;
+
+	zipw_write_local_header(c, zzz, mbr);
+
+	if(mbr->using_compression) {
+		dbuf_copy(mbr->cmpr_data, 0, mbr->cmpr_data->len, zzz->outf);
+	}
+	else {
+		dbuf_copy(f, 0, f->len, zzz->outf);
 	}
 
-	if(try_compression) {
-		unsigned int level;
+	zipw_write_cdir_entry(c, zzz, mbr);
+	zzz->membercount++;
 
-		cmpr_data = dbuf_create_membuf(c, 0, 0);
+done:
+	;
+}
 
-		if ((int)level_and_flags < 0)
-			level_and_flags = MZ_DEFAULT_LEVEL;
-		level = level_and_flags & 0xF;
+static void zipw_member_destroy(deark *c, struct zipw_member *mbr)
+{
+	if(!mbr) return;
+	if(mbr->md) {
+		dbuf_close(mbr->md->eflocal);
+		dbuf_close(mbr->md->efcentral);
+		de_free(c, mbr->md);
+	}
+	dbuf_close(mbr->data);
+	dbuf_close(mbr->cmpr_data);
+	de_crcobj_destroy(mbr->crco);
+	fmtutil_tdefl_destroy(mbr->tdctx);
+	de_free(c, mbr->name);
+	de_free(c, mbr);
+}
 
-		zipw_deflate(c, zzz, f, cmpr_data, level);
+static void zipw_dequeue_head(struct zipw_ctx *zzz)
+{
+	struct zipw_member *mbr = zzz->queue_head;
 
-		if(cmpr_data->len < f->len) {
-			using_compression = 1;
-			cmpr_len = cmpr_data->len;
+	zzz->queue_head = mbr->next_queued;
+	if(!zzz->queue_head) zzz->queue_tail = NULL;
+	mbr->next_queued = NULL;
+}
 
-			// This is the logic used by Info-Zip
-			if(level<=2) bit_flags |= 4;
-			else if(level>=8) bit_flags |= 2;
-		}
-		else { // No savings - Discard compressed data
-			dbuf_close(cmpr_data);
-			cmpr_data = NULL;
+// Write finished members to the ZIP file, in the order they were created.
+// We stop at the first member that is still open (which might be the one
+// being streamed), so members are never reordered.
+// If flush_all is not set, we also stop at the first member whose worker
+// thread job is not done, unless too many members are waiting.
+static void zipw_write_queued_members(deark *c, struct zipw_ctx *zzz, int flush_all)
+{
+	while(zzz->queue_head && zzz->queue_head->is_finished) {
+		struct zipw_member *mbr = zzz->queue_head;
+
+		if(mbr->job && !flush_all && zzz->queue_len <= zzz->max_queue_len &&
+			!de_workerpool_job_is_done(zzz->wp, mbr->job))
+		{
+			break;
 		}
-	}
 
-	bit_flags |= 0x0800; // Use UTF-8 filenames
+		zipw_dequeue_head(zzz);
+		zzz->queue_len--;
 
-	dbuf_writeu32le(zzz->cdir, CODE_PK12);
-	dbuf_writeu32le(zzz->outf, CODE_PK34);
-	dbuf_writeu16le(zzz->cdir, ZIPENC_VER_MADE_BY);
+		if(mbr->job) {
+			de_workerpool_finish_job(zzz->wp, mbr->job);
+			mbr->job = NULL;
+		}
+		else {
+			zipw_compress_member(mbr);
+		}
 
-	if(using_compression) ver_needed = 20;
-	else if(md->is_directory) ver_needed = 20;
-	else ver_needed = 10;
+		zipw_write_member(c, zzz, mbr);
+		zipw_member_destroy(c, mbr);
+	}
+}
 
-	dbuf_writeu16le(zzz->cdir, ver_needed);
-	dbuf_writeu16le(zzz->outf, ver_needed);
+static void zipw_stream_data(deark *c, struct zipw_ctx *zzz, struct zipw_member *mbr,
+	const u8 *buf, i64 buf_len)
+{
+	enum fmtutil_tdefl_status ret;
 
-	dbuf_writeu16le(zzz->cdir, bit_flags);
-	dbuf_writeu16le(zzz->outf, bit_flags);
+	if(buf_len<1) return;
+	de_crcobj_addbuf(mbr->crco, buf, buf_len);
+	mbr->uncmpr_len += buf_len;
 
-	dbuf_writeu16le(zzz->cdir, using_compression?8:0); // cmpr method
-	dbuf_writeu16le(zzz->outf, using_compression?8:0);
+	if(!mbr->tdctx) {
+		dbuf_write(zzz->outf, buf, buf_len);
+		return;
+	}
 
-	dbuf_writeu16le(zzz->cdir, md->modtime_dostime);
-	dbuf_writeu16le(zzz->outf, md->modtime_dostime);
-	dbuf_writeu16le(zzz->cdir, md->modtime_dosdate);
-	dbuf_writeu16le(zzz->outf, md->modtime_dosdate);
+	ret = fmtutil_tdefl_compress_buffer(mbr->tdctx, buf, (size_t)buf_len,
+		FMTUTIL_TDEFL_NO_FLUSH);
+	if(ret != FMTUTIL_TDEFL_STATUS_OKAY) {
+		de_err(c, "Deflate compression error");
+		de_fatalerror(c);
+	}
+}
 
-	dbuf_writeu32le(zzz->cdir, crc); // crc
-	dbuf_writeu32le(zzz->outf, crc);
+static int zipw_stream_cbfn(struct de_bufferedreadctx *brctx, const u8 *buf,
+	i64 buf_len)
+{
+	struct zipw_member *mbr = (struct zipw_member*)brctx->userdata;
 
-	dbuf_writeu32le(zzz->cdir, cmpr_len); // cmpr size
-	dbuf_writeu32le(zzz->outf, cmpr_len);
-	dbuf_writeu32le(zzz->cdir, f->len); // uncmpr size
-	dbuf_writeu32le(zzz->outf, f->len);
+	zipw_stream_data(brctx->c, (struct zipw_ctx*)brctx->c->zip_data, mbr, buf, buf_len);
+	return 1;
+}
 
-	fnlen = de_strlen(name);
-	dbuf_writeu16le(zzz->cdir, fnlen);
-	dbuf_writeu16le(zzz->outf, fnlen);
+// Convert a member that has been buffered so far, into one that is written
+// to the ZIP file as it arrives.
+static void zipw_begin_streaming(deark *c, struct zipw_ctx *zzz, struct zipw_member *mbr)
+{
+	unsigned int level;
+	dbuf *pending;
+
+	// Everything created before this member has to be written first.
+	// zipw_can_stream() made sure all of it is finished.
+	zipw_write_queued_members(c, zzz, 1);
+
+	de_dbg(c, "streaming zip member %s", mbr->name);
+	mbr->is_streaming = 1;
+	mbr->ldir_offset = zzz->outf->len;
+	mbr->crco = de_crcobj_create(c, DE_CRCOBJ_CRC32_IEEE);
+
+	level = zipw_get_level(mbr);
+	if(level==0) {
+		mbr->cmpr_method = 0;
+		mbr->ver_needed = 10;
+	}
+	else {
+		mbr->cmpr_method = 8;
+		mbr->ver_needed = 20;
+		zipw_set_cmpr_bit_flags(mbr, level);
+	}
 
-	dbuf_writeu16le(zzz->cdir, md->efcentral->len); // eflen
-	dbuf_writeu16le(zzz->outf, md->eflocal->len);
+	zipw_write_local_header(c, zzz, mbr);
+	mbr->cmpr_data_pos = zzz->outf->len;
 
-	dbuf_writeu16le(zzz->cdir, 0); // file comment len
-	dbuf_writeu16le(zzz->cdir, 0); // disk number start
+	if(mbr->cmpr_method==8) {
+		mbr->tdctx = fmtutil_tdefl_create(c, zzz->outf,
+			fmtutil_tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY));
+	}
 
-	dbuf_writeu16le(zzz->cdir, 0); // int attrib
+	pending = mbr->data;
+	mbr->data = NULL;
+	dbuf_buffered_read(pending, 0, pending->len, zipw_stream_cbfn, (void*)mbr);
+	dbuf_close(pending);
+}
 
-	// Set the Unix (etc.) file attributes to "-rw-r--r--" or
-	// "-rwxr-xr-x", etc.
-	if(md->is_directory)
-		ext_attributes = (0040755U << 16) | 0x10;
-	else if(md->is_executable)
-		ext_attributes = (0100755U << 16);
-	else
-		ext_attributes = (0100644U << 16);
+static void zipw_patch_u16(struct zipw_ctx *zzz, i64 pos, i64 n)
+{
+	u8 buf[2];
 
-	dbuf_writeu32le(zzz->cdir, (i64)ext_attributes); // ext attrib
+	de_writeu16le_direct(buf, n);
+	dbuf_write_at(zzz->outf, pos, buf, 2);
+}
 
-	dbuf_writeu32le(zzz->cdir, ldir_offset);
+static void zipw_patch_u32(struct zipw_ctx *zzz, i64 pos, i64 n)
+{
+	u8 buf[4];
+
+	de_writeu32le_direct(buf, n);
+	dbuf_write_at(zzz->outf, pos, buf, 4);
+}
 
-	dbuf_write(zzz->cdir, (const u8*)name, fnlen);
-	dbuf_write(zzz->outf, (const u8*)name, fnlen);
+static void zipw_finish_streaming(deark *c, struct zipw_ctx *zzz, struct zipw_member *mbr)
+{
+	int need_zip64;
 
-	dbuf_copy(md->efcentral, 0, md->efcentral->len, zzz->cdir);
-	dbuf_copy(md->eflocal, 0, md->eflocal->len, zzz->outf);
+	if(mbr->tdctx) {
+		enum fmtutil_tdefl_status ret;
 
-	if(using_compression) {
-		if(cmpr_data) {
-			dbuf_copy(cmpr_data, 0, cmpr_data->len, zzz->outf);
+		ret = fmtutil_tdefl_compress_buffer(mbr->tdctx, NULL, 0, FMTUTIL_TDEFL_FINISH);
+		if(ret != FMTUTIL_TDEFL_STATUS_DONE) {
+			de_err(c, "Deflate compression error");
 		}
+		fmtutil_tdefl_destroy(mbr->tdctx);
+		mbr->tdctx = NULL;
 	}
-	else {
-		dbuf_copy(f, 0, f->len, zzz->outf);
+
+	mbr->cmpr_len = zzz->outf->len - mbr->cmpr_data_pos;
+	mbr->crc = de_crcobj_getval(mbr->crco);
+	need_zip64 = (mbr->uncmpr_len >= 0xffffffffLL) || (mbr->cmpr_len >= 0xffffffffLL);
+	if(need_zip64 && zzz->opt_zip64==0) {
+		// Too late to do anything but report it.
+		de_err(c, "Maximum ZIP member file size exceeded");
+		need_zip64 = 0;
+	}
+
+	// Seek back and patch the local header.
+	// As with TAR, we have to restore the file position ourselves.
+	if(need_zip64) {
+		u8 buf[ZIPW_RESERVED_EF_LEN];
+
+		mbr->ver_needed = 45;
+		zipw_patch_u16(zzz, mbr->ldir_offset+4, mbr->ver_needed);
+		de_writeu16le_direct(&buf[0], 0x0001);
+		de_writeu16le_direct(&buf[2], 16);
+		de_writeu64le_direct(&buf[4], (u64)mbr->uncmpr_len);
+		de_writeu64le_direct(&buf[12], (u64)mbr->cmpr_len);
+		dbuf_write_at(zzz->outf, mbr->reserved_ef_pos, buf, ZIPW_RESERVED_EF_LEN);
 	}
+	zipw_patch_u32(zzz, mbr->ldir_offset+14, mbr->crc);
+	zipw_patch_u32(zzz, mbr->ldir_offset+18, need_zip64 ? 0xffffffffLL : mbr->cmpr_len);
+	zipw_patch_u32(zzz, mbr->ldir_offset+22, need_zip64 ? 0xffffffffLL : mbr->uncmpr_len);
+	de_fseek(zzz->outf->fp, zzz->outf->len, SEEK_SET);
 
+	zipw_write_cdir_entry(c, zzz, mbr);
 	zzz->membercount++;
+}
 
-done:
-	if(cmpr_data) dbuf_close(cmpr_data);
+static int zipw_can_stream(struct zipw_ctx *zzz, struct zipw_member *mbr)
+{
+	struct zipw_member *m;
+
+	// We need to be able to seek back to patch the local header.
+	if(zzz->outf->btype!=DBUF_TYPE_OFILE) return 0;
+	if(mbr->md->is_directory) return 0;
+	if(zzz->opt_zip64==0 && zzz->outf->len > 0xffffffffLL) return 0;
+
+	// Members are written in the order they were created, so we can't start
+	// writing this one while an older one is still open. This also means
+	// only one member can be streamed at a time.
+	for(m=zzz->queue_head; m && m!=mbr; m=m->next_queued) {
+		if(!m->is_finished) return 0;
+	}
+	return 1;
 }
 
-void de_zip_add_file_to_archive(deark *c, dbuf *f)
+static void zipw_member_write_cb(dbuf *f, void *userdata, const u8 *buf, i64 buf_len)
 {
-	struct zipw_ctx *zzz;
-	struct zipw_md *md = NULL;
-	int write_ntfs_times = 0;
-	int write_UT_time = 0;
+	struct zipw_member *mbr = (struct zipw_member*)userdata;
+	deark *c = f->c;
+	struct zipw_ctx *zzz = (struct zipw_ctx*)c->zip_data;
 
-	md = de_malloc(c, sizeof(struct zipw_md));
+	if(mbr->is_streaming) {
+		zipw_stream_data(c, zzz, mbr, buf, buf_len);
+		return;
+	}
 
-	if(!c->zip_data) {
-		// ZIP file hasn't been created yet
-		if(!de_zip_create_file(c)) {
-			de_fatalerror(c);
-			goto done;
-		}
+	dbuf_write(mbr->data, buf, buf_len);
+	if(mbr->data->len >= ZIPW_STREAMING_THRESHOLD && zipw_can_stream(zzz, mbr)) {
+		zipw_begin_streaming(c, zzz, mbr);
 	}
+}
 
-	zzz = (struct zipw_ctx*)c->zip_data;
+static struct zipw_md *zipw_md_create(deark *c, dbuf *f)
+{
+	struct zipw_md *md = NULL;
+	int write_ntfs_times = 0;
+	int write_UT_time = 0;
 
-	de_dbg(c, "adding to zip: name=%s len=%"I64_FMT, f->name, f->len);
+	md = de_malloc(c, sizeof(struct zipw_md));
 
 	if(f->fi_copy && f->fi_copy->is_directory) {
 		md->is_directory = 1;
@@ -503,29 +837,90 @@ void de_zip_add_file_to_archive(deark *c, dbuf *f)
 		do_ntfs_times(c, md, md->efcentral, 1);
 	}
 
-	if(md->is_directory) {
+	return md;
+}
+
+// Called when a member file is created. The caller has set f->btype to
+// DBUF_TYPE_CUSTOM.
+// The data is buffered in memory, up to a point. If the member turns out to be
+// large, and the ZIP file is seekable, we switch to compressing the data and
+// writing it to the ZIP file as it arrives.
+void de_zip_start_member_file(deark *c, dbuf *f)
+{
+	struct zipw_ctx *zzz;
+	struct zipw_member *mbr;
+
+	if(!c->zip_data) {
+		// ZIP file hasn't been created yet
+		if(!de_zip_create_file(c)) {
+			de_fatalerror(c);
+			return;
+		}
+	}
+
+	zzz = (struct zipw_ctx*)c->zip_data;
+
+	mbr = de_malloc(c, sizeof(struct zipw_member));
+	mbr->c = c;
+	mbr->md = zipw_md_create(c, f);
+	mbr->bit_flags = 0x0800; // Use UTF-8 filenames
+
+	if(mbr->md->is_directory) {
 		size_t nlen;
-		char *name2;
 
 		// Append a "/" to the name
 		nlen = de_strlen(f->name);
-		name2 = de_malloc(c, (i64)nlen+2);
-		de_snprintf(name2, nlen+2, "%s/", f->name);
-
-		zipw_add_memberfile(c, zzz, md, f, name2, MZ_NO_COMPRESSION);
+		mbr->name = de_malloc(c, (i64)nlen+2);
+		de_snprintf(mbr->name, nlen+2, "%s/", f->name);
+		mbr->level_and_flags = MZ_NO_COMPRESSION;
+		// A directory entry is not expected to have any data associated
+		// with it (besides the files it contains).
+		mbr->data = dbuf_create_membuf(c, 16, 0);
+	}
+	else {
+		mbr->name = de_strdup(c, f->name);
+		mbr->level_and_flags = zzz->cmprlevel;
+		mbr->data = dbuf_create_membuf(c, 65536, 0);
+	}
 
-		de_free(c, name2);
+	if(zzz->queue_tail) {
+		zzz->queue_tail->next_queued = mbr;
 	}
 	else {
-		zipw_add_memberfile(c, zzz, md, f, f->name, zzz->cmprlevel);
+		zzz->queue_head = mbr;
 	}
+	zzz->queue_tail = mbr;
 
-done:
-	if(md) {
-		dbuf_close(md->eflocal);
-		dbuf_close(md->efcentral);
-		de_free(c, md);
+	f->userdata_for_customwrite = (void*)mbr;
+	f->customwrite_fn = zipw_member_write_cb;
+}
+
+void de_zip_end_member_file(deark *c, dbuf *f)
+{
+	struct zipw_ctx *zzz = (struct zipw_ctx*)c->zip_data;
+	struct zipw_member *mbr = (struct zipw_member*)f->userdata_for_customwrite;
+
+	if(!zzz || !mbr) return;
+	f->userdata_for_customwrite = NULL;
+	f->customwrite_fn = NULL;
+
+	de_dbg(c, "adding to zip: name=%s len=%"I64_FMT, f->name, f->len);
+
+	if(mbr->is_streaming) {
+		// A streamed member is always at the head of the queue.
+		zipw_finish_streaming(c, zzz, mbr);
+		zipw_dequeue_head(zzz);
+		zipw_member_destroy(c, mbr);
 	}
+	else {
+		if(zzz->wp) {
+			mbr->job = de_workerpool_submit(zzz->wp, zipw_compress_job, (void*)mbr);
+		}
+		mbr->is_finished = 1;
+		zzz->queue_len++;
+	}
+
+	zipw_write_queued_members(c, zzz, 0);
 }
 
 static int copy_to_FILE_cbfn(struct de_bufferedreadctx *brctx, const u8 *buf,
@@ -546,7 +941,6 @@ static void zipw_finalize(deark *c, struct zipw_ctx *zzz)
 {
 	i64 cdir_start;
 	i64 zip64_eocd_pos;
-	int opt_zip64;
 	int need_zip64 = 0;
 	int use_zip64 = 0;
 
@@ -558,10 +952,12 @@ static void zipw_finalize(deark *c, struct zipw_ctx *zzz)
 		need_zip64 = 1;
 	}
 
-	opt_zip64 = de_get_ext_option_bool(c, "archive:zip64", 0);
-	if(opt_zip64>0) {
+	if(zzz->opt_zip64>0) {
 		use_zip64 = 1; // Zip64 always
 	}
+	else if(need_zip64 && zzz->opt_zip64==0) {
+		de_err(c, "Maximum ZIP file size or number of members exceeded");
+	}
 	else if(need_zip64) {
 		use_zip64 = 1; // Zip64 auto
 		de_info(c, "Note: Writing a ZIP file that uses Zip64 extensions. Not all unzip "
@@ -640,6 +1036,14 @@ void de_zip_close_file(deark *c)
 
 	zzz = (struct zipw_ctx*)c->zip_data;
 
+	while(zzz->queue_head) {
+		zipw_write_queued_members(c, zzz, 1);
+		if(zzz->queue_head) {
+			// A member that was never closed. Leave it out, so that it
+			// doesn't hold up the ones after it.
+			zipw_dequeue_head(zzz);
+		}
+	}
 	zipw_finalize(c, zzz);
 
 	if(c->archive_to_stdout && zzz->outf && zzz->outf->btype==DBUF_TYPE_MEMBUF) {
@@ -648,7 +1052,7 @@ void de_zip_close_file(deark *c)
 
 	dbuf_close(zzz->cdir);
 	dbuf_close(zzz->outf);
-	de_crcobj_destroy(zzz->crc32o);
+	de_workerpool_destroy(zzz->wp);
 
 	de_free(c, zzz);
 	c->zip_data = NULL;
@@ -131,9 +131,31 @@ typedef void (*de_fatalerrorfn_type)(deark *c);
 #define DE_OUTPUTSTYLE_DIRECT 0
 #define DE_OUTPUTSTYLE_ARCHIVE 1
 #define DE_OUTPUTSTYLE_STDOUT 2
+#define DE_OUTPUTSTYLE_CALLBACK 3 // See de_set_output_callbacks()
 #define DE_ARCHIVEFMT_ZIP     1
 #define DE_ARCHIVEFMT_TAR     2
 
+// For DE_OUTPUTSTYLE_CALLBACK: Instead of being written to files, the
+// extracted files are passed to the caller's functions.
+struct de_output_file_info {
+	const char *name; // UTF-8. May contain "/" path separators.
+	int file_id; // The number used by the -get option
+	int is_directory;
+	int is_executable; // 1=yes, 0=no, -1=unknown
+	int mod_time_valid;
+	i64 mod_time; // Unix time
+	i64 mod_time_subsec; // Ten-millionths of a second after mod_time
+};
+// openfn returns a handle (which may be NULL), that is passed to the other
+// functions. For each file, writefn may be called any number of times, and
+// closefn is called once (unless a fatal error occurs).
+typedef void *(*de_output_open_fn)(deark *c, void *userdata,
+	const struct de_output_file_info *ofi);
+typedef void (*de_output_write_fn)(deark *c, void *userdata, void *handle,
+	const u8 *buf, i64 buf_len);
+typedef void (*de_output_close_fn)(deark *c, void *userdata, void *handle,
+	i64 file_len);
+
 void de_puts(deark *c, unsigned int flags, const char *s);
 void de_printf(deark *c, unsigned int flags, const char *fmt, ...)
 	de_gnuc_attribute ((format (printf, 3, 4)));
@@ -39,6 +39,42 @@ void de_dfilter_init_objects(deark *c, struct de_dfilter_in_params *dcmpri,
 		de_dfilter_results_clear(c, dres);
 }
 
+// Decompressors call this before doing anything else. If it returns 1, they
+// should return immediately.
+int de_dfilter_skip_unwanted_output(deark *c, struct de_dfilter_out_params *dcmpro,
+	struct de_dfilter_results *dres)
+{
+	if(!dcmpro->skip_if_unwanted) return 0;
+	if(dbuf_output_is_wanted(dcmpro->f)) return 0;
+	dres->output_skipped = 1;
+	return 1;
+}
+
+// Write decompressed data to dcmpro->f, but not past dcmpro->expected_len
+// (if len_known). *pnbytes_written is the number of bytes written so far, and
+// is updated.
+// Returns 1 if some of the data had to be discarded.
+int de_dfilter_write_to_output(struct de_dfilter_out_params *dcmpro,
+	i64 *pnbytes_written, const u8 *buf, i64 buf_len)
+{
+	i64 amt = buf_len;
+	int retval = 0;
+
+	if(dcmpro->len_known) {
+		if(*pnbytes_written >= dcmpro->expected_len) {
+			return 1;
+		}
+		if(amt > dcmpro->expected_len - *pnbytes_written) {
+			amt = dcmpro->expected_len - *pnbytes_written;
+			retval = 1;
+		}
+	}
+
+	dbuf_write(dcmpro->f, buf, amt);
+	*pnbytes_written += amt;
+	return retval;
+}
+
 void de_dfilter_set_errorf(deark *c, struct de_dfilter_results *dres, const char *modname,
 	const char *fmt, ...)
 {
@@ -138,6 +174,8 @@ void de_dfilter_decompress_oneshot(deark *c,
 {
 	struct de_dfilter_ctx *dfctx = NULL;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	dfctx = de_dfilter_create(c, codec_init_fn, codec_private_params,
 		dcmpro, dres);
 	dbuf_buffered_read(dcmpri->f, dcmpri->pos, dcmpri->len,
@@ -153,6 +191,8 @@ void fmtutil_decompress_uncompressed(deark *c, struct de_dfilter_in_params *dcmp
 	i64 len;
 	i64 nbytes_avail;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	nbytes_avail = de_min_int(dcmpri->len, dcmpri->f->len - dcmpri->pos);
 
 	if(dcmpro->len_known) {
@@ -181,6 +221,8 @@ void fmtutil_decompress_packbits_ex(deark *c, struct de_dfilter_in_params *dcmpr
 	dbuf *f = dcmpri->f;
 	dbuf *unc_pixels = dcmpro->f;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	pos = dcmpri->pos;
 	endpos = dcmpri->pos + dcmpri->len;
 
@@ -260,6 +302,8 @@ void fmtutil_decompress_packbits16_ex(deark *c, struct de_dfilter_in_params *dcm
 	dbuf *f = dcmpri->f;
 	dbuf *unc_pixels = dcmpro->f;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	pos = dcmpri->pos;
 	endpos = dcmpri->pos + dcmpri->len;
 
@@ -435,20 +479,14 @@ struct szdd_ctx {
 	struct de_lz77buffer *ringbuf;
 };
 
-static void szdd_lz77buf_writebytecb(struct de_lz77buffer *rb, const u8 n)
+static void szdd_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct szdd_ctx *sctx = (struct szdd_ctx*)rb->userdata;
 
-	if(sctx->stop_flag) return;
-	if(sctx->dcmpro->len_known) {
-		if(sctx->nbytes_written >= sctx->dcmpro->expected_len) {
-			sctx->stop_flag = 1;
-			return;
-		}
+	if(de_dfilter_write_to_output(sctx->dcmpro, &sctx->nbytes_written, buf, buf_len)) {
+		sctx->stop_flag = 1;
 	}
-
-	dbuf_writebyte(sctx->dcmpro->f, n);
-	sctx->nbytes_written++;
 }
 
 static void szdd_init_window_default(struct de_lz77buffer *ringbuf)
@@ -491,10 +529,12 @@ void fmtutil_decompress_szdd(deark *c, struct de_dfilter_in_params *dcmpri,
 	i64 endpos = dcmpri->pos + dcmpri->len;
 	struct szdd_ctx *sctx = NULL;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	sctx = de_malloc(c, sizeof(struct szdd_ctx));
 	sctx->dcmpro = dcmpro;
 	sctx->ringbuf = de_lz77buffer_create(c, 4096);
-	sctx->ringbuf->writebyte_cb = szdd_lz77buf_writebytecb;
+	sctx->ringbuf->writebytes_cb = szdd_lz77buf_writebytescb;
 	sctx->ringbuf->userdata = (void*)sctx;
 
 	if(flags & 0x1) {
@@ -554,20 +594,14 @@ struct hlplz77ctx {
 	struct de_lz77buffer *ringbuf;
 };
 
-static void hlplz77_lz77buf_writebytecb(struct de_lz77buffer *rb, const u8 n)
+static void hlplz77_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct hlplz77ctx *sctx = (struct hlplz77ctx*)rb->userdata;
 
-	if(sctx->stop_flag) return;
-	if(sctx->dcmpro->len_known) {
-		if(sctx->nbytes_written >= sctx->dcmpro->expected_len) {
-			sctx->stop_flag = 1;
-			return;
-		}
+	if(de_dfilter_write_to_output(sctx->dcmpro, &sctx->nbytes_written, buf, buf_len)) {
+		sctx->stop_flag = 1;
 	}
-
-	dbuf_writebyte(sctx->dcmpro->f, n);
-	sctx->nbytes_written++;
 }
 
 // This is very similar to the mscompress SZDD algorithm, but
@@ -580,10 +614,12 @@ void fmtutil_hlp_lz77_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
 	i64 endpos = dcmpri->pos + dcmpri->len;
 	struct hlplz77ctx *sctx = NULL;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	sctx = de_malloc(c, sizeof(struct hlplz77ctx));
 	sctx->dcmpro = dcmpro;
 	sctx->ringbuf = de_lz77buffer_create(c, 4096);
-	sctx->ringbuf->writebyte_cb = hlplz77_lz77buf_writebytecb;
+	sctx->ringbuf->writebytes_cb = hlplz77_lz77buf_writebytescb;
 	sctx->ringbuf->userdata = (void*)sctx;
 	de_lz77buffer_clear(sctx->ringbuf, 0x20);
 
@@ -663,6 +699,8 @@ void de_dfilter_decompress_two_layer(deark *c, struct de_dcmpr_two_layer_params
 	struct my_2layer_userdata u;
 	struct de_dfilter_ctx *dfctx_codec2 = NULL;
 
+	if(de_dfilter_skip_unwanted_output(c, tlp->dcmpro, tlp->dres)) return;
+
 	de_dfilter_init_objects(c, NULL, &dcmpro_codec1, NULL);
 	de_dfilter_init_objects(c, NULL, NULL, &dres_codec2);
 	de_zeromem(&u, sizeof(struct my_2layer_userdata));
@@ -764,20 +802,48 @@ void de_lz77buffer_set_curpos(struct de_lz77buffer *rb, UI newpos)
 
 void de_lz77buffer_add_literal_byte(struct de_lz77buffer *rb, u8 b)
 {
-	rb->writebyte_cb(rb, b);
 	rb->buf[rb->curpos] = b;
+	rb->writebytes_cb(rb, &rb->buf[rb->curpos], 1);
 	rb->curpos = (rb->curpos+1) & rb->mask;
 }
 
+// Copy 'count' bytes in blocks.
+// The result is the same as copying one byte at a time: if the source overlaps
+// the bytes being written, the pattern is repeated.
 void de_lz77buffer_copy_from_hist(struct de_lz77buffer *rb,
 	UI startpos, UI count)
 {
-	UI frompos;
-	UI i;
-
-	frompos = startpos & rb->mask;
-	for(i=0; i<count; i++) {
-		de_lz77buffer_add_literal_byte(rb, rb->buf[frompos]);
-		frompos = (frompos+1) & rb->mask;
+	UI dist; // Distance back to the first source byte; 1 to bufsize
+	UI srcdist;
+	UI nwritten = 0;
+
+	dist = ((rb->curpos - startpos - 1) & rb->mask) + 1;
+	srcdist = dist;
+
+	while(nwritten < count) {
+		UI frompos;
+		UI n;
+
+		frompos = (rb->curpos - srcdist) & rb->mask;
+		n = count - nwritten;
+		if(n > srcdist) n = srcdist;
+		if(n > rb->bufsize - rb->curpos) n = rb->bufsize - rb->curpos;
+		if(n > rb->bufsize - frompos) n = rb->bufsize - frompos;
+
+		// Since n<=srcdist, any source bytes that get overwritten are read first.
+		de_memmove(&rb->buf[rb->curpos], &rb->buf[frompos], (size_t)n);
+		rb->writebytes_cb(rb, &rb->buf[rb->curpos], (i64)n);
+		rb->curpos = (rb->curpos+n) & rb->mask;
+		nwritten += n;
+
+		if(dist < count) {
+			// An overlapping copy. Everything from dist bytes before the start,
+			// to here, is the repeated pattern, so we can copy from farther back,
+			// in larger blocks.
+			srcdist = ((nwritten+dist)/dist)*dist;
+			if(srcdist > rb->bufsize) {
+				srcdist = (rb->bufsize/dist)*dist;
+			}
+		}
 	}
 }
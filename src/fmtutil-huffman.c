@@ -12,6 +12,14 @@
 #define MAX_TREE_DEPTH 56
 #define MAX_MAX_NODES  66000
 
+// Parameters for the lookup tables that speed up decoding.
+// The primary table is indexed by the next (up to) LOOKUP_PRIMARY_MAX_BITS bits.
+// Codes longer than that continue in subtables, each of which is indexed by
+// (up to) LOOKUP_SUBTBL_MAX_BITS more bits.
+#define LOOKUP_PRIMARY_MAX_BITS 10
+#define LOOKUP_SUBTBL_MAX_BITS  8
+#define LOOKUP_MAX_ENTRIES      1048576
+
 struct huffman_nval_pointer_data {
 	NODE_REF_TYPE noderef;
 };
@@ -42,6 +50,22 @@ struct huffman_cursor {
 	NODE_REF_TYPE curr_noderef;
 };
 
+struct huffman_lookup_entry {
+#define LOOKUPSTATUS_INVALID  0
+#define LOOKUPSTATUS_VALUE    1
+#define LOOKUPSTATUS_SUBTABLE 2
+	u8 status;
+	u8 nbits; // Number of bits consumed by this entry
+	// If status==LOOKUPSTATUS_SUBTABLE, this is the subtable's index.
+	fmtutil_huffman_valtype value;
+};
+
+struct huffman_lookup_subtbl {
+	NODE_REF_TYPE noderef; // The tree node that this (sub)table starts at
+	UI nbits;
+	u32 first_entry; // Index into lookup_entries
+};
+
 struct fmtutil_huffman_tree {
 	// In principle, the cursor should be separate, so we could have multiple
 	// cursors for one tree. But that's inconvenient, and it's not clear that
@@ -61,6 +85,22 @@ struct fmtutil_huffman_tree {
 	i64 lengths_arr_numalloc;
 	i64 lengths_arr_numused;
 	struct huffman_lengths_arr_item *lengths_arr; // array[lengths_arr_numalloc]
+
+	// Lookup tables derived from the tree. They are constructed when needed,
+	// and discarded whenever the tree changes.
+	deark *c;
+#define LOOKUP_STATE_NONE  0
+#define LOOKUP_STATE_READY 1
+#define LOOKUP_STATE_UNAVAILABLE 2
+	u8 lookup_state;
+	u8 lookup_is_lsb; // The bit order that the tables were made for
+	u8 lookup_failed;
+	u32 lookup_num_subtbls;
+	u32 lookup_subtbls_alloc;
+	struct huffman_lookup_subtbl *lookup_subtbls; // array[lookup_subtbls_alloc]; [0] is the primary table
+	u32 lookup_num_entries;
+	u32 lookup_entries_alloc;
+	struct huffman_lookup_entry *lookup_entries; // array[lookup_entries_alloc]
 };
 
 // Ensure that at least n nodes are allocated (0 through n-1)
@@ -121,6 +161,20 @@ void fmtutil_huffman_reset_cursor(struct fmtutil_huffman_tree *ht)
 	ht->cursor.curr_noderef = 0;
 }
 
+static void huffman_discard_lookup_tables(deark *c, struct fmtutil_huffman_tree *ht)
+{
+	if(ht->lookup_state==LOOKUP_STATE_NONE) return;
+	de_free(c, ht->lookup_subtbls);
+	ht->lookup_subtbls = NULL;
+	ht->lookup_subtbls_alloc = 0;
+	ht->lookup_num_subtbls = 0;
+	de_free(c, ht->lookup_entries);
+	ht->lookup_entries = NULL;
+	ht->lookup_entries_alloc = 0;
+	ht->lookup_num_entries = 0;
+	ht->lookup_state = LOOKUP_STATE_NONE;
+}
+
 // Add a code, adding to the current tree structure as needed. Codes can be
 // added in any order.
 //
@@ -136,6 +190,7 @@ int fmtutil_huffman_add_code(deark *c, struct fmtutil_huffman_tree *ht,
 	NODE_REF_TYPE curr_noderef = 0; // Note that this may temporarily point to an unallocated node
 	int retval = 0;
 
+	huffman_discard_lookup_tables(c, ht);
 	if(code_nbits>MAX_TREE_DEPTH) goto done;
 
 	if(code_nbits<1) {
@@ -231,6 +286,174 @@ done:
 	return retval;
 }
 
+// Reverses the order of the low nbits bits of n.
+static UI huffman_reverse_bits(UI n, UI nbits)
+{
+	UI k;
+	UI r = 0;
+
+	for(k=0; k<nbits; k++) {
+		r = (r<<1) | ((n>>k)&0x1);
+	}
+	return r;
+}
+
+// Set all the entries of a (sub)table whose first 'code_nbits' bits (in the
+// order they are read) are 'code'.
+static void huffman_lookup_set_entries(struct fmtutil_huffman_tree *ht, u32 tblidx,
+	UI code, UI code_nbits, u8 status, fmtutil_huffman_valtype value)
+{
+	struct huffman_lookup_subtbl *st = &ht->lookup_subtbls[tblidx];
+	UI nsuffixbits = st->nbits - code_nbits;
+	UI suffix;
+
+	for(suffix=0; suffix < (1U<<nsuffixbits); suffix++) {
+		UI idx;
+		struct huffman_lookup_entry *e;
+
+		idx = (code<<nsuffixbits) | suffix;
+		if(ht->lookup_is_lsb) {
+			idx = huffman_reverse_bits(idx, st->nbits);
+		}
+		e = &ht->lookup_entries[st->first_entry + idx];
+		e->status = status;
+		e->nbits = (status==LOOKUPSTATUS_SUBTABLE) ? (u8)st->nbits : (u8)code_nbits;
+		e->value = value;
+	}
+}
+
+static u32 huffman_lookup_make_subtbl(struct fmtutil_huffman_tree *ht,
+	NODE_REF_TYPE noderef, UI nbits);
+
+// Fill in the part of (sub)table #tblidx that is reachable from the given node.
+// code/code_nbits are the bits that lead from the table's starting node to
+// this node.
+static void huffman_lookup_fill(struct fmtutil_huffman_tree *ht, u32 tblidx,
+	NODE_REF_TYPE noderef, UI code, UI code_nbits)
+{
+	UI child_idx;
+
+	for(child_idx=0; child_idx<=1; child_idx++) {
+		UI childcode = (code<<1) | child_idx;
+		UI childcode_nbits = code_nbits+1;
+		struct huffman_node *nd = &ht->nodes[noderef];
+		NODE_REF_TYPE nextref;
+		UI subtbl_nbits;
+		u32 subtblidx;
+
+		if(ht->lookup_failed) return;
+
+		if(nd->child_status[child_idx]==CHILDSTATUS_VALUE) {
+			huffman_lookup_set_entries(ht, tblidx, childcode, childcode_nbits,
+				LOOKUPSTATUS_VALUE, nd->child[child_idx].hnvd.value);
+			continue;
+		}
+
+		if(nd->child_status[child_idx]!=CHILDSTATUS_POINTER) {
+			huffman_lookup_set_entries(ht, tblidx, childcode, childcode_nbits,
+				LOOKUPSTATUS_INVALID, 0);
+			continue;
+		}
+
+		nextref = nd->child[child_idx].hnpd.noderef;
+		if(nextref<=noderef || nextref>=ht->next_avail_node || nextref>=ht->nodes_alloc) {
+			// Shouldn't be possible
+			ht->lookup_failed = 1;
+			return;
+		}
+
+		if(childcode_nbits < ht->lookup_subtbls[tblidx].nbits) {
+			huffman_lookup_fill(ht, tblidx, nextref, childcode, childcode_nbits);
+			continue;
+		}
+
+		// This code continues past the end of this table.
+		subtbl_nbits = LOOKUP_SUBTBL_MAX_BITS;
+		if(ht->max_bits > (UI)ht->nodes[nextref].depth &&
+			ht->max_bits - (UI)ht->nodes[nextref].depth < subtbl_nbits)
+		{
+			subtbl_nbits = ht->max_bits - (UI)ht->nodes[nextref].depth;
+		}
+		subtblidx = huffman_lookup_make_subtbl(ht, nextref, subtbl_nbits);
+		if(ht->lookup_failed) return;
+		huffman_lookup_set_entries(ht, tblidx, childcode, childcode_nbits,
+			LOOKUPSTATUS_SUBTABLE, (fmtutil_huffman_valtype)subtblidx);
+	}
+}
+
+// Returns the index of the new subtable.
+static u32 huffman_lookup_make_subtbl(struct fmtutil_huffman_tree *ht,
+	NODE_REF_TYPE noderef, UI nbits)
+{
+	deark *c = ht->c;
+	u32 tblidx;
+	u32 nentries = 1U<<nbits;
+
+	if((i64)ht->lookup_num_entries + (i64)nentries > LOOKUP_MAX_ENTRIES) {
+		ht->lookup_failed = 1;
+		return 0;
+	}
+
+	if(ht->lookup_num_subtbls >= ht->lookup_subtbls_alloc) {
+		u32 new_alloc = ht->lookup_subtbls_alloc*2;
+
+		if(new_alloc<16) new_alloc = 16;
+		ht->lookup_subtbls = de_reallocarray(c, ht->lookup_subtbls, ht->lookup_subtbls_alloc,
+			sizeof(struct huffman_lookup_subtbl), new_alloc);
+		ht->lookup_subtbls_alloc = new_alloc;
+	}
+	if(ht->lookup_num_entries + nentries > ht->lookup_entries_alloc) {
+		u32 new_alloc = ht->lookup_entries_alloc*2;
+
+		if(new_alloc < ht->lookup_num_entries + nentries) {
+			new_alloc = ht->lookup_num_entries + nentries;
+		}
+		ht->lookup_entries = de_reallocarray(c, ht->lookup_entries, ht->lookup_entries_alloc,
+			sizeof(struct huffman_lookup_entry), new_alloc);
+		ht->lookup_entries_alloc = new_alloc;
+	}
+
+	tblidx = ht->lookup_num_subtbls++;
+	ht->lookup_subtbls[tblidx].noderef = noderef;
+	ht->lookup_subtbls[tblidx].nbits = nbits;
+	ht->lookup_subtbls[tblidx].first_entry = ht->lookup_num_entries;
+	ht->lookup_num_entries += nentries;
+
+	huffman_lookup_fill(ht, tblidx, noderef, 0, 0);
+	return tblidx;
+}
+
+// Construct the lookup tables, for the given bit order.
+// On failure, sets the state to LOOKUP_STATE_UNAVAILABLE, and the slower
+// decoding method will be used.
+static void huffman_make_lookup_tables(struct fmtutil_huffman_tree *ht, u8 is_lsb)
+{
+	UI primary_nbits;
+
+	huffman_discard_lookup_tables(ht->c, ht);
+	ht->lookup_state = LOOKUP_STATE_UNAVAILABLE;
+	ht->lookup_is_lsb = is_lsb;
+	ht->lookup_failed = 0;
+
+	if(!ht->c) return;
+	if(ht->has_null_code) return;
+	if(ht->max_bits<1 || ht->max_bits>MAX_TREE_DEPTH) return;
+	if(ht->next_avail_node<1 || ht->nodes_alloc<1) return;
+
+	primary_nbits = ht->max_bits;
+	if(primary_nbits > LOOKUP_PRIMARY_MAX_BITS) {
+		primary_nbits = LOOKUP_PRIMARY_MAX_BITS;
+	}
+
+	(void)huffman_lookup_make_subtbl(ht, 0, primary_nbits);
+	if(ht->lookup_failed) {
+		huffman_discard_lookup_tables(ht->c, ht);
+		ht->lookup_state = LOOKUP_STATE_UNAVAILABLE;
+		return;
+	}
+	ht->lookup_state = LOOKUP_STATE_READY;
+}
+
 // Read the next Huffman code from a bitreader, and decode it.
 // *pval will always be written to. On error, it will be set to 0.
 // pnbits returns the number of bits read. Can be NULL.
@@ -252,6 +475,47 @@ int fmtutil_huffman_read_next_value(struct fmtutil_huffman_tree *ht,
 		goto done;
 	}
 
+	if(ht->cursor.curr_noderef==0) {
+		if(ht->lookup_state==LOOKUP_STATE_NONE ||
+			(ht->lookup_state==LOOKUP_STATE_READY && ht->lookup_is_lsb!=bitrd->bbll.is_lsb))
+		{
+			huffman_make_lookup_tables(ht, bitrd->bbll.is_lsb);
+		}
+	}
+
+	if(ht->cursor.curr_noderef==0 && ht->lookup_state==LOOKUP_STATE_READY) {
+		u32 tblidx = 0;
+
+		// Decode using the lookup tables, for as long as we can.
+		while(1) {
+			struct huffman_lookup_subtbl *st = &ht->lookup_subtbls[tblidx];
+			struct huffman_lookup_entry *e;
+			u64 code;
+
+			if(!de_bitreader_peekbits(bitrd, st->nbits, &code)) {
+				// Near the end of the data. Finish this code one bit at a time.
+				ht->cursor.curr_noderef = st->noderef;
+				break;
+			}
+
+			e = &ht->lookup_entries[st->first_entry + (u32)code];
+			de_bitreader_skipbits(bitrd, (UI)e->nbits);
+			bitcount += (int)e->nbits;
+
+			if(e->status==LOOKUPSTATUS_VALUE) {
+				*pval = e->value;
+				retval = 1;
+				goto done;
+			}
+			else if(e->status==LOOKUPSTATUS_SUBTABLE) {
+				tblidx = (u32)e->value;
+			}
+			else {
+				goto done;
+			}
+		}
+	}
+
 	while(1) {
 		int ret;
 		u8 b;
@@ -447,6 +711,7 @@ struct fmtutil_huffman_tree *fmtutil_huffman_create_tree(deark *c, i64 initial_c
 		initial_nodes = MAX_MAX_NODES;
 	}
 
+	ht->c = c;
 	huffman_ensure_alloc(c, ht, (NODE_REF_TYPE)initial_nodes);
 	ht->next_avail_node = 0;
 	ht->num_codes = 0;
@@ -458,6 +723,8 @@ struct fmtutil_huffman_tree *fmtutil_huffman_create_tree(deark *c, i64 initial_c
 void fmtutil_huffman_destroy_tree(deark *c, struct fmtutil_huffman_tree *ht)
 {
 	if(!ht) return;
+	huffman_discard_lookup_tables(c, ht);
+	de_free(c, ht->nodes);
 	de_free(c, ht->lengths_arr);
 	de_free(c, ht);
 }
@@ -649,6 +916,8 @@ void fmtutil_huff_squeeze_codectype1(deark *c, struct de_dfilter_in_params *dcmp
 	struct squeeze_ctx *sqctx = NULL;
 	int ok = 0;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	sqctx = de_malloc(c, sizeof(struct squeeze_ctx));
 	sqctx->c = c;
 	sqctx->modname = "unsqueeze";
@@ -665,7 +934,7 @@ void fmtutil_huff_squeeze_codectype1(deark *c, struct de_dfilter_in_params *dcmp
 	if(!squeeze_read_nodetable(c, sqctx)) goto done;
 	if(!squeeze_read_codes(c, sqctx)) goto done;
 
-	dres->bytes_consumed = sqctx->bitrd.curpos - dcmpri->pos;
+	dres->bytes_consumed = de_bitreader_get_curpos(&sqctx->bitrd) - dcmpri->pos;
 	if(dres->bytes_consumed > dcmpri->len) {
 		dres->bytes_consumed = dcmpri->len;
 	}
@@ -454,15 +454,12 @@ static int lzh_have_enough_output(struct lzh_ctx *cctx)
 	return 0;
 }
 
-static void lha5like_lz77buf_writebytecb(struct de_lz77buffer *rb, u8 n)
+static void lha5like_lz77buf_writebytescb(struct de_lz77buffer *rb,
+	const u8 *buf, i64 buf_len)
 {
 	struct lzh_ctx *cctx = (struct lzh_ctx*)rb->userdata;
 
-	if(lzh_have_enough_output(cctx)) {
-		return;
-	}
-	dbuf_writebyte(cctx->dcmpro->f, n);
-	cctx->nbytes_written++;
+	de_dfilter_write_to_output(cctx->dcmpro, &cctx->nbytes_written, buf, buf_len);
 }
 
 static void decompress_lha_lh5like(struct lzh_ctx *cctx, struct de_lzh_params *lzhp)
@@ -490,7 +487,7 @@ static void decompress_lha_lh5like(struct lzh_ctx *cctx, struct de_lzh_params *l
 
 	cctx->ringbuf = de_lz77buffer_create(cctx->c, rb_size);
 	cctx->ringbuf->userdata = (void*)cctx;
-	cctx->ringbuf->writebyte_cb = lha5like_lz77buf_writebytecb;
+	cctx->ringbuf->writebytes_cb = lha5like_lz77buf_writebytescb;
 	if(lzhp->use_history_fill_val) {
 		if(lzhp->history_fill_val!=0x00) {
 			de_lz77buffer_clear(cctx->ringbuf, lzhp->history_fill_val);
@@ -515,6 +512,8 @@ void fmtutil_decompress_lzh(deark *c, struct de_dfilter_in_params *dcmpri,
 {
 	struct lzh_ctx *cctx = NULL;
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	cctx = de_malloc(c, sizeof(struct lzh_ctx));
 	cctx->modname = "unlzh";
 	cctx->c = c;
@@ -542,8 +541,7 @@ void fmtutil_decompress_lzh(deark *c, struct de_dfilter_in_params *dcmpri,
 		goto done;
 	}
 
-	cctx->dres->bytes_consumed = cctx->bitrd.curpos - cctx->dcmpri->pos;
-	cctx->dres->bytes_consumed -= cctx->bitrd.bbll.nbits_in_bitbuf / 8;
+	cctx->dres->bytes_consumed = de_bitreader_get_curpos(&cctx->bitrd) - cctx->dcmpri->pos;
 	if(cctx->dres->bytes_consumed<0) {
 		cctx->dres->bytes_consumed = 0;
 	}
@@ -38,6 +38,8 @@ void fmtutil_inflate_codectype1(deark *c, struct de_dfilter_in_params *dcmpri,
 	int stream_open_flag = 0;
 	static const char *modname = "inflate";
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	dres->bytes_consumed = 0;
 	if(dcmpri->len<0) {
 		de_dfilter_set_errorf(c, dres, modname, "Internal error");
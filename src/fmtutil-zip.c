@@ -104,6 +104,8 @@ void fmtutil_decompress_zip_reduce(deark *c, struct de_dfilter_in_params *dcmpri
 	struct ozXX_udatatype uctx;
 	static const char *modname = "unreduce";
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	if(!dcmpro->len_known) goto done;
 
 	de_zeromem(&uctx, sizeof(struct ozXX_udatatype));
@@ -237,6 +239,8 @@ void fmtutil_decompress_zip_implode(deark *c, struct de_dfilter_in_params *dcmpr
 	int retval = 0;
 	static const char *modname = "unimplode";
 
+	if(de_dfilter_skip_unwanted_output(c, dcmpro, dres)) return;
+
 	de_zeromem(&zu, sizeof(struct ozXX_udatatype));
 	if(!dcmpro->len_known) goto done;
 